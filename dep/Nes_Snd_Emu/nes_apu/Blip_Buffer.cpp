@@ -30,6 +30,7 @@ Blip_Buffer::Blip_Buffer()
 	offset_ = 0;
 	buffer_size_ = 0;
 	length_ = 0;
+	point_sampled_ = false;
 	
 	bass_freq_ = 16;
 }
@@ -46,6 +46,10 @@ public:
 	// Set frequency at which high-pass filter attenuation passes -3dB
 	void bass_freq( int frequency );
 	
+	// Add transitions as plain steps at the sample they fall in, rather than
+	// band-limited. Much cheaper to synthesize, but aliases.
+	void point_sampled( bool );
+	
 	// Remove all available samples and clear buffer to silence. If 'entire_buffer' is
 	// false, just clear out any samples waiting rather than the entire buffer.
 	void clear( bool entire_buffer = true );
@@ -113,6 +117,7 @@ private:
 		resampled_time_t offset_;
 		buf_t_* buffer_;
 		unsigned buffer_size_;
+		bool point_sampled_;
 	private:
 		long reader_accum;
 		int bass_shift;
@@ -244,6 +249,10 @@ inline long Blip_Buffer::clock_rate() const {
 	return clocks_per_sec;
 }
 
+inline void Blip_Buffer::point_sampled( bool b ) {
+	point_sampled_ = b;
+}
+
 // MSVC6 fix
 typedef Blip_Buffer::resampled_time_t blip_resampled_time_t;
 
@@ -81,6 +81,10 @@ public:
 	void offset_inline( blip_time_t time, int delta ) const {
 		offset_inline( time, delta, impulse.buf );
 	}
+	
+	// Size of a transition of 1 as a plain step, for adding directly to a point
+	// sampled buffer
+	int point_unit() const { return int (impulse.offset & 0xffff); }
 };
 
 // Blip_Wave is a synthesizer for adding a *single* waveform to a Blip_Buffer.
@@ -137,6 +141,14 @@ inline void Blip_Synth<quality,range>::offset_resampled( blip_resampled_time_t t
 {
 	typedef blip_pair_t_ pair_t;
 	
+	if ( blip_buf->point_sampled_ )
+	{
+		// whole step at the centre of where the impulse would be
+		unsigned index = unsigned (time >> BLIP_BUFFER_ACCURACY) + Blip_Buffer::widest_impulse_ / 2;
+		blip_buf->buffer_ [index] += Blip_Buffer::buf_t_ (delta * point_unit());
+		return;
+	}
+	
 	unsigned sample_index = (time >> BLIP_BUFFER_ACCURACY) & ~1;
 	assert(( "Blip_Synth/Blip_wave: Went past end of buffer",
 			sample_index < blip_buf->buffer_size_ ));
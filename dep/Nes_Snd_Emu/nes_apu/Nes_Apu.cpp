@@ -163,7 +163,7 @@ void Nes_Apu::run_until( cpu_time_t end_time )
 		{
 			case 0:
 				if ( !(frame_mode & 0xc0) ) {
-		 			next_irq = time + frame_period * 4 + 1;
+		 			next_irq = time + frame_period * 4 - 1;
 		 			irq_flag = true;
 		 		}
 		 		// fall through
@@ -312,7 +312,7 @@ void Nes_Apu::write_register( cpu_time_t time, cpu_addr_t addr, int data )
 			frame = 1;
 			frame_delay += frame_period;
 			if ( irq_enabled )
-				next_irq = time + frame_delay + frame_period * 3;
+				next_irq = time + frame_delay + frame_period * 3 - 1;
 		}
 		
 		irq_changed();
@@ -57,6 +57,10 @@ public:
 	void save_snapshot( apu_snapshot_t* out ) const;
 	void load_snapshot( apu_snapshot_t const& );
 	
+	// Time in the current frame that the APU has been run up to, which is
+	// the point a snapshot is saved at. Loading one starts a new frame there.
+	cpu_time_t last_run_time() const;
+	
 	// Set overall volume (default is 1.0)
 	void volume( double );
 	
@@ -91,6 +95,10 @@ public:
 	// 'count_dmc_reads( time )' would result in the same result.
 	int count_dmc_reads( cpu_time_t t, cpu_time_t* last_read = NULL ) const;
 	
+	// Time of the next DMC read, or no_irq if none will occur. 'run_until( t )'
+	// makes the read once t is past it.
+	cpu_time_t next_dmc_read() const;
+	
 	// Run APU until specified time, so that any DMC memory reads can be
 	// accounted for (i.e. inserting CPU wait states).
 	void run_until( cpu_time_t );
@@ -141,6 +149,11 @@ inline cpu_time_t Nes_Apu::earliest_irq() const
 	return earliest_irq_;
 }
 
+inline cpu_time_t Nes_Apu::last_run_time() const
+{
+	return last_time;
+}
+
 inline void Nes_Apu::dmc_reader( int (*func)( void*, cpu_addr_t ), void* user_data )
 {
 	dmc.rom_reader_data = user_data;
@@ -157,6 +170,11 @@ inline int Nes_Apu::count_dmc_reads( cpu_time_t time, cpu_time_t* last_read ) co
 {
 	return dmc.count_reads( time, last_read );
 }
+
+inline cpu_time_t Nes_Apu::next_dmc_read() const
+{
+	return dmc.next_read();
+}
 	
 #endif
 
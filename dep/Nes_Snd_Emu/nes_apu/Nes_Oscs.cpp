@@ -279,6 +279,14 @@ int Nes_Dmc::count_reads( cpu_time_t time, cpu_time_t* last_read ) const
 	return count;
 }
 
+cpu_time_t Nes_Dmc::next_read() const
+{
+	if ( length_counter == 0 )
+		return Nes_Apu::no_irq; // not reading
+	
+	return apu->last_time + delay + long (bits_remain - 1) * period;
+}
+
 static const short dmc_period_table [2] [16] = {
 	0x1ac, 0x17c, 0x154, 0x140, 0x11e, 0x0fe, 0x0e2, 0x0d6, // NTSC
 	0x0be, 0x0a0, 0x08e, 0x080, 0x06a, 0x054, 0x048, 0x036,
@@ -473,20 +481,43 @@ void Nes_Noise::run( cpu_time_t time, cpu_time_t end_time )
 			int delta = amp * 2 - volume;
 			const int tap = (regs [2] & mode_flag ? 8 : 13);
 			
-			do {
-				int feedback = (noise << tap) ^ (noise << 14);
-				time += period;
-				
-				if ( (noise + 1) & 2 ) {
-					// bits 0 and 1 of noise differ
-					delta = -delta;
-					synth.offset_resampled( rtime, delta, output );
+			if ( output->point_sampled_ )
+			{
+				// every step is added, as nothing if the output doesn't change, since
+				// the noise is too unpredictable to branch on
+				Blip_Buffer::buf_t_* const buf = output->buffer_ + Blip_Buffer::widest_impulse_ / 2;
+				const int unit = synth.point_unit();
+				do {
+					int feedback = (noise << tap) ^ (noise << 14);
+					time += period;
+					
+					// all ones if bits 0 and 1 of noise differ
+					int changed = -(((noise + 1) >> 1) & 1);
+					delta = (delta ^ changed) - changed;
+					buf [rtime >> BLIP_BUFFER_ACCURACY] += Blip_Buffer::buf_t_ ((delta & changed) * unit);
+					
+					rtime += rperiod;
+					noise = (feedback & 0x4000) | (noise >> 1);
 				}
-				
-				rtime += rperiod;
-				noise = (feedback & 0x4000) | (noise >> 1);
+				while ( time < end_time );
+			}
+			else
+			{
+				do {
+					int feedback = (noise << tap) ^ (noise << 14);
+					time += period;
+					
+					if ( (noise + 1) & 2 ) {
+						// bits 0 and 1 of noise differ
+						delta = -delta;
+						synth.offset_resampled( rtime, delta, output );
+					}
+					
+					rtime += rperiod;
+					noise = (feedback & 0x4000) | (noise >> 1);
+				}
+				while ( time < end_time );
 			}
-			while ( time < end_time );
 			
 			last_amp = (delta + volume) >> 1;
 			this->noise = noise;
@@ -136,6 +136,7 @@ struct Nes_Dmc : Nes_Osc
 	void reload_sample();
 	void reset();
 	int count_reads( cpu_time_t, cpu_time_t* ) const;
+	cpu_time_t next_read() const;
 };
 
 #endif
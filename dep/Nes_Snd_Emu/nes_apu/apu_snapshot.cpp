@@ -111,6 +111,16 @@ void Nes_Apu::load_snapshot( apu_snapshot_t const& state )
 	frame       = state.step;
 	irq_flag    = state.irq_flag;
 	
+	// write_register() above scheduled the frame IRQ for a counter that was just reset
+	next_irq = no_irq;
+	if ( !(frame_mode & 0xc0) )
+	{
+		next_irq = frame_delay;
+		for ( int f = frame; f != 0; f = (f + 1) & 3 )
+			next_irq += frame_period - (f == 1 ? 2 : 0);
+		next_irq += 1;
+	}
+	
 	typedef apu_reflection<0> refl;
 	apu_snapshot_t& st = (apu_snapshot_t&) state; // const_cast
 	refl::reflect_square  ( st.square1,     square1 );
@@ -118,7 +128,11 @@ void Nes_Apu::load_snapshot( apu_snapshot_t const& state )
 	refl::reflect_triangle( st.triangle,    triangle );
 	refl::reflect_noise   ( st.noise,       noise );
 	refl::reflect_dmc     ( st.dmc,         dmc );
+	
+	// starting the DMC above ends its placeholder sample, which clears its enable
+	osc_enables = state.w4015;
 	dmc.recalc_irq();
+	irq_changed();
 	dmc.last_amp = dmc.dac;
 }
 
@@ -1,12 +1,24 @@
 #include "audio.h"
 #include "YBaseLib/Assert.h"
+#include "YBaseLib/ByteStream.h"
 #include "YBaseLib/Log.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
 Log_SetChannel(Audio);
 
 Audio::Audio() = default;
 
 Audio::~Audio() = default;
 
+u32 Audio::GetBufferedSamples() const
+{
+  const u32 read_position = m_read_position.load(std::memory_order_acquire);
+  const u32 write_position = m_write_position.load(std::memory_order_acquire);
+  return std::min(write_position - read_position, m_ring_size);
+}
+
 bool Audio::Reconfigure(u32 output_sample_rate /*= DefaultOutputSampleRate*/, u32 channels /*= 1*/,
                         u32 buffer_size /*= DefaultBufferSize*/, u32 buffer_count /*= DefaultBufferCount*/)
 {
@@ -16,14 +28,18 @@ bool Audio::Reconfigure(u32 output_sample_rate /*= DefaultOutputSampleRate*/, u3
   m_output_sample_rate = output_sample_rate;
   m_channels = channels;
   m_buffer_size = buffer_size;
-  AllocateBuffers(buffer_count);
+  m_buffer_count = buffer_count;
+  AllocateRing(buffer_size * buffer_count);
   m_output_paused = true;
 
   if (!OpenDevice())
   {
     EmptyBuffers();
-    m_buffers.clear();
+    m_ring.clear();
+    m_ring_size = 0;
+    m_ring_mask = 0;
     m_buffer_size = 0;
+    m_buffer_count = 0;
     m_output_sample_rate = 0;
     m_channels = 0;
     return false;
@@ -52,8 +68,11 @@ void Audio::Shutdown()
 
   CloseDevice();
   EmptyBuffers();
-  m_buffers.clear();
+  m_ring.clear();
+  m_ring_size = 0;
+  m_ring_mask = 0;
   m_buffer_size = 0;
+  m_buffer_count = 0;
   m_output_sample_rate = 0;
   m_channels = 0;
   m_output_paused = true;
@@ -61,141 +80,314 @@ void Audio::Shutdown()
 
 void Audio::BeginWrite(SampleType** buffer_ptr, u32* num_samples)
 {
-  m_buffer_lock.lock();
+  const u32 write_position = m_write_position.load(std::memory_order_relaxed);
+  const u32 write_offset = write_position & m_ring_mask;
+  const u32 space_to_end = m_ring_size - write_offset;
+
+  // Only touch the consumer's cache line when the last known read position limits the span.
+  u32 free_space = m_ring_size - (write_position - m_producer_cached_read_position);
+  if (free_space < space_to_end)
+  {
+    m_producer_cached_read_position = m_read_position.load(std::memory_order_acquire);
+    free_space = m_ring_size - (write_position - m_producer_cached_read_position);
+
+    // A paused device will never make space, so don't wait on it.
+    while (free_space == 0 && m_blocking_writes && !m_output_paused)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      m_producer_cached_read_position = m_read_position.load(std::memory_order_acquire);
+      free_space = m_ring_size - (write_position - m_producer_cached_read_position);
+    }
+  }
+
+  *buffer_ptr = m_ring.data() + (write_offset * m_channels);
+  *num_samples = std::min(free_space, space_to_end);
+}
+
+void Audio::EndWrite(u32 num_samples)
+{
+  const u32 write_position = m_write_position.load(std::memory_order_relaxed);
+  DebugAssert((write_position + num_samples - m_producer_cached_read_position) <= m_ring_size);
 
-  if (m_num_free_buffers == 0)
-    DropBuffer();
+  // Release, so the consumer sees the samples before the new position.
+  m_write_position.store(write_position + num_samples, std::memory_order_release);
+}
 
-  Buffer& buffer = m_buffers[m_first_free_buffer];
-  *buffer_ptr = buffer.data.data() + buffer.write_position;
-  *num_samples = m_buffer_size - buffer.write_position;
+void Audio::DropSamples(u32 num_samples)
+{
+  m_overrun_samples.fetch_add(num_samples, std::memory_order_relaxed);
 }
 
 void Audio::WriteSamples(const SampleType* samples, u32 num_samples)
 {
-  std::lock_guard<std::mutex> guard(m_buffer_lock);
   u32 remaining_samples = num_samples;
 
+  // At most two spans, one up to the end of the ring and one from the start.
   while (remaining_samples > 0)
   {
-    if (m_num_free_buffers == 0)
-      DropBuffer();
-
-    Buffer& buffer = m_buffers[m_first_free_buffer];
-    const u32 to_this_buffer = std::min(m_buffer_size - buffer.write_position, remaining_samples);
+    SampleType* buffer;
+    u32 buffer_samples;
+    BeginWrite(&buffer, &buffer_samples);
+    if (buffer_samples == 0)
+    {
+      DropSamples(remaining_samples);
+      break;
+    }
 
-    const u32 copy_count = to_this_buffer * m_channels;
-    std::memcpy(&buffer.data[buffer.write_position * m_channels], samples, copy_count * sizeof(SampleType));
+    const u32 to_this_span = std::min(buffer_samples, remaining_samples);
+    const u32 copy_count = to_this_span * m_channels;
+    std::memcpy(buffer, samples, copy_count * sizeof(SampleType));
     samples += copy_count;
+    remaining_samples -= to_this_span;
+    EndWrite(to_this_span);
+  }
+}
 
-    remaining_samples -= to_this_buffer;
-    buffer.write_position += to_this_buffer;
+u32 Audio::ReadSamples(SampleType* samples, u32 num_samples)
+{
+  const u32 read_position = m_read_position.load(std::memory_order_relaxed);
 
-    // End of the buffer?
-    if (buffer.write_position == m_buffer_size)
-    {
-      // Reset it back to the start, and enqueue it.
-      buffer.write_position = 0;
-      m_num_free_buffers--;
-      m_first_free_buffer = (m_first_free_buffer + 1) % m_buffers.size();
-      m_num_available_buffers++;
-    }
+  // Only touch the producer's cache line when the last known write position can't satisfy the read.
+  u32 available = m_consumer_cached_write_position - read_position;
+  if (available < num_samples)
+  {
+    m_consumer_cached_write_position = m_write_position.load(std::memory_order_acquire);
+    available = m_consumer_cached_write_position - read_position;
+  }
+
+  const u32 read_count = std::min(available, num_samples);
+  const u32 read_offset = read_position & m_ring_mask;
+  const u32 first_count = std::min(read_count, m_ring_size - read_offset);
+  std::memcpy(samples, m_ring.data() + (read_offset * m_channels), first_count * m_channels * sizeof(SampleType));
+  if (first_count < read_count)
+  {
+    std::memcpy(samples + (first_count * m_channels), m_ring.data(),
+                (read_count - first_count) * m_channels * sizeof(SampleType));
   }
+
+  // Release, so the producer doesn't overwrite the samples before we have copied them.
+  m_read_position.store(read_position + read_count, std::memory_order_release);
+
+  if (read_count < num_samples)
+    m_underrun_samples.fetch_add(num_samples - read_count, std::memory_order_relaxed);
+
+  // A sample written now plays after everything still queued, and the block the device is about to play.
+  const u32 latency = (available - read_count) + num_samples;
+  const u32 last_latency = m_latency_samples.load(std::memory_order_relaxed);
+  m_latency_samples.store(last_latency + ((s32(latency) - s32(last_latency)) / 8), std::memory_order_relaxed);
+
+  return read_count;
 }
 
-void Audio::EndWrite(u32 num_samples)
+void Audio::AllocateRing(u32 min_size)
 {
-  Buffer& buffer = m_buffers[m_first_free_buffer];
-  DebugAssert((buffer.write_position + num_samples) <= m_buffer_size);
-  buffer.write_position += num_samples;
+  // Power of two size, so positions can wrap around the u32 range.
+  u32 size = 1;
+  while (size < min_size)
+    size <<= 1;
+
+  m_ring.resize(size * m_channels);
+  m_ring_size = size;
+  m_ring_mask = size - 1;
+  EmptyBuffers();
+}
 
-  // End of the buffer?
-  if (buffer.write_position == m_buffer_size)
+void Audio::EmptyBuffers()
+{
+  m_write_position.store(0, std::memory_order_relaxed);
+  m_read_position.store(0, std::memory_order_relaxed);
+  m_producer_cached_read_position = 0;
+  m_consumer_cached_write_position = 0;
+  m_latency_samples.store(0, std::memory_order_relaxed);
+}
+
+NullAudio::NullAudio() = default;
+
+NullAudio::~NullAudio() = default;
+
+void NullAudio::Drain()
+{
+  // Only read what is queued, so the reads aren't counted as underruns.
+  SampleType scratch[1024];
+  u32 remaining = GetBufferedSamples();
+  while (remaining > 0)
   {
-    // Reset it back to the start, and enqueue it.
-    // Log_DevPrintf("Enqueue buffer %u", m_first_free_buffer);
-    buffer.write_position = 0;
-    m_num_free_buffers--;
-    m_first_free_buffer = (m_first_free_buffer + 1) % m_buffers.size();
-    m_num_available_buffers++;
+    const u32 count = std::min(remaining, u32(countof(scratch)) / m_channels);
+    ReadSamples(scratch, count);
+    remaining -= count;
   }
+}
 
-  m_buffer_lock.unlock();
+bool NullAudio::OpenDevice()
+{
+  return true;
 }
 
-u32 Audio::ReadSamples(SampleType* samples, u32 num_samples)
+void NullAudio::PauseDevice(bool paused) {}
+
+void NullAudio::CloseDevice() {}
+
+FileAudio::FileAudio(const char* filename, Format format) : m_filename(filename), m_format(format)
 {
-  std::lock_guard<std::mutex> guard(m_buffer_lock);
-  u32 remaining_samples = num_samples;
+  // Never drop samples, wait for the writer instead.
+  SetBlockingWrites(true);
+}
 
-  while (remaining_samples > 0 && m_num_available_buffers > 0)
-  {
-    Buffer& buffer = m_buffers[m_first_available_buffer];
-    const u32 from_this_buffer = std::min(m_buffer_size - buffer.read_position, remaining_samples);
+FileAudio::~FileAudio()
+{
+  if (m_stream)
+    FileAudio::CloseDevice();
+}
 
-    const u32 copy_count = from_this_buffer * m_channels;
-    std::memcpy(samples, &buffer.data[buffer.read_position * m_channels], copy_count * sizeof(SampleType));
-    samples += copy_count;
+std::unique_ptr<FileAudio> FileAudio::Create(const char* filename, Format format /* = Format::WAV */)
+{
+  return std::make_unique<FileAudio>(filename, format);
+}
 
-    remaining_samples -= from_this_buffer;
-    buffer.read_position += from_this_buffer;
+bool FileAudio::OpenDevice()
+{
+  DebugAssert(!m_stream);
+  if (!ByteStream_OpenFileStream(m_filename.c_str(),
+                                 BYTESTREAM_OPEN_CREATE | BYTESTREAM_OPEN_WRITE | BYTESTREAM_OPEN_TRUNCATE, &m_stream))
+  {
+    Log_ErrorPrintf("Failed to open '%s' for writing", m_filename.c_str());
+    return false;
+  }
 
-    if (buffer.read_position == m_buffer_size)
-    {
-      // Log_DevPrintf("Finish dequeing buffer %u", m_first_available_buffer);
-      // End of this buffer.
-      buffer.read_position = 0;
-      m_num_available_buffers--;
-      m_first_available_buffer = (m_first_available_buffer + 1) % m_buffers.size();
-      m_num_free_buffers++;
-    }
+  // The sizes are filled in when the file is closed.
+  if (m_format == Format::WAV && !WriteWAVHeader(0))
+  {
+    Log_ErrorPrintf("Failed to write header to '%s'", m_filename.c_str());
+    m_stream->Release();
+    m_stream = nullptr;
+    return false;
   }
 
-  return num_samples - remaining_samples;
+  m_write_buffer.resize(WRITE_BUFFER_SIZE * m_channels);
+  m_write_buffer_samples = 0;
+  m_samples_written.store(0, std::memory_order_relaxed);
+  return true;
+}
+
+void FileAudio::PauseDevice(bool paused)
+{
+  // Everything queued is written out before pausing, as the ring is emptied afterwards.
+  if (paused)
+    StopWriter();
+  else
+    StartWriter();
 }
 
-void Audio::AllocateBuffers(u32 buffer_count)
+void FileAudio::CloseDevice()
 {
-  m_buffers.resize(buffer_count);
-  for (u32 i = 0; i < buffer_count; i++)
+  DebugAssert(m_stream);
+  StopWriter();
+
+  if (m_format == Format::WAV)
   {
-    Buffer& buffer = m_buffers[i];
-    buffer.data.resize(m_buffer_size * m_channels);
-    buffer.read_position = 0;
-    buffer.write_position = 0;
+    const u64 data_size = GetSamplesWritten() * m_channels * sizeof(SampleType);
+    if (data_size > (0xFFFFFFFFu - WAV_HEADER_SIZE))
+      Log_WarningPrintf("'%s' is larger than 4GB, WAV header sizes are invalid", m_filename.c_str());
+
+    if (!m_stream->SeekAbsolute(0) || !WriteWAVHeader(static_cast<u32>(data_size)))
+      Log_ErrorPrintf("Failed to update header of '%s'", m_filename.c_str());
   }
 
-  m_first_available_buffer = 0;
-  m_num_available_buffers = 0;
-  m_first_free_buffer = 0;
-  m_num_free_buffers = buffer_count;
+  m_stream->Commit();
+  m_stream->Release();
+  m_stream = nullptr;
+  m_write_buffer = {};
 }
 
-void Audio::DropBuffer()
+void FileAudio::StartWriter()
 {
-  DebugAssert(m_num_available_buffers > 0);
-  // Log_DevPrintf("Dropping buffer %u", m_first_free_buffer);
+  if (m_writer_running.load())
+    return;
+
+  m_writer_running.store(true);
+  m_writer_thread = std::thread(&FileAudio::WriterThreadEntry, this);
+}
 
-  // Out of space. We'll overwrite the oldest buffer with the new data.
-  // At the same time, we shift the available buffer forward one.
-  m_first_available_buffer = (m_first_available_buffer + 1) % m_buffers.size();
-  m_num_available_buffers--;
+void FileAudio::StopWriter()
+{
+  if (!m_writer_running.load())
+    return;
 
-  m_buffers[m_first_free_buffer].read_position = 0;
-  m_buffers[m_first_free_buffer].write_position = 0;
-  m_num_free_buffers++;
+  m_writer_running.store(false);
+  m_writer_thread.join();
 }
 
-void Audio::EmptyBuffers()
+void FileAudio::WriterThreadEntry()
 {
-  for (Buffer& buffer : m_buffers)
+  while (m_writer_running.load())
   {
-    buffer.read_position = 0;
-    buffer.write_position = 0;
+    if (!ReadToWriteBuffer())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
   }
 
-  m_first_free_buffer = 0;
-  m_num_free_buffers = static_cast<u32>(m_buffers.size());
-  m_first_available_buffer = 0;
-  m_num_available_buffers = 0;
+  // Drain whatever was queued before stopping.
+  while (ReadToWriteBuffer())
+    ;
+
+  FlushWriteBuffer();
 }
+
+bool FileAudio::ReadToWriteBuffer()
+{
+  // Only ask for what is queued, so the writer isn't counted as underrunning.
+  const u32 space = WRITE_BUFFER_SIZE - m_write_buffer_samples;
+  const u32 count = std::min(GetBufferedSamples(), space);
+  if (count == 0)
+    return false;
+
+  ReadSamples(m_write_buffer.data() + (m_write_buffer_samples * m_channels), count);
+  m_write_buffer_samples += count;
+  if (m_write_buffer_samples == WRITE_BUFFER_SIZE)
+    FlushWriteBuffer();
+
+  return true;
+}
+
+void FileAudio::FlushWriteBuffer()
+{
+  if (m_write_buffer_samples == 0)
+    return;
+
+  if (!m_stream->Write2(m_write_buffer.data(), m_write_buffer_samples * m_channels * sizeof(SampleType)))
+    Log_ErrorPrintf("Failed to write to '%s'", m_filename.c_str());
+
+  m_samples_written.fetch_add(m_write_buffer_samples, std::memory_order_relaxed);
+  m_write_buffer_samples = 0;
+}
+
+bool FileAudio::WriteWAVHeader(u32 data_size)
+{
+  const u32 block_align = m_channels * sizeof(SampleType);
+
+  u8 header[WAV_HEADER_SIZE];
+  auto put16 = [&header](u32 offset, u32 value) {
+    header[offset + 0] = u8(value);
+    header[offset + 1] = u8(value >> 8);
+  };
+  auto put32 = [&header](u32 offset, u32 value) {
+    header[offset + 0] = u8(value);
+    header[offset + 1] = u8(value >> 8);
+    header[offset + 2] = u8(value >> 16);
+    header[offset + 3] = u8(value >> 24);
+  };
+
+  // RIFF header, PCM format chunk, then the data chunk.
+  std::memcpy(&header[0], "RIFF", 4);
+  put32(4, WAV_HEADER_SIZE - 8 + data_size);
+  std::memcpy(&header[8], "WAVEfmt ", 8);
+  put32(16, 16);
+  put16(20, 1);
+  put16(22, m_channels);
+  put32(24, m_output_sample_rate);
+  put32(28, m_output_sample_rate * block_align);
+  put16(32, block_align);
+  put16(34, sizeof(SampleType) * 8);
+  std::memcpy(&header[36], "data", 4);
+  put32(40, data_size);
+  return m_stream->Write2(header, sizeof(header));
+}
\ No newline at end of file
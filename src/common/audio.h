@@ -1,10 +1,18 @@
 #pragma once
 #include "types.h"
+#include <atomic>
 #include <memory>
-#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
+class ByteStream;
+
 // Uses signed 16-bits samples.
+//
+// Samples are passed from the emulation thread (the single producer) to the output device's thread (the single
+// consumer) through a lock-free ring. Neither side ever waits on the other: when the ring is full, new samples are
+// dropped, and when it is empty, the device is given silence. Both cases are counted.
 
 class Audio
 {
@@ -24,19 +32,48 @@ public:
   u32 GetOutputSampleRate() const { return m_output_sample_rate; }
   u32 GetChannels() const { return m_channels; }
   u32 GetBufferSize() const { return m_buffer_size; }
-  u32 GetBufferCount() const { return static_cast<u32>(m_buffers.size()); }
+  u32 GetBufferCount() const { return m_buffer_count; }
+
+  // Capacity of the ring in sample frames. Rounded up to a power of two from buffer_size * buffer_count.
+  u32 GetRingSize() const { return m_ring_size; }
+
+  // Number of sample frames queued for output. Safe to call from any thread, but only approximate if the other side
+  // is running at the same time.
+  u32 GetBufferedSamples() const;
+
+  // Output latency in sample frames, measured by the device's thread: samples still queued after each read, plus the
+  // block just handed to the device. Smoothed over recent reads.
+  u32 GetLatencySamples() const { return m_latency_samples.load(std::memory_order_relaxed); }
+
+  // Sample frames dropped because the ring was full, and frames of silence output because it was empty.
+  u64 GetOverrunSampleCount() const { return m_overrun_samples.load(std::memory_order_relaxed); }
+  u64 GetUnderrunSampleCount() const { return m_underrun_samples.load(std::memory_order_relaxed); }
 
   bool Reconfigure(u32 output_sample_rate = DefaultOutputSampleRate, u32 channels = 1,
                    u32 buffer_size = DefaultBufferSize, u32 buffer_count = DefaultBufferCount);
 
+  bool IsOutputPaused() const { return m_output_paused; }
   void PauseOutput(bool paused);
+
+  // Discards all queued samples. The device must be paused or closed.
   void EmptyBuffers();
 
   void Shutdown();
 
+  // When enabled, a write to a full ring waits for the device to make space instead of dropping samples. This paces
+  // the emulation thread on the audio clock at the granularity samples are written, which is what allows a ring
+  // smaller than a video frame. Only the producer waits; the device's thread still never blocks.
+  void SetBlockingWrites(bool enabled) { m_blocking_writes = enabled; }
+  bool GetBlockingWrites() const { return m_blocking_writes; }
+
+  // Producer side, only called from the emulation thread.
+  // BeginWrite returns the largest contiguous free span of the ring, which may be zero if it is full. The caller
+  // writes directly into it, then commits the samples with EndWrite. Samples which do not fit should be passed to
+  // DropSamples, so they are accounted for.
   void BeginWrite(SampleType** buffer_ptr, u32* num_samples);
-  void WriteSamples(const SampleType* samples, u32 num_samples);
   void EndWrite(u32 num_samples);
+  void DropSamples(u32 num_samples);
+  void WriteSamples(const SampleType* samples, u32 num_samples);
 
 protected:
   virtual bool OpenDevice() = 0;
@@ -45,33 +82,100 @@ protected:
 
   bool IsDeviceOpen() const { return (m_output_sample_rate > 0); }
 
+  // Consumer side, only called from the device's thread. Returns the number of sample frames read.
   u32 ReadSamples(SampleType* samples, u32 num_samples);
 
   u32 m_output_sample_rate = 0;
   u32 m_channels = 0;
   u32 m_buffer_size = 0;
+  u32 m_buffer_count = 0;
 
 private:
-  struct Buffer
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+
+  void AllocateRing(u32 min_size);
+
+  // Positions are free-running frame counters, and are masked to index the ring.
+  std::vector<SampleType> m_ring;
+  u32 m_ring_size = 0;
+  u32 m_ring_mask = 0;
+  bool m_output_paused = true;
+  bool m_blocking_writes = false;
+
+  // Written by the producer. Aligned away from the consumer's state, so the two threads do not invalidate each
+  // other's cache lines on every update.
+  alignas(CACHE_LINE_SIZE) std::atomic<u32> m_write_position{0};
+  u32 m_producer_cached_read_position = 0;
+  std::atomic<u64> m_overrun_samples{0};
+
+  // Written by the consumer.
+  alignas(CACHE_LINE_SIZE) std::atomic<u32> m_read_position{0};
+  u32 m_consumer_cached_write_position = 0;
+  std::atomic<u64> m_underrun_samples{0};
+  std::atomic<u32> m_latency_samples{0};
+};
+
+// Discards the output, for running without an audio device. Nothing reads the ring on its own, so the owner must call
+// Drain() regularly (e.g. once a frame), otherwise samples are dropped once it fills. Synthesis runs as normal.
+class NullAudio final : public Audio
+{
+public:
+  NullAudio();
+  ~NullAudio();
+
+  // Discards all queued samples, as the device would.
+  void Drain();
+
+protected:
+  bool OpenDevice() override;
+  void PauseDevice(bool paused) override;
+  void CloseDevice() override;
+};
+
+// Writes the output to a WAV or raw PCM file, as fast as it is generated rather than in real time. The file is
+// written on a background thread in large blocks. Samples are never dropped: if the writer falls behind, emulation
+// waits for it.
+class FileAudio final : public Audio
+{
+public:
+  enum class Format
   {
-    std::vector<SampleType> data;
-    u32 write_position;
-    u32 read_position;
+    WAV,
+    RawPCM
   };
 
-  void AllocateBuffers(u32 buffer_count);
-  void DropBuffer();
+  FileAudio(const char* filename, Format format);
+  ~FileAudio();
 
-  std::vector<Buffer> m_buffers;
-  std::mutex m_buffer_lock;
+  static std::unique_ptr<FileAudio> Create(const char* filename, Format format = Format::WAV);
 
-  // For input.
-  u32 m_first_free_buffer = 0;
-  u32 m_num_free_buffers = 0;
+  // Number of sample frames written to the file so far.
+  u64 GetSamplesWritten() const { return m_samples_written.load(std::memory_order_relaxed); }
 
-  // For output.
-  u32 m_num_available_buffers = 0;
-  u32 m_first_available_buffer = 0;
+protected:
+  bool OpenDevice() override;
+  void PauseDevice(bool paused) override;
+  void CloseDevice() override;
 
-  bool m_output_paused = true;
+private:
+  static const u32 WRITE_BUFFER_SIZE = 64 * 1024;
+  static const u32 WAV_HEADER_SIZE = 44;
+
+  void StartWriter();
+  void StopWriter();
+  void WriterThreadEntry();
+  bool ReadToWriteBuffer();
+  void FlushWriteBuffer();
+  bool WriteWAVHeader(u32 data_size);
+
+  std::string m_filename;
+  Format m_format;
+
+  ByteStream* m_stream = nullptr;
+  std::vector<SampleType> m_write_buffer;
+  u32 m_write_buffer_samples = 0;
+
+  std::thread m_writer_thread;
+  std::atomic_bool m_writer_running{false};
+  std::atomic<u64> m_samples_written{0};
 };
\ No newline at end of file
@@ -84,6 +84,66 @@ void Display::CopyFrame(const void* pixels, u32 stride)
   }
 }
 
+// 3x5 glyphs for ' ' to 'Z', one bit per pixel, row by row from the top left.
+static const u16 s_overlay_font[] = {
+  0x0000, 0x2482, 0x5A00, 0x5F7D, 0x3C9E, 0x52A5, 0x2AAB, 0x2400, 0x1491, 0x4494, 0x0AA8, 0x05D0, 0x0014, 0x01C0,
+  0x0002, 0x12A4, 0x7B6F, 0x2C97, 0x73E7, 0x73CF, 0x5BC9, 0x79CF, 0x79EF, 0x7252, 0x7BEF, 0x7BCF, 0x0410, 0x0414,
+  0x1511, 0x0E38, 0x4454, 0x7282, 0x7B67, 0x2BED, 0x6BAE, 0x3923, 0x6B6E, 0x79A7, 0x79A4, 0x396B, 0x5BED, 0x7497,
+  0x126A, 0x5BAD, 0x4927, 0x5FED, 0x6B6D, 0x2B6A, 0x6BA4, 0x2B73, 0x6BAD, 0x388E, 0x7492, 0x5B6F, 0x5B6A, 0x5BFD,
+  0x5AAD, 0x5A92, 0x72A7};
+
+void Display::DrawOverlay()
+{
+  static constexpr u32 GLYPH_WIDTH = 3;
+  static constexpr u32 GLYPH_HEIGHT = 5;
+  static constexpr u32 CELL_WIDTH = GLYPH_WIDTH + 1;
+  static constexpr u32 CELL_HEIGHT = GLYPH_HEIGHT + 1;
+  static constexpr u32 BACKGROUND_COLOR = PackRGB(0, 0, 0);
+  static constexpr u32 TEXT_COLOR = PackRGB(255, 255, 255);
+
+  if (m_overlay_text.empty() || !m_framebuffer_pointer)
+    return;
+
+  // Each line is drawn on an opaque box, one pixel wider than the text all round, so it reads over any picture. The
+  // pixels are only written, as the framebuffer may be mapped write-only.
+  u32 y = 0;
+  size_t line_start = 0;
+  while (line_start < m_overlay_text.size() && (y + CELL_HEIGHT + 1) <= m_framebuffer_height)
+  {
+    size_t line_end = m_overlay_text.find('\n', line_start);
+    if (line_end == std::string::npos)
+      line_end = m_overlay_text.size();
+
+    const u32 max_length = (m_framebuffer_width - 1) / CELL_WIDTH;
+    const u32 length = std::min(static_cast<u32>(line_end - line_start), max_length);
+    const u32 box_width = length * CELL_WIDTH + 1;
+    for (u32 row = 0; row <= CELL_HEIGHT; row++)
+    {
+      for (u32 x = 0; x < box_width; x++)
+      {
+        u32 color = BACKGROUND_COLOR;
+        const u32 glyph_x = (x - 1) % CELL_WIDTH;
+        const u32 glyph_y = row - 1;
+        if (x > 0 && row > 0 && glyph_x < GLYPH_WIDTH && glyph_y < GLYPH_HEIGHT)
+        {
+          char ch = m_overlay_text[line_start + (x - 1) / CELL_WIDTH];
+          if (ch >= 'a' && ch <= 'z')
+            ch = ch - 'a' + 'A';
+
+          const u16 glyph = (ch >= ' ' && ch <= 'Z') ? s_overlay_font[ch - ' '] : s_overlay_font['?' - ' '];
+          if (glyph & (0x4000 >> (glyph_y * GLYPH_WIDTH + glyph_x)))
+            color = TEXT_COLOR;
+        }
+
+        std::memcpy(&m_framebuffer_pointer[(y + row) * m_framebuffer_pitch + x * sizeof(u32)], &color, sizeof(color));
+      }
+    }
+
+    y += CELL_HEIGHT;
+    line_start = line_end + 1;
+  }
+}
+
 void Display::AddFrameRendered()
 {
   m_frames_rendered++;
@@ -129,6 +189,13 @@ std::unique_ptr<Display> NullDisplay::Create()
   return std::make_unique<NullDisplay>();
 }
 
-void NullDisplay::ResizeFramebuffer(u32 width, u32 height) {}
+void NullDisplay::ResizeFramebuffer(u32 width, u32 height)
+{
+  m_framebuffer_width = width;
+  m_framebuffer_height = height;
+  m_framebuffer_pitch = width * sizeof(u32);
+  m_framebuffer.resize(m_framebuffer_pitch * height);
+  m_framebuffer_pointer = m_framebuffer.data();
+}
 
 void NullDisplay::DisplayFramebuffer() {}
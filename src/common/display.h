@@ -2,6 +2,8 @@
 #include "YBaseLib/Timer.h"
 #include "types.h"
 #include <memory>
+#include <string>
+#include <vector>
 
 class Display
 {
@@ -21,6 +23,8 @@ public:
 
   u32 GetFramebufferWidth() const { return m_framebuffer_width; }
   u32 GetFramebufferHeight() const { return m_framebuffer_height; }
+  const byte* GetFramebufferPointer() const { return m_framebuffer_pointer; }
+  u32 GetFramebufferPitch() const { return m_framebuffer_pitch; }
   void ClearFramebuffer();
   virtual void ResizeFramebuffer(u32 width, u32 height) = 0;
   virtual void DisplayFramebuffer() = 0;
@@ -35,7 +39,15 @@ public:
   void SetPixel(u32 x, u32 y, u32 rgb);
   void CopyFrame(const void* pixels, u32 stride);
 
+  // Text drawn over the top-left of each presented frame in a small built-in font, such as performance stats. Lines
+  // are separated by newlines, and letters are drawn in upper case. Empty for none.
+  const std::string& GetOverlayText() const { return m_overlay_text; }
+  void SetOverlayText(std::string text) { m_overlay_text = std::move(text); }
+
 protected:
+  // Draws the overlay text into the framebuffer. Implementations call this before presenting it.
+  void DrawOverlay();
+
   void AddFrameRendered();
   void CalculateDrawRectangle(s32* x, s32* y, u32* width, u32* height);
 
@@ -54,8 +66,11 @@ protected:
   Timer m_frame_counter_timer;
   u32 m_frames_rendered = 0;
   float m_fps = 0.0f;
+
+  std::string m_overlay_text;
 };
 
+// Renders to a framebuffer in memory which is never presented, for running without a window.
 class NullDisplay : public Display
 {
 public:
@@ -66,4 +81,7 @@ public:
 
   void ResizeFramebuffer(u32 width, u32 height) override;
   void DisplayFramebuffer() override;
+
+private:
+  std::vector<byte> m_framebuffer;
 };
\ No newline at end of file
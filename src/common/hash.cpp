@@ -0,0 +1,105 @@
+#include "hash.h"
+#include <cstring>
+
+static const u64 PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const u64 PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const u64 PRIME64_3 = 0x165667B19E3779F9ULL;
+static const u64 PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const u64 PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline u64 RotateLeft(u64 value, int count)
+{
+  return (value << count) | (value >> (64 - count));
+}
+
+static inline u64 Read64(const u8* ptr)
+{
+  u64 value;
+  std::memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+static inline u32 Read32(const u8* ptr)
+{
+  u32 value;
+  std::memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+static inline u64 Round(u64 acc, u64 input)
+{
+  acc += input * PRIME64_2;
+  acc = RotateLeft(acc, 31);
+  return acc * PRIME64_1;
+}
+
+static inline u64 MergeRound(u64 acc, u64 value)
+{
+  acc ^= Round(0, value);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+u64 HashBytes64(const void* data, size_t size, u64 seed /* = 0 */)
+{
+  const u8* ptr = static_cast<const u8*>(data);
+  const u8* const end = ptr + size;
+  u64 hash;
+
+  if (size >= 32)
+  {
+    u64 v1 = seed + PRIME64_1 + PRIME64_2;
+    u64 v2 = seed + PRIME64_2;
+    u64 v3 = seed;
+    u64 v4 = seed - PRIME64_1;
+
+    const u8* const limit = end - 32;
+    do
+    {
+      v1 = Round(v1, Read64(ptr));
+      v2 = Round(v2, Read64(ptr + 8));
+      v3 = Round(v3, Read64(ptr + 16));
+      v4 = Round(v4, Read64(ptr + 24));
+      ptr += 32;
+    } while (ptr <= limit);
+
+    hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+    hash = MergeRound(hash, v1);
+    hash = MergeRound(hash, v2);
+    hash = MergeRound(hash, v3);
+    hash = MergeRound(hash, v4);
+  }
+  else
+  {
+    hash = seed + PRIME64_5;
+  }
+
+  hash += static_cast<u64>(size);
+
+  while ((ptr + 8) <= end)
+  {
+    hash ^= Round(0, Read64(ptr));
+    hash = RotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+    ptr += 8;
+  }
+
+  if ((ptr + 4) <= end)
+  {
+    hash ^= static_cast<u64>(Read32(ptr)) * PRIME64_1;
+    hash = RotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+    ptr += 4;
+  }
+
+  while (ptr < end)
+  {
+    hash ^= static_cast<u64>(*ptr) * PRIME64_5;
+    hash = RotateLeft(hash, 11) * PRIME64_1;
+    ptr++;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME64_2;
+  hash ^= hash >> 29;
+  hash *= PRIME64_3;
+  hash ^= hash >> 32;
+  return hash;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "types.h"
+
+// 64-bit non-cryptographic hash (XXH64). Processes four independent 64-bit lanes per 32-byte stripe, which the
+// compiler can keep in registers or vectorize, so hashing runs at close to memory bandwidth.
+u64 HashBytes64(const void* data, size_t size, u64 seed = 0);
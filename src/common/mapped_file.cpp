@@ -0,0 +1,101 @@
+#include "mapped_file.h"
+#include "YBaseLib/Error.h"
+
+#ifdef _WIN32
+#include "YBaseLib/Windows/WindowsHeaders.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::~MappedFile()
+{
+  if (m_data)
+    UnmapViewOfFile(m_data);
+  if (m_mapping_handle)
+    CloseHandle(m_mapping_handle);
+  if (m_file_handle)
+    CloseHandle(m_file_handle);
+}
+
+std::unique_ptr<MappedFile> MappedFile::Open(const char* filename, Error* error)
+{
+  std::unique_ptr<MappedFile> mf(new MappedFile());
+  HANDLE file_handle =
+    CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_handle == INVALID_HANDLE_VALUE)
+  {
+    error->SetErrorUserFormatted(1, "Failed to open '%s'", filename);
+    return nullptr;
+  }
+  mf->m_file_handle = file_handle;
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+  {
+    error->SetErrorUserFormatted(1, "File '%s' is empty", filename);
+    return nullptr;
+  }
+
+  mf->m_mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mf->m_mapping_handle)
+  {
+    error->SetErrorUserFormatted(1, "Failed to create mapping of '%s'", filename);
+    return nullptr;
+  }
+
+  mf->m_data = static_cast<const byte*>(MapViewOfFile(mf->m_mapping_handle, FILE_MAP_READ, 0, 0, 0));
+  if (!mf->m_data)
+  {
+    error->SetErrorUserFormatted(1, "Failed to map '%s'", filename);
+    return nullptr;
+  }
+
+  mf->m_size = static_cast<size_t>(file_size.QuadPart);
+  return mf;
+}
+
+#else
+
+MappedFile::~MappedFile()
+{
+  if (m_data)
+    munmap(const_cast<byte*>(m_data), m_size);
+  if (m_fd >= 0)
+    close(m_fd);
+}
+
+std::unique_ptr<MappedFile> MappedFile::Open(const char* filename, Error* error)
+{
+  std::unique_ptr<MappedFile> mf(new MappedFile());
+  mf->m_fd = open(filename, O_RDONLY);
+  if (mf->m_fd < 0)
+  {
+    error->SetErrorUserFormatted(1, "Failed to open '%s'", filename);
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(mf->m_fd, &st) != 0 || st.st_size == 0)
+  {
+    error->SetErrorUserFormatted(1, "File '%s' is empty", filename);
+    return nullptr;
+  }
+
+  void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, mf->m_fd, 0);
+  if (data == MAP_FAILED)
+  {
+    error->SetErrorUserFormatted(1, "Failed to map '%s'", filename);
+    return nullptr;
+  }
+
+  mf->m_data = static_cast<const byte*>(data);
+  mf->m_size = static_cast<size_t>(st.st_size);
+  return mf;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+#include "types.h"
+#include <memory>
+
+class Error;
+
+// Read-only memory mapping of a whole file. The contents are paged in on access, so nothing is copied up front.
+class MappedFile
+{
+public:
+  ~MappedFile();
+
+  static std::unique_ptr<MappedFile> Open(const char* filename, Error* error);
+
+  const byte* GetData() const { return m_data; }
+  size_t GetSize() const { return m_size; }
+
+private:
+  MappedFile() = default;
+
+  const byte* m_data = nullptr;
+  size_t m_size = 0;
+
+#ifdef _WIN32
+  void* m_file_handle = nullptr;
+  void* m_mapping_handle = nullptr;
+#else
+  int m_fd = -1;
+#endif
+};
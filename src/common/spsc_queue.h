@@ -0,0 +1,86 @@
+#pragma once
+#include "types.h"
+#include <atomic>
+#include <vector>
+
+// Bounded wait-free queue for one producer thread and one consumer thread. Items are trivially copyable values.
+// The capacity is rounded up to a power of two, so positions are free-running counters masked to index the ring.
+template<typename T>
+class SPSCQueue
+{
+public:
+  SPSCQueue(u32 capacity)
+  {
+    m_capacity = 1;
+    while (m_capacity < capacity)
+      m_capacity <<= 1;
+
+    m_items.resize(m_capacity);
+    m_mask = m_capacity - 1;
+  }
+
+  u32 GetCapacity() const { return m_capacity; }
+
+  // Approximate if either side is running at the same time.
+  u32 GetSize() const
+  {
+    return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+  }
+  bool IsEmpty() const { return (GetSize() == 0); }
+
+  // Producer side.
+  bool TryPush(const T& item)
+  {
+    const u32 tail = m_tail.load(std::memory_order_relaxed);
+    if ((tail - m_producer_cached_head) == m_capacity)
+    {
+      m_producer_cached_head = m_head.load(std::memory_order_acquire);
+      if ((tail - m_producer_cached_head) == m_capacity)
+        return false;
+    }
+
+    m_items[tail & m_mask] = item;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. The item is only released back to the producer by Pop(), so it can be processed in place, and the
+  // producer can tell when the consumer has finished with everything it pushed.
+  const T* Peek()
+  {
+    const u32 head = m_head.load(std::memory_order_relaxed);
+    if (head == m_consumer_cached_tail)
+    {
+      m_consumer_cached_tail = m_tail.load(std::memory_order_acquire);
+      if (head == m_consumer_cached_tail)
+        return nullptr;
+    }
+
+    return &m_items[head & m_mask];
+  }
+  void Pop() { m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  // Neither side may be running.
+  void Clear()
+  {
+    m_head.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+    m_producer_cached_head = 0;
+    m_consumer_cached_tail = 0;
+  }
+
+private:
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+
+  std::vector<T> m_items;
+  u32 m_capacity;
+  u32 m_mask;
+
+  // Written by the producer, aligned away from the consumer's state.
+  alignas(CACHE_LINE_SIZE) std::atomic<u32> m_tail{0};
+  u32 m_producer_cached_head = 0;
+
+  // Written by the consumer.
+  alignas(CACHE_LINE_SIZE) std::atomic<u32> m_head{0};
+  u32 m_consumer_cached_tail = 0;
+};
@@ -0,0 +1,72 @@
+#include "state_wrapper.h"
+#include "YBaseLib/Log.h"
+Log_SetChannel(StateWrapper);
+
+StateWrapper::StateWrapper(const std::vector<u8>& buffer)
+  : m_mode(Mode::Read), m_read_pointer(buffer.data()), m_read_size(buffer.size())
+{
+}
+
+StateWrapper::StateWrapper(std::vector<u8>* buffer) : m_mode(Mode::Write), m_write_buffer(buffer)
+{
+  m_write_buffer->clear();
+}
+
+StateWrapper::~StateWrapper() = default;
+
+void StateWrapper::DoBytes(void* data, size_t length)
+{
+  if (m_mode == Mode::Read)
+  {
+    if (m_error || (m_position + length) > m_read_size)
+    {
+      m_error = true;
+      std::memset(data, 0, length);
+      return;
+    }
+
+    std::memcpy(data, m_read_pointer + m_position, length);
+  }
+  else
+  {
+    // resize() won't reallocate once the buffer has grown to the state size.
+    m_write_buffer->resize(m_position + length);
+    std::memcpy(m_write_buffer->data() + m_position, data, length);
+  }
+
+  m_position += length;
+}
+
+void StateWrapper::DoBytes(std::vector<u8>* data)
+{
+  DoBytes(data->data(), data->size());
+}
+
+void StateWrapper::Do(bool* value_ptr)
+{
+  u8 value = BoolToUInt8(*value_ptr);
+  DoBytes(&value, sizeof(value));
+  if (m_mode == Mode::Read)
+    *value_ptr = (value != 0);
+}
+
+bool StateWrapper::DoMarker(const char* marker)
+{
+  const size_t length = std::strlen(marker);
+  if (m_mode == Mode::Write)
+  {
+    DoBytes(const_cast<char*>(marker), length);
+    return true;
+  }
+
+  if (m_error || (m_position + length) > m_read_size ||
+      std::memcmp(m_read_pointer + m_position, marker, length) != 0)
+  {
+    Log_ErrorPrintf("State marker '%s' mismatch at offset %u", marker, static_cast<u32>(m_position));
+    m_error = true;
+    return false;
+  }
+
+  m_position += length;
+  return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "types.h"
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Serializes component state to/from a flat in-memory buffer.
+// The same DoState() code path is used for both directions, so the layout is always symmetric.
+// For a given cartridge the state size is constant, so two states can be diffed bytewise.
+class StateWrapper
+{
+public:
+  enum class Mode
+  {
+    Read,
+    Write
+  };
+
+  // Reading from an existing buffer.
+  StateWrapper(const std::vector<u8>& buffer);
+
+  // Writing to a buffer. The buffer is cleared, but its capacity is retained.
+  StateWrapper(std::vector<u8>* buffer);
+
+  ~StateWrapper();
+
+  bool HasError() const { return m_error; }
+  bool IsReading() const { return (m_mode == Mode::Read); }
+  bool IsWriting() const { return (m_mode == Mode::Write); }
+  Mode GetMode() const { return m_mode; }
+  size_t GetPosition() const { return m_position; }
+
+  // Overload for integral or floating-point types. Writes bytes as-is.
+  template<typename T, std::enable_if_t<std::is_integral<T>::value || std::is_floating_point<T>::value, int> = 0>
+  void Do(T* value_ptr)
+  {
+    DoBytes(value_ptr, sizeof(T));
+  }
+
+  // Overload for enum types. Uses the underlying type.
+  template<typename T, std::enable_if_t<std::is_enum<T>::value, int> = 0>
+  void Do(T* value_ptr)
+  {
+    using TUnderlying = typename std::underlying_type<T>::type;
+    TUnderlying temp = static_cast<TUnderlying>(*value_ptr);
+    DoBytes(&temp, sizeof(temp));
+    if (m_mode == Mode::Read)
+      *value_ptr = static_cast<T>(temp);
+  }
+
+  // Overload for POD types, such as structs.
+  template<typename T, std::enable_if_t<std::is_standard_layout<T>::value && std::is_trivial<T>::value, int> = 0>
+  void DoPOD(T* value_ptr)
+  {
+    DoBytes(value_ptr, sizeof(T));
+  }
+
+  template<typename T, size_t N>
+  void DoArray(T (&data)[N])
+  {
+    DoBytes(data, sizeof(T) * N);
+  }
+
+  // Vectors are expected to already be sized correctly when reading, as the state layout is fixed.
+  void DoBytes(std::vector<u8>* data);
+
+  void DoBytes(void* data, size_t length);
+
+  void Do(bool* value_ptr);
+
+  // Writes or checks a four-character marker, used to catch layout mismatches early.
+  bool DoMarker(const char* marker);
+
+private:
+  Mode m_mode;
+  std::vector<u8>* m_write_buffer = nullptr;
+  const u8* m_read_pointer = nullptr;
+  size_t m_read_size = 0;
+  size_t m_position = 0;
+  bool m_error = false;
+};
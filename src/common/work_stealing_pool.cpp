@@ -0,0 +1,127 @@
+#include "common/work_stealing_pool.h"
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool(u32 num_threads /* = 0 */)
+{
+  m_num_threads = (num_threads != 0) ? num_threads : std::max(std::thread::hardware_concurrency(), 1u);
+  m_queues = std::make_unique<Queue[]>(m_num_threads);
+
+  m_threads.reserve(m_num_threads - 1);
+  for (u32 i = 1; i < m_num_threads; i++)
+    m_threads.emplace_back([this, i]() { WorkerThread(i); });
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_shutdown = true;
+  }
+  m_batch_start.notify_all();
+
+  for (std::thread& thread : m_threads)
+    thread.join();
+}
+
+void WorkStealingPool::Run(const u32* tasks, u32 num_tasks, const std::function<void(u32)>& func)
+{
+  if (num_tasks == 0)
+    return;
+
+  // The function is set before any task is queued, so a thread which finds a task also sees it.
+  m_func = &func;
+  m_remaining_tasks.store(num_tasks);
+  for (u32 i = 0; i < m_num_threads; i++)
+  {
+    Queue& queue = m_queues[i];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.tasks.clear();
+    queue.head = 0;
+    for (u32 j = i; j < num_tasks; j += m_num_threads)
+      queue.tasks.push_back(tasks[j]);
+  }
+
+  if (m_num_threads > 1)
+  {
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_batch++;
+    }
+    m_batch_start.notify_all();
+  }
+
+  RunTasks(0);
+
+  std::unique_lock<std::mutex> lock(m_lock);
+  m_batch_done.wait(lock, [this]() { return m_remaining_tasks.load() == 0; });
+}
+
+void WorkStealingPool::Run(u32 num_tasks, const std::function<void(u32)>& func)
+{
+  std::vector<u32> tasks(num_tasks);
+  for (u32 i = 0; i < num_tasks; i++)
+    tasks[i] = i;
+
+  Run(tasks.data(), num_tasks, func);
+}
+
+bool WorkStealingPool::PopTask(u32 index, u32* task)
+{
+  Queue& queue = m_queues[index];
+  std::lock_guard<std::mutex> guard(queue.lock);
+  if (queue.head == queue.tasks.size())
+    return false;
+
+  *task = queue.tasks[queue.head++];
+  return true;
+}
+
+bool WorkStealingPool::StealTask(u32 index, u32* task)
+{
+  for (u32 i = 1; i < m_num_threads; i++)
+  {
+    Queue& queue = m_queues[(index + i) % m_num_threads];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.head == queue.tasks.size())
+      continue;
+
+    *task = queue.tasks.back();
+    queue.tasks.pop_back();
+    return true;
+  }
+
+  return false;
+}
+
+void WorkStealingPool::RunTasks(u32 index)
+{
+  // Nothing is queued while a batch runs, so the batch is over for this thread once there is nothing left to steal.
+  u32 task;
+  while (PopTask(index, &task) || StealTask(index, &task))
+  {
+    (*m_func)(task);
+    if (m_remaining_tasks.fetch_sub(1) == 1)
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_batch_done.notify_all();
+    }
+  }
+}
+
+void WorkStealingPool::WorkerThread(u32 index)
+{
+  u64 last_batch = 0;
+  for (;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_lock);
+      m_batch_start.wait(lock, [this, last_batch]() { return m_shutdown || m_batch != last_batch; });
+      if (m_shutdown)
+        return;
+
+      last_batch = m_batch;
+    }
+
+    RunTasks(index);
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "types.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads which run batches of tasks. Each thread takes tasks from the front of its own queue,
+// and once that's empty, steals from the back of the others', so a few long tasks don't leave the other threads idle.
+// The threads persist between batches, and the queues keep their storage, so running a batch doesn't allocate and small
+// batches, such as a frame each of several systems, stay cheap.
+class WorkStealingPool
+{
+public:
+  // Zero threads means one per core. The thread calling Run() works too, so one fewer thread is created.
+  explicit WorkStealingPool(u32 num_threads = 0);
+  ~WorkStealingPool();
+
+  u32 GetThreadCount() const { return m_num_threads; }
+
+  // Calls func for every task, in no particular order, and returns once they have all finished. Tasks are dealt out
+  // to the threads in order, so putting the longest first keeps the stealing at the end to short tasks. Must not be
+  // called from a task, or from more than one thread at a time.
+  void Run(const u32* tasks, u32 num_tasks, const std::function<void(u32)>& func);
+
+  // Runs tasks zero to num_tasks - 1.
+  void Run(u32 num_tasks, const std::function<void(u32)>& func);
+
+private:
+  // The owner takes from the head, thieves from the end.
+  struct Queue
+  {
+    std::mutex lock;
+    std::vector<u32> tasks;
+    size_t head = 0;
+  };
+
+  bool PopTask(u32 index, u32* task);
+  bool StealTask(u32 index, u32* task);
+  void RunTasks(u32 index);
+  void WorkerThread(u32 index);
+
+  u32 m_num_threads;
+  std::unique_ptr<Queue[]> m_queues;
+  std::vector<std::thread> m_threads;
+
+  // Workers wait for the batch number to change, then run tasks until none are left.
+  std::mutex m_lock;
+  std::condition_variable m_batch_start;
+  std::condition_variable m_batch_done;
+  u64 m_batch = 0;
+  bool m_shutdown = false;
+
+  const std::function<void(u32)>* m_func = nullptr;
+  std::atomic<u32> m_remaining_tasks{0};
+};
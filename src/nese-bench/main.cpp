@@ -0,0 +1,752 @@
+#include "YBaseLib/Error.h"
+#include "YBaseLib/Log.h"
+#include "YBaseLib/Timer.h"
+#include "common/audio.h"
+#include "common/display.h"
+#include "nese/apu.h"
+#include "nese/bus.h"
+#include "nese/cartridge.h"
+#include "nese/controller.h"
+#include "nese/cpu.h"
+#include "nese/env_batch.h"
+#include "nese/ppu.h"
+#include "nese/system.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+// Micro-benchmarks for the core's components. Each one reports nanoseconds per unit of work (an emulated cycle, a
+// scanline, a memory read, a pixel, a clone), as the fastest of several runs, with the heap memory that run allocated.
+// Results are written as JSON, and can be compared against a stored baseline, which flags anything slower by more than
+// a threshold.
+//
+// Timings depend on the machine and the build, so no baseline is kept in the tree. Record one on the machine doing the
+// comparison, from the build before a change, with "nese-bench -out baseline.json". Then run "nese-bench -baseline
+// baseline.json" with the changed build, or compare two recorded files with -compare.
+
+// Results are accumulated here, so the compiler can't remove the work being measured.
+static volatile u32 s_sink;
+
+// Counts every heap allocation, so benchmarks can report the bytes allocated per operation.
+static std::atomic<u64> s_allocated_bytes{0};
+
+void* operator new(std::size_t size)
+{
+  s_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* ptr = std::malloc((size > 0) ? size : 1))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  operator delete(ptr);
+}
+
+// Only the time and allocations between Start() and Stop() are counted, so a benchmark can exclude its own setup.
+class Stopwatch
+{
+public:
+  void Start()
+  {
+    m_start_allocated_bytes = s_allocated_bytes.load(std::memory_order_relaxed);
+    m_start = Timer::GetValue();
+  }
+  void Stop()
+  {
+    m_elapsed += Timer::GetValue() - m_start;
+    m_allocated_bytes += s_allocated_bytes.load(std::memory_order_relaxed) - m_start_allocated_bytes;
+  }
+
+  Timer::Value GetElapsed() const { return m_elapsed; }
+  u64 GetAllocatedBytes() const { return m_allocated_bytes; }
+
+private:
+  Timer::Value m_start = 0;
+  Timer::Value m_elapsed = 0;
+  u64 m_start_allocated_bytes = 0;
+  u64 m_allocated_bytes = 0;
+};
+
+struct BenchmarkResult
+{
+  std::string name;
+  std::string unit;
+  double ns_per_op;
+  double bytes_per_op;
+};
+
+class BenchmarkRunner
+{
+public:
+  BenchmarkRunner(const char* filter, double min_time, u32 num_runs)
+    : m_filter(filter), m_min_time(min_time), m_num_runs(num_runs)
+  {
+  }
+
+  const std::vector<BenchmarkResult>& GetResults() const { return m_results; }
+
+  // The batch function runs some work, timing it with the stopwatch, and returns the number of operations done.
+  template<typename BatchFunction>
+  void Run(const char* name, const char* unit, BatchFunction batch)
+  {
+    if (m_filter && !std::strstr(name, m_filter))
+      return;
+
+    Stopwatch warmup;
+    batch(warmup);
+
+    // Host noise only ever makes a run slower, so the fastest is the most representative.
+    double best = std::numeric_limits<double>::max();
+    double best_bytes = 0.0;
+    for (u32 run = 0; run < m_num_runs; run++)
+    {
+      Stopwatch stopwatch;
+      u64 ops = 0;
+      while (Timer::ConvertValueToSeconds(stopwatch.GetElapsed()) < m_min_time)
+        ops += batch(stopwatch);
+
+      const double ns = Timer::ConvertValueToNanoseconds(stopwatch.GetElapsed()) / double(ops);
+      if (ns < best)
+      {
+        best = ns;
+        best_bytes = double(stopwatch.GetAllocatedBytes()) / double(ops);
+      }
+    }
+
+    std::fprintf(stderr, "%-32s %10.3f ns/%-8s %14.0f %s/s %12.1f bytes/%s\n", name, best, unit, 1e9 / best, unit,
+                 best_bytes, unit);
+    m_results.push_back({name, unit, best, best_bytes});
+  }
+
+private:
+  const char* m_filter;
+  double m_min_time;
+  u32 m_num_runs;
+  std::vector<BenchmarkResult> m_results;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Fixtures
+//////////////////////////////////////////////////////////////////////////
+
+// Builds cartridge data in memory, with PRG filled from the given program (placed at $8000 of the last 32K, with the
+// reset vector pointing to it) and CHR filled with a pseudo-random pattern.
+static Cartridge::CartridgeData CreateCartridgeData(u16 mapper_id, u32 prg_size, u32 chr_size,
+                                                    const std::vector<u8>& program = {})
+{
+  auto image = std::make_shared<Cartridge::DataType>(prg_size + chr_size);
+  byte* prg = image->data();
+  byte* chr = image->data() + prg_size;
+
+  u32 seed = 0x12345678;
+  for (u32 i = 0; i < chr_size; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    chr[i] = Truncate8(seed >> 16);
+  }
+
+  const u32 last_32k = prg_size - 0x8000;
+  std::copy(program.begin(), program.end(), prg + last_32k);
+  prg[prg_size - 4] = 0x00;
+  prg[prg_size - 3] = 0x80;
+
+  Cartridge::CartridgeData data = {};
+  data.prg_rom = Cartridge::ROMView(image, prg, prg_size);
+  data.chr_rom = Cartridge::ROMView(image, chr, chr_size);
+  data.prg_ram_size = Cartridge::INES_PRG_RAM_BANK_SIZE;
+  data.chr_ram_size = (chr_size == 0) ? Cartridge::INES_CHR_ROM_BANK_SIZE : 0;
+  data.mapper_id = mapper_id;
+  return data;
+}
+
+static std::unique_ptr<Cartridge> CreateCartridge(u16 mapper_id, u32 prg_size, u32 chr_size,
+                                                  const std::vector<u8>& program = {})
+{
+  Error error;
+  std::unique_ptr<Cartridge> cart = Cartridge::Create(CreateCartridgeData(mapper_id, prg_size, chr_size, program),
+                                                      &error);
+  if (!cart)
+  {
+    std::fprintf(stderr, "Failed to create mapper %u: %s\n", u32(mapper_id),
+                 error.GetErrorDescription().GetCharArray());
+    std::exit(EXIT_FAILURE);
+  }
+
+  cart->Reset();
+  return cart;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CPU
+//////////////////////////////////////////////////////////////////////////
+
+// Straight-line arithmetic.
+static const std::vector<u8> s_cpu_alu_program = {
+  0x18,             // $8000: CLC
+  0x69, 0x01,       // $8001: ADC #$01
+  0x49, 0x55,       // $8003: EOR #$55
+  0x0A,             // $8005: ASL A
+  0x6A,             // $8006: ROR A
+  0x29, 0x7F,       // $8007: AND #$7F
+  0x09, 0x01,       // $8009: ORA #$01
+  0xAA,             // $800B: TAX
+  0xC8,             // $800C: INY
+  0x4C, 0x00, 0x80, // $800D: JMP $8000
+};
+
+// Tight counted loops, with taken and not-taken branches.
+static const std::vector<u8> s_cpu_branch_program = {
+  0xA2, 0x10, // $8000: LDX #$10
+  0xCA,       // $8002: DEX
+  0xD0, 0xFD, // $8003: BNE $8002
+  0xC8,       // $8005: INY
+  0x30, 0xF8, // $8006: BMI $8000
+  0x10, 0xF6, // $8008: BPL $8000
+};
+
+// Zero page, absolute indexed and indirect accesses to WRAM, and reads from PRG-ROM.
+static const std::vector<u8> s_cpu_memory_program = {
+  0xA9, 0x00,       // $8000: LDA #$00
+  0x85, 0x20,       // $8002: STA $20
+  0xA9, 0x03,       // $8004: LDA #$03
+  0x85, 0x21,       // $8006: STA $21
+  0xB5, 0x00,       // $8008: LDA $00,X
+  0x9D, 0x00, 0x02, // $800A: STA $0200,X
+  0xE6, 0x10,       // $800D: INC $10
+  0xB1, 0x20,       // $800F: LDA ($20),Y
+  0x91, 0x20,       // $8011: STA ($20),Y
+  0xE8,             // $8013: INX
+  0xC8,             // $8014: INY
+  0xAD, 0x00, 0x90, // $8015: LDA $9000
+  0x4C, 0x08, 0x80, // $8018: JMP $8008
+};
+
+static void RunCPUBenchmark(BenchmarkRunner& runner, const char* name, const std::vector<u8>& program)
+{
+  // Only the CPU and the cartridge are attached, so nothing else runs.
+  std::unique_ptr<Cartridge> cart = CreateCartridge(0, 0x8000, 0x2000, program);
+  Bus bus;
+  CPU cpu;
+  bus.Initialize(&cpu, nullptr, nullptr);
+  bus.SetCartridge(cart.get());
+  cpu.Initialize(nullptr, &bus);
+  bus.Reset();
+  cpu.Reset();
+
+  runner.Run(name, "cycle", [&](Stopwatch& sw) {
+    static const CycleCount BATCH_CYCLES = 100000;
+    const u32 start_cycle = cpu.GetCyclesSinceReset();
+    sw.Start();
+    cpu.Execute(BATCH_CYCLES);
+    sw.Stop();
+    bus.ExecutePendingCycles();
+    return u64(cpu.GetCyclesSinceReset() - start_cycle);
+  });
+}
+
+static void RunCPUBenchmarks(BenchmarkRunner& runner)
+{
+  RunCPUBenchmark(runner, "cpu/alu", s_cpu_alu_program);
+  RunCPUBenchmark(runner, "cpu/branch", s_cpu_branch_program);
+  RunCPUBenchmark(runner, "cpu/memory", s_cpu_memory_program);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PPU
+//////////////////////////////////////////////////////////////////////////
+
+// Runs a line at a time to the line before, then a cycle at a time to the start of the line.
+static void RunPPUToScanline(PPU* ppu, u32 scanline)
+{
+  const u32 previous_scanline = (scanline + 261) % 262;
+  while (ppu->GetCurrentScanline() != previous_scanline)
+    ppu->Execute(PPU::CYCLES_PER_LINE);
+  while (ppu->GetCurrentScanline() != scanline || ppu->GetCurrentCycle() != 0)
+    ppu->Execute(1);
+}
+
+static void SetPPUAddress(PPU* ppu, u16 address)
+{
+  ppu->WriteRegister(6, Truncate8(address >> 8));
+  ppu->WriteRegister(6, Truncate8(address));
+}
+
+static void RunPPUBenchmarks(BenchmarkRunner& runner)
+{
+  std::unique_ptr<Cartridge> cart = CreateCartridge(0, 0x8000, 0x2000);
+  NullDisplay display;
+  System system;
+  system.Initialize(&display, nullptr, cart.get());
+  system.Reset();
+  PPU* ppu = system.GetPPU();
+
+  // Every tile and palette entry differs, so nothing is uniform.
+  SetPPUAddress(ppu, 0x2000);
+  for (u32 i = 0; i < 0x400; i++)
+    ppu->WriteRegister(7, Truncate8(i * 7));
+  SetPPUAddress(ppu, 0x3F00);
+  for (u32 i = 0; i < 32; i++)
+    ppu->WriteRegister(7, Truncate8(i * 3 + 1));
+  SetPPUAddress(ppu, 0x0000);
+
+  // Bands of 8x16 sprites, eight per line, covering about half the screen.
+  ppu->WriteRegister(3, 0);
+  for (u32 i = 0; i < 64; i++)
+  {
+    ppu->WriteRegister(4, Truncate8((i / 8) * 30));
+    ppu->WriteRegister(4, Truncate8(i * 2));
+    ppu->WriteRegister(4, Truncate8(i & 3));
+    ppu->WriteRegister(4, Truncate8((i % 8) * 24));
+  }
+
+  const auto run_lines = [ppu](u32 first_line, u32 line_count) {
+    return [ppu, first_line, line_count](Stopwatch& sw) {
+      RunPPUToScanline(ppu, first_line);
+      sw.Start();
+      ppu->Execute(line_count * PPU::CYCLES_PER_LINE);
+      sw.Stop();
+      return u64(line_count);
+    };
+  };
+
+  ppu->WriteRegister(0, 0x20);
+  ppu->WriteRegister(1, 0x0A);
+  runner.Run("ppu/visible", "scanline", run_lines(0, 240));
+  runner.Run("ppu/vblank", "scanline", run_lines(241, 20));
+
+  ppu->WriteRegister(1, 0x1E);
+  runner.Run("ppu/sprites", "scanline", run_lines(0, 240));
+
+  ppu->WriteRegister(1, 0x00);
+  runner.Run("ppu/rendering-off", "scanline", run_lines(0, 240));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Bus
+//////////////////////////////////////////////////////////////////////////
+
+static void RunBusBenchmarks(BenchmarkRunner& runner)
+{
+  std::unique_ptr<Cartridge> cart = CreateCartridge(0, 0x8000, 0x2000);
+  StandardController controller;
+  System system;
+  system.Initialize(nullptr, nullptr, cart.get());
+  system.SetController(0, &controller);
+  system.Reset();
+  Bus* bus = system.GetBus();
+
+  const auto read_region = [bus](u16 base, u16 mask) {
+    return [bus, base, mask](Stopwatch& sw) {
+      static const u32 BATCH_READS = 4096;
+      u32 sum = 0;
+      sw.Start();
+      for (u32 i = 0; i < BATCH_READS; i++)
+        sum += bus->ReadCPUAddress(base | (i & mask));
+      sw.Stop();
+      s_sink += sum;
+      return u64(BATCH_READS);
+    };
+  };
+
+  runner.Run("bus/wram", "read", read_region(0x0000, 0x07FF));
+  runner.Run("bus/ppu-register", "read", read_region(0x2002, 0x0000));
+  runner.Run("bus/apu-register", "read", read_region(0x4015, 0x0000));
+  runner.Run("bus/controller", "read", read_region(0x4016, 0x0000));
+  runner.Run("bus/cartridge", "read", read_region(0x8000, 0x7FFF));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Mappers
+//////////////////////////////////////////////////////////////////////////
+
+static void RunMapperBenchmarks(BenchmarkRunner& runner)
+{
+  struct MapperConfig
+  {
+    const char* name;
+    u16 mapper_id;
+    u32 prg_size;
+    u32 chr_size;
+  };
+  static const MapperConfig configs[] = {{"nrom", 0, 0x8000, 0x2000},     {"mmc1", 1, 0x20000, 0x8000},
+                                         {"uxrom", 2, 0x20000, 0},        {"mmc3", 4, 0x20000, 0x8000},
+                                         {"axrom", 7, 0x20000, 0},        {"gxrom", 66, 0x20000, 0x8000}};
+
+  Bus bus;
+  for (const MapperConfig& config : configs)
+  {
+    const std::string prefix = std::string("mapper/") + config.name + "/";
+    std::unique_ptr<Cartridge> cart = CreateCartridge(config.mapper_id, config.prg_size, config.chr_size);
+    Cartridge* cart_ptr = cart.get();
+    Bus* bus_ptr = &bus;
+    const auto read = [cart_ptr, bus_ptr](bool ppu, u16 base, u16 mask) {
+      return [cart_ptr, bus_ptr, ppu, base, mask](Stopwatch& sw) {
+        static const u32 BATCH_READS = 4096;
+        u32 sum = 0;
+        sw.Start();
+        if (ppu)
+        {
+          for (u32 i = 0; i < BATCH_READS; i++)
+            sum += cart_ptr->ReadPPUAddress(bus_ptr, base | (i & mask));
+        }
+        else
+        {
+          for (u32 i = 0; i < BATCH_READS; i++)
+            sum += cart_ptr->ReadCPUAddress(bus_ptr, base | (i & mask));
+        }
+        sw.Stop();
+        s_sink += sum;
+        return u64(BATCH_READS);
+      };
+    };
+
+    runner.Run((prefix + "cpu").c_str(), "read", read(false, 0x8000, 0x7FFF));
+    runner.Run((prefix + "ppu").c_str(), "read", read(true, 0x0000, 0x1FFF));
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// APU
+//////////////////////////////////////////////////////////////////////////
+
+static void RunAPUBenchmarks(BenchmarkRunner& runner)
+{
+  std::unique_ptr<Cartridge> cart = CreateCartridge(0, 0x8000, 0x2000);
+  NullAudio audio;
+  System system;
+  system.Initialize(nullptr, &audio, cart.get());
+  system.Reset();
+  APU* apu = system.GetAPU();
+
+  // Square, triangle and noise all playing, with the frame IRQ inhibited.
+  static const std::pair<u8, u8> registers[] = {{0x15, 0x0F}, {0x17, 0x40}, {0x00, 0xBF}, {0x02, 0x80},
+                                                {0x03, 0x01}, {0x04, 0x7F}, {0x06, 0x40}, {0x07, 0x02},
+                                                {0x08, 0xFF}, {0x0A, 0x60}, {0x0B, 0x01}, {0x0C, 0x3F},
+                                                {0x0E, 0x05}, {0x0F, 0x08}};
+  for (const auto& reg : registers)
+    apu->WriteRegister(reg.first, reg.second);
+
+  const auto run_frame = [apu, &audio](Stopwatch& sw) {
+    static const CycleCount BATCH_CYCLES = APU::DEFAULT_MIX_QUANTUM;
+    sw.Start();
+    apu->Execute(BATCH_CYCLES);
+    sw.Stop();
+
+    // Emptying the output is the host's cost, not the APU's.
+    audio.Drain();
+    return u64(BATCH_CYCLES);
+  };
+
+  // Mode switches take effect at the next mix, which the runner's warm-up batch reaches.
+  apu->SetTimingOnly(false);
+  runner.Run("apu/synthesis", "cycle", run_frame);
+  apu->SetTimingOnly(true);
+  runner.Run("apu/timing-only", "cycle", run_frame);
+
+  apu->SetTimingOnly(false);
+  for (u32 i = 0; i < u32(APU::AudioQuality::Count); i++)
+  {
+    const APU::AudioQuality quality = APU::AudioQuality(i);
+    apu->SetAudioQuality(quality);
+    runner.Run((std::string("apu/quality/") + APU::GetAudioQualityName(quality)).c_str(), "cycle", run_frame);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// System
+//////////////////////////////////////////////////////////////////////////
+
+static void RunSystemBenchmarks(BenchmarkRunner& runner)
+{
+  // Forked part-way through running the memory test program, without any output.
+  std::unique_ptr<Cartridge> cart = CreateCartridge(0, 0x8000, 0x2000, s_cpu_memory_program);
+  System system;
+  system.Initialize(nullptr, nullptr, cart.get());
+  system.Reset();
+  for (u32 i = 0; i < 10; i++)
+    system.FrameStep();
+
+  // The clones are destroyed outside the timed region.
+  runner.Run("system/clone", "clone", [&](Stopwatch& sw) {
+    static const u32 BATCH_CLONES = 16;
+    std::unique_ptr<System> clones[BATCH_CLONES];
+    sw.Start();
+    for (u32 i = 0; i < BATCH_CLONES; i++)
+      clones[i] = system.Clone();
+    sw.Stop();
+    return u64(BATCH_CLONES);
+  });
+
+  std::unique_ptr<System> clone = system.Clone();
+  runner.Run("system/copy_to", "copy", [&](Stopwatch& sw) {
+    static const u32 BATCH_COPIES = 256;
+    sw.Start();
+    for (u32 i = 0; i < BATCH_COPIES; i++)
+      s_sink += system.CopyTo(clone.get());
+    sw.Stop();
+    return u64(BATCH_COPIES);
+  });
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Environments
+//////////////////////////////////////////////////////////////////////////
+
+static void RunEnvBatchBenchmarks(BenchmarkRunner& runner)
+{
+  // Eight copies of the memory test program, with every output filled in. Allocations here should always be zero.
+  std::unique_ptr<Cartridge> cart = CreateCartridge(0, 0x8000, 0x2000, s_cpu_memory_program);
+  EnvBatch::Config config;
+  config.num_envs = 8;
+  EnvBatch batch;
+  if (!batch.Initialize(cart.get(), config))
+  {
+    std::fprintf(stderr, "Failed to initialize environments\n");
+    std::exit(EXIT_FAILURE);
+  }
+
+  std::vector<u8> observations(config.num_envs * batch.GetObservationSize());
+  std::vector<u8> wram(config.num_envs * Bus::WRAM_SIZE);
+  std::vector<float> rewards(config.num_envs);
+  std::vector<u8> dones(config.num_envs);
+  const EnvBatch::Output output = {observations.data(), wram.data(), rewards.data(), dones.data()};
+  batch.Reset(output);
+
+  u32 step = 0;
+  std::vector<u8> actions(config.num_envs);
+  runner.Run("env/step", "env-step", [&](Stopwatch& sw) {
+    static const u32 BATCH_STEPS = 4;
+    sw.Start();
+    for (u32 i = 0; i < BATCH_STEPS; i++)
+    {
+      for (u32 env = 0; env < config.num_envs; env++)
+        actions[env] = Truncate8((step + env) >> 2);
+      batch.Step(actions.data(), output);
+      step++;
+    }
+    sw.Stop();
+    s_sink += observations[0] + wram[0];
+    return u64(BATCH_STEPS) * config.num_envs;
+  });
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Display
+//////////////////////////////////////////////////////////////////////////
+
+static void RunDisplayBenchmarks(BenchmarkRunner& runner)
+{
+  NullDisplay display;
+  display.ResizeFramebuffer(PPU::SCREEN_WIDTH, PPU::SCREEN_HEIGHT);
+
+  std::vector<u32> frame(PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT);
+  for (u32 i = 0; i < frame.size(); i++)
+    frame[i] = Display::PackRGB(Truncate8(i), Truncate8(i >> 8), Truncate8(i >> 16));
+
+  runner.Run("display/set-pixel", "pixel", [&](Stopwatch& sw) {
+    sw.Start();
+    for (u32 y = 0; y < PPU::SCREEN_HEIGHT; y++)
+    {
+      for (u32 x = 0; x < PPU::SCREEN_WIDTH; x++)
+        display.SetPixel(x, y, frame[y * PPU::SCREEN_WIDTH + x]);
+    }
+    sw.Stop();
+    s_sink += display.GetFramebufferPointer()[0];
+    return u64(frame.size());
+  });
+
+  runner.Run("display/copy-frame", "pixel", [&](Stopwatch& sw) {
+    sw.Start();
+    display.CopyFrame(frame.data(), PPU::SCREEN_WIDTH * sizeof(u32));
+    sw.Stop();
+    s_sink += display.GetFramebufferPointer()[0];
+    return u64(frame.size());
+  });
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Results
+//////////////////////////////////////////////////////////////////////////
+
+// One benchmark per line, so the file diffs cleanly and can be read back without a JSON parser.
+static bool WriteResults(const char* filename, const std::vector<BenchmarkResult>& results)
+{
+  std::FILE* fp = filename ? std::fopen(filename, "w") : stdout;
+  if (!fp)
+  {
+    std::fprintf(stderr, "Failed to open '%s' for writing\n", filename);
+    return false;
+  }
+
+  std::fprintf(fp, "{\n  \"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const BenchmarkResult& result = results[i];
+    std::fprintf(fp, "    {\"name\": \"%s\", \"unit\": \"%s\", \"ns_per_op\": %.4f, \"bytes_per_op\": %.1f}%s\n",
+                 result.name.c_str(), result.unit.c_str(), result.ns_per_op, result.bytes_per_op,
+                 (i + 1) < results.size() ? "," : "");
+  }
+  std::fprintf(fp, "  ]\n}\n");
+
+  if (filename)
+    std::fclose(fp);
+
+  return true;
+}
+
+static bool ReadResults(const char* filename, std::vector<BenchmarkResult>* results)
+{
+  std::FILE* fp = std::fopen(filename, "r");
+  if (!fp)
+  {
+    std::fprintf(stderr, "Failed to open '%s'\n", filename);
+    return false;
+  }
+
+  char line[512];
+  while (std::fgets(line, sizeof(line), fp))
+  {
+    char name[128];
+    char unit[32];
+    double ns_per_op;
+    double bytes_per_op = 0.0;
+    // Older files have no allocation figures.
+    if (std::sscanf(line,
+                    " {\"name\": \"%127[^\"]\", \"unit\": \"%31[^\"]\", \"ns_per_op\": %lf, \"bytes_per_op\": %lf", name,
+                    unit, &ns_per_op, &bytes_per_op) >= 3)
+    {
+      results->push_back({name, unit, ns_per_op, bytes_per_op});
+    }
+  }
+
+  std::fclose(fp);
+  return true;
+}
+
+// Returns false if any benchmark is slower than the baseline by more than the threshold.
+static bool CompareResults(const std::vector<BenchmarkResult>& baseline, const std::vector<BenchmarkResult>& results,
+                           double threshold_percent)
+{
+  std::map<std::string, double> baseline_map;
+  for (const BenchmarkResult& result : baseline)
+    baseline_map[result.name] = result.ns_per_op;
+
+  u32 regression_count = 0;
+  std::printf("%-32s %12s %12s %9s\n", "benchmark", "baseline", "current", "change");
+  for (const BenchmarkResult& result : results)
+  {
+    auto iter = baseline_map.find(result.name);
+    if (iter == baseline_map.end())
+    {
+      std::printf("%-32s %12s %12.3f %9s  new\n", result.name.c_str(), "-", result.ns_per_op, "-");
+      continue;
+    }
+
+    const double change = (result.ns_per_op - iter->second) * 100.0 / iter->second;
+    const char* verdict = "";
+    if (change > threshold_percent)
+    {
+      verdict = "  REGRESSION";
+      regression_count++;
+    }
+    else if (change < -threshold_percent)
+    {
+      verdict = "  improved";
+    }
+
+    std::printf("%-32s %12.3f %12.3f %+8.1f%%%s\n", result.name.c_str(), iter->second, result.ns_per_op, change,
+                verdict);
+  }
+
+  std::printf("%u regression(s) beyond %.1f%%\n", regression_count, threshold_percent);
+  return (regression_count == 0);
+}
+
+int main(int argc, char* argv[])
+{
+  g_pLog->SetConsoleOutputParams(true, nullptr, LOGLEVEL_WARNING);
+
+  const char* filter = nullptr;
+  const char* output_filename = nullptr;
+  const char* baseline_filename = nullptr;
+  const char* compare_filename = nullptr;
+  double min_time = 0.1;
+  u32 num_runs = 5;
+  double threshold = 10.0;
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::strcmp(argv[i], "-filter") == 0 && (i + 1) < argc)
+      filter = argv[++i];
+    else if (std::strcmp(argv[i], "-min-time") == 0 && (i + 1) < argc)
+      min_time = std::strtod(argv[++i], nullptr);
+    else if (std::strcmp(argv[i], "-runs") == 0 && (i + 1) < argc)
+      num_runs = std::max(static_cast<u32>(std::strtoul(argv[++i], nullptr, 10)), 1u);
+    else if (std::strcmp(argv[i], "-out") == 0 && (i + 1) < argc)
+      output_filename = argv[++i];
+    else if (std::strcmp(argv[i], "-baseline") == 0 && (i + 1) < argc)
+      baseline_filename = argv[++i];
+    else if (std::strcmp(argv[i], "-threshold") == 0 && (i + 1) < argc)
+      threshold = std::strtod(argv[++i], nullptr);
+    else if (std::strcmp(argv[i], "-compare") == 0 && (i + 2) < argc)
+    {
+      baseline_filename = argv[++i];
+      compare_filename = argv[++i];
+    }
+    else
+    {
+      std::fprintf(stderr,
+                   "usage: %s [-filter <substring>] [-min-time <seconds>] [-runs <count>] [-out <results.json>] "
+                   "[-baseline <baseline.json>] [-threshold <percent>]\n"
+                   "       %s -compare <baseline.json> <results.json> [-threshold <percent>]\n",
+                   argv[0], argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<BenchmarkResult> baseline;
+  if (baseline_filename && !ReadResults(baseline_filename, &baseline))
+    return EXIT_FAILURE;
+
+  // Comparing two stored files doesn't run anything.
+  if (compare_filename)
+  {
+    std::vector<BenchmarkResult> results;
+    if (!ReadResults(compare_filename, &results))
+      return EXIT_FAILURE;
+
+    return CompareResults(baseline, results, threshold) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  BenchmarkRunner runner(filter, min_time, num_runs);
+  RunCPUBenchmarks(runner);
+  RunPPUBenchmarks(runner);
+  RunBusBenchmarks(runner);
+  RunMapperBenchmarks(runner);
+  RunAPUBenchmarks(runner);
+  RunSystemBenchmarks(runner);
+  RunEnvBatchBenchmarks(runner);
+  RunDisplayBenchmarks(runner);
+
+  // With a baseline, the comparison goes to stdout, so the JSON needs a file.
+  if ((output_filename || !baseline_filename) && !WriteResults(output_filename, runner.GetResults()))
+    return EXIT_FAILURE;
+
+  if (baseline_filename)
+    return CompareResults(baseline, runner.GetResults(), threshold) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
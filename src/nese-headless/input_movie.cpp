@@ -0,0 +1,67 @@
+#include "input_movie.h"
+#include "nese/controller.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+bool InputMovie::LoadFM2(const char* filename)
+{
+  // Movie button order, mapped to controller buttons.
+  static const u8 button_order[StandardController::NUM_BUTTONS] = {
+    StandardController::Button_Right, StandardController::Button_Left,   StandardController::Button_Down,
+    StandardController::Button_Up,    StandardController::Button_Start,  StandardController::Button_Select,
+    StandardController::Button_B,     StandardController::Button_A};
+
+  std::FILE* fp = std::fopen(filename, "r");
+  if (!fp)
+    return false;
+
+  m_frames.clear();
+
+  // Header lines don't start with a '|'.
+  char line[256];
+  while (std::fgets(line, sizeof(line), fp))
+  {
+    if (line[0] != '|')
+      continue;
+
+    Frame frame = {};
+    const char* field = line + 1;
+    frame.commands = static_cast<u8>(std::strtoul(field, nullptr, 10));
+    for (u32 port = 0; port < System::NUM_CONTROLLERS; port++)
+    {
+      field = std::strchr(field, '|');
+      if (!field)
+        break;
+
+      field++;
+      for (u32 i = 0; i < StandardController::NUM_BUTTONS && field[i] != '|' && field[i] != '\0'; i++)
+      {
+        if (field[i] != '.' && field[i] != ' ')
+          frame.buttons[port] |= (1 << button_order[i]);
+      }
+    }
+
+    m_frames.push_back(frame);
+  }
+
+  std::fclose(fp);
+  return true;
+}
+
+void InputMovie::ApplyFrame(u32 frame, System* system, StandardController* controllers) const
+{
+  if (frame >= m_frames.size())
+    return;
+
+  // Soft and hard reset are the same here.
+  const Frame& in = m_frames[frame];
+  if (in.commands & 0x03)
+    system->Reset();
+
+  for (u32 port = 0; port < System::NUM_CONTROLLERS; port++)
+  {
+    for (u8 button = 0; button < StandardController::NUM_BUTTONS; button++)
+      controllers[port].SetButtonState(button, (in.buttons[port] & (1 << button)) != 0);
+  }
+}
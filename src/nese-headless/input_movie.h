@@ -0,0 +1,29 @@
+#pragma once
+#include "nese/system.h"
+#include "types.h"
+#include <vector>
+
+class StandardController;
+
+// Controller input for a run, one entry per frame, loaded from an FCEUX movie (.fm2). Each frame is a line of the
+// form "|commands|RLDUTSBA|RLDUTSBA||", where a button is pressed unless its character is '.' or a space.
+class InputMovie
+{
+public:
+  bool LoadFM2(const char* filename);
+
+  u32 GetFrameCount() const { return static_cast<u32>(m_frames.size()); }
+
+  // Sets the controllers' buttons for the frame, and resets the system first if the movie does. Past the end of the
+  // movie, the controllers are left as they are.
+  void ApplyFrame(u32 frame, System* system, StandardController* controllers) const;
+
+private:
+  struct Frame
+  {
+    u8 commands;
+    u8 buttons[System::NUM_CONTROLLERS];
+  };
+
+  std::vector<Frame> m_frames;
+};
@@ -0,0 +1,357 @@
+#include "YBaseLib/Error.h"
+#include "YBaseLib/Log.h"
+#include "YBaseLib/Timer.h"
+#include "common/audio.h"
+#include "common/display.h"
+#include "common/hash.h"
+#include "input_movie.h"
+#include "nese/bus.h"
+#include "nese/cartridge.h"
+#include "nese/controller.h"
+#include "nese/cpu.h"
+#include "nese/cpu_debug_interface.h"
+#include "nese/event_timeline.h"
+#include "nese/system.h"
+#include "nese/system_pool.h"
+#include "regression.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Runs a ROM for a fixed number of frames as fast as possible, without a window or an audio device, and reports the
+// speed along with a hash of the final frame. With the same ROM, frame count and input, the hash must not change, so
+// this both measures and checks every change to the core. -novideo only renders the final frame, to measure jobs which
+// only read memory. Given a manifest, it runs a whole set of ROMs instead; see regression.h. With -instances, it runs
+// copies of the ROM side by side to measure how stepping many systems scales. -stats writes the performance counters
+// for every frame to a CSV file, and adds a breakdown by component to the report. -trace records the event timeline
+// and writes it as a Chrome trace, which keeps the most recent events if the run is long. -watch prints every access
+// hitting a watchpoint, given as for CPUDebugInterface::ParseWatchpoint(), and can be repeated.
+
+static void PrintWatchpointHit(u32 frame, const CPUDebugInterface::WatchpointHit& hit)
+{
+  const char* space = (hit.space == CPUDebugInterface::AddressSpace::PPU) ? "PPU" : "CPU";
+  if (hit.flag == Bus::WATCH_WRITE)
+  {
+    std::printf("watchpoint:       frame %u, PC $%04X, %s write $%04X: $%02X -> $%02X\n", frame, hit.pc, space,
+                hit.address, hit.old_value, hit.new_value);
+  }
+  else
+  {
+    std::printf("watchpoint:       frame %u, PC $%04X, %s %s $%04X: $%02X\n", frame, hit.pc, space,
+                (hit.flag == Bus::WATCH_READ) ? "read" : "execute", hit.address, hit.new_value);
+  }
+}
+
+static double GetPercentile(const std::vector<double>& sorted_values, double percentile)
+{
+  const size_t index = static_cast<size_t>(percentile * double(sorted_values.size() - 1) + 0.5);
+  return sorted_values[index];
+}
+
+struct Instance
+{
+  std::unique_ptr<Cartridge> cart;
+  NullDisplay display;
+  NullAudio audio;
+  StandardController controllers[System::NUM_CONTROLLERS];
+  System system;
+};
+
+// Runs the instances in lockstep on the pool, and returns the time taken. Every copy must finish on the same frame, or
+// some state is shared between systems.
+static bool RunInstancesPass(const Cartridge* cart, const InputMovie& movie, u32 num_frames, u32 num_instances,
+                             u32 num_threads, double* seconds)
+{
+  std::vector<std::unique_ptr<Instance>> instances;
+  SystemPool pool(num_threads);
+  for (u32 i = 0; i < num_instances; i++)
+  {
+    std::unique_ptr<Instance> instance = std::make_unique<Instance>();
+    instance->cart = cart->Clone();
+    if (!instance->system.Initialize(&instance->display, &instance->audio, instance->cart.get()))
+      return false;
+
+    for (u32 port = 0; port < System::NUM_CONTROLLERS; port++)
+      instance->system.SetController(port, &instance->controllers[port]);
+    instance->system.Reset();
+    pool.AddSystem(&instance->system);
+    instances.push_back(std::move(instance));
+  }
+
+  const Timer::Value start_time = Timer::GetValue();
+  for (u32 frame = 0; frame < num_frames; frame++)
+  {
+    for (const std::unique_ptr<Instance>& instance : instances)
+      movie.ApplyFrame(frame, &instance->system, instance->controllers);
+
+    pool.FrameStep();
+
+    for (const std::unique_ptr<Instance>& instance : instances)
+      instance->audio.Drain();
+  }
+  *seconds = Timer::ConvertValueToSeconds(Timer::GetValue() - start_time);
+
+  const NullDisplay& first = instances[0]->display;
+  const u32 framebuffer_size = first.GetFramebufferPitch() * first.GetFramebufferHeight();
+  for (const std::unique_ptr<Instance>& instance : instances)
+  {
+    if (std::memcmp(instance->display.GetFramebufferPointer(), first.GetFramebufferPointer(), framebuffer_size) != 0)
+    {
+      std::fprintf(stderr, "Instances diverged\n");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static int RunInstances(const Cartridge* cart, const InputMovie& movie, u32 num_frames, u32 num_instances,
+                        u32 num_threads)
+{
+  double single_seconds, pool_seconds;
+  if (!RunInstancesPass(cart, movie, num_frames, num_instances, 1, &single_seconds))
+    return EXIT_FAILURE;
+
+  if (num_threads == 0)
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  if (!RunInstancesPass(cart, movie, num_frames, num_instances, num_threads, &pool_seconds))
+    return EXIT_FAILURE;
+
+  // Efficiency is against the threads which can actually run at once, so oversubscribing doesn't hide the overhead.
+  const u32 num_cores = std::max(std::thread::hardware_concurrency(), 1u);
+  const u32 parallel_threads = std::min(std::min(num_threads, num_instances), num_cores);
+  const double total_frames = double(num_frames) * double(num_instances);
+  const double speedup = single_seconds / pool_seconds;
+  std::printf("instances:        %u\n", num_instances);
+  std::printf("threads:          %u (%u cores)\n", num_threads, num_cores);
+  std::printf("1 thread:         %.1f frames/s\n", total_frames / single_seconds);
+  std::printf("all threads:      %.1f frames/s (%.2fx, %.0f%% efficiency)\n", total_frames / pool_seconds, speedup,
+              speedup / double(parallel_threads) * 100.0);
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+  g_pLog->SetConsoleOutputParams(true, nullptr, LOGLEVEL_WARNING);
+
+  const char* filename = nullptr;
+  const char* input_filename = nullptr;
+  const char* manifest_filename = nullptr;
+  const char* stats_filename = nullptr;
+  const char* trace_filename = nullptr;
+  std::vector<CPUDebugInterface::Watchpoint> watchpoints;
+  u32 num_frames = 3600;
+  u32 num_threads = 0;
+  u32 num_instances = 0;
+  bool update = false;
+  bool no_video = false;
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::strcmp(argv[i], "-frames") == 0 && (i + 1) < argc)
+      num_frames = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "-input") == 0 && (i + 1) < argc)
+      input_filename = argv[++i];
+    else if (std::strcmp(argv[i], "-manifest") == 0 && (i + 1) < argc)
+      manifest_filename = argv[++i];
+    else if (std::strcmp(argv[i], "-jobs") == 0 && (i + 1) < argc)
+      num_threads = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "-instances") == 0 && (i + 1) < argc)
+      num_instances = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "-update") == 0)
+      update = true;
+    else if (std::strcmp(argv[i], "-novideo") == 0)
+      no_video = true;
+    else if (std::strcmp(argv[i], "-stats") == 0 && (i + 1) < argc)
+      stats_filename = argv[++i];
+    else if (std::strcmp(argv[i], "-trace") == 0 && (i + 1) < argc)
+      trace_filename = argv[++i];
+    else if (std::strcmp(argv[i], "-watch") == 0 && (i + 1) < argc)
+    {
+      CPUDebugInterface::Watchpoint wp;
+      if (!CPUDebugInterface::ParseWatchpoint(argv[++i], &wp))
+      {
+        std::fprintf(stderr, "Invalid watchpoint '%s', expected [ppu:]<r|w|x>:<start>[-<end>][=<value>]\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+
+      watchpoints.push_back(wp);
+    }
+    else
+      filename = argv[i];
+  }
+
+  if (manifest_filename)
+    return Regression::RunManifest(manifest_filename, num_threads, update);
+
+  if (!filename || num_frames == 0)
+  {
+    std::fprintf(stderr,
+                 "usage: %s [-frames <count>] [-input <movie.fm2>] [-novideo] [-stats <file.csv>] [-trace <file.json>] "
+                 "[-watch <watchpoint>]... <path to .nes>\n",
+                 argv[0]);
+    std::fprintf(stderr, "       %s -instances <count> [-jobs <count>] [-frames <count>] [-input <movie.fm2>] <rom>\n",
+                 argv[0]);
+    std::fprintf(stderr, "       %s -manifest <file> [-jobs <count>] [-update]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  Error error;
+  std::unique_ptr<Cartridge> cart = Cartridge::LoadFile(filename, &error);
+  if (!cart)
+  {
+    std::fprintf(stderr, "Cartridge load error: %s\n", error.GetErrorDescription().GetCharArray());
+    return EXIT_FAILURE;
+  }
+
+  InputMovie movie;
+  if (input_filename && !movie.LoadFM2(input_filename))
+  {
+    std::fprintf(stderr, "Failed to read input file '%s'\n", input_filename);
+    return EXIT_FAILURE;
+  }
+
+  if (num_instances > 0)
+    return RunInstances(cart.get(), movie, num_frames, num_instances, num_threads);
+
+  NullDisplay display;
+  NullAudio audio;
+  StandardController controllers[System::NUM_CONTROLLERS];
+  System system;
+  if (!system.Initialize(&display, &audio, cart.get()))
+  {
+    std::fprintf(stderr, "Failed to initialize system\n");
+    return EXIT_FAILURE;
+  }
+
+  for (u32 i = 0; i < System::NUM_CONTROLLERS; i++)
+    system.SetController(i, &controllers[i]);
+  system.Reset();
+
+  std::FILE* stats_fp = nullptr;
+  if (stats_filename)
+  {
+    stats_fp = std::fopen(stats_filename, "w");
+    if (!stats_fp)
+    {
+      std::fprintf(stderr, "Failed to open stats file '%s'\n", stats_filename);
+      return EXIT_FAILURE;
+    }
+
+    std::fprintf(stats_fp, "frame,frame_ms");
+    for (u32 i = 0; i < PerfCounters::NUM_SECTIONS; i++)
+    {
+      std::fputc(',', stats_fp);
+      for (const char* ch = PerfCounters::GetSectionName(static_cast<PerfCounters::Section>(i)); *ch; ch++)
+        std::fputc(std::tolower(static_cast<unsigned char>(*ch)), stats_fp);
+      std::fprintf(stats_fp, "_ms");
+    }
+    std::fprintf(stats_fp, ",cpu_cycles,cpu_instructions,syncs,audio_underrun_samples,audio_overrun_samples\n");
+    system.SetStatsEnabled(true);
+  }
+
+  if (trace_filename)
+    system.SetEventTimelineEnabled(true);
+
+  CPUDebugInterface* debug_interface = system.GetDebugInterface();
+  for (const CPUDebugInterface::Watchpoint& wp : watchpoints)
+    debug_interface->AddWatchpoint(wp);
+
+  std::vector<double> frame_times;
+  frame_times.reserve(num_frames);
+  u64 total_cycles = 0;
+  double total_section_ms[PerfCounters::NUM_SECTIONS] = {};
+  u64 total_instructions = 0;
+  u64 total_syncs = 0;
+
+  const Timer::Value start_time = Timer::GetValue();
+  Timer::Value last_time = start_time;
+  for (u32 frame = 0; frame < num_frames; frame++)
+  {
+    movie.ApplyFrame(frame, &system, controllers);
+
+    // Only the final frame is needed for the hash, which must come out the same either way.
+    system.SetVideoEnabled(!no_video || frame == (num_frames - 1));
+
+    // The cycle counter is 32-bit, so it's accumulated per frame.
+    const u32 start_cycles = system.GetCPU()->GetCyclesSinceReset();
+    const u32 frame_number = system.GetFrameNumber();
+    system.FrameStep();
+
+    // Stopping at a watchpoint returns part-way through the frame, unless it stopped as the frame ended.
+    while (debug_interface->IsStopped())
+    {
+      if (const CPUDebugInterface::WatchpointHit* hit = debug_interface->GetWatchpointHit())
+        PrintWatchpointHit(frame, *hit);
+
+      debug_interface->Continue();
+      if (system.GetFrameNumber() == frame_number)
+        system.FrameStep();
+    }
+
+    audio.Drain();
+    total_cycles += system.GetCPU()->GetCyclesSinceReset() - start_cycles;
+
+    if (stats_fp)
+    {
+      const PerfCounters::FrameStats& fs = system.GetLastFrameStats();
+      std::fprintf(stats_fp, "%u,%.4f", frame, fs.frame_ms);
+      for (u32 i = 0; i < PerfCounters::NUM_SECTIONS; i++)
+      {
+        std::fprintf(stats_fp, ",%.4f", fs.section_ms[i]);
+        total_section_ms[i] += fs.section_ms[i];
+      }
+      std::fprintf(stats_fp, ",%u,%u,%u,%u,%u\n", fs.cpu_cycles, fs.cpu_instructions, fs.syncs,
+                   fs.audio_underrun_samples, fs.audio_overrun_samples);
+      total_instructions += fs.cpu_instructions;
+      total_syncs += fs.syncs;
+    }
+
+    const Timer::Value now = Timer::GetValue();
+    frame_times.push_back(Timer::ConvertValueToMilliseconds(now - last_time));
+    last_time = now;
+  }
+
+  const double total_seconds = Timer::ConvertValueToSeconds(last_time - start_time);
+  std::sort(frame_times.begin(), frame_times.end());
+
+  const u64 hash = HashBytes64(display.GetFramebufferPointer(),
+                               display.GetFramebufferPitch() * display.GetFramebufferHeight());
+
+  std::printf("frames:           %u\n", num_frames);
+  std::printf("time:             %.3f s\n", total_seconds);
+  std::printf("frames/s:         %.1f\n", double(num_frames) / total_seconds);
+  std::printf("cycles/s:         %.0f (%.1fx real time)\n", double(total_cycles) / total_seconds,
+              double(total_cycles) / total_seconds / double(APU::CPU_CLOCK_RATE));
+  std::printf("frame time (ms):  p50 %.4f, p90 %.4f, p99 %.4f, max %.4f\n", GetPercentile(frame_times, 0.5),
+              GetPercentile(frame_times, 0.9), GetPercentile(frame_times, 0.99), frame_times.back());
+  if (stats_fp)
+  {
+    std::printf("frame time by component (ms):");
+    for (u32 i = 0; i < PerfCounters::NUM_SECTIONS; i++)
+    {
+      const char* name = PerfCounters::GetSectionName(static_cast<PerfCounters::Section>(i));
+      std::printf("%s %s %.4f", (i == 0) ? "" : ",", name, total_section_ms[i] / double(num_frames));
+    }
+    std::printf("\nper frame:        %.0f cycles, %.0f instructions, %.0f syncs\n",
+                double(total_cycles) / double(num_frames), double(total_instructions) / double(num_frames),
+                double(total_syncs) / double(num_frames));
+    std::fclose(stats_fp);
+  }
+
+  if (trace_filename)
+  {
+    const EventTimeline* timeline = system.GetEventTimeline();
+    if (!timeline->WriteChromeTrace(trace_filename))
+      return EXIT_FAILURE;
+
+    std::printf("trace:            %u events written to %s\n", timeline->GetEventCount(), trace_filename);
+  }
+
+  std::printf("framebuffer hash: %016llx\n", static_cast<unsigned long long>(hash));
+  return EXIT_SUCCESS;
+}
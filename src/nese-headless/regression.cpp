@@ -0,0 +1,473 @@
+#include "regression.h"
+#include "YBaseLib/Error.h"
+#include "YBaseLib/Timer.h"
+#include "common/audio.h"
+#include "common/display.h"
+#include "common/hash.h"
+#include "common/work_stealing_pool.h"
+#include "input_movie.h"
+#include "nese/bus.h"
+#include "nese/cartridge.h"
+#include "nese/controller.h"
+#include "nese/system.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <thread>
+
+namespace Regression {
+
+// blargg's test ROMs report through cartridge RAM: $6000 holds the status, $6001-$6003 a signature showing that it is
+// valid, and the text output starts at $6004.
+static const u16 BLARGG_STATUS_ADDRESS = 0x6000;
+static const u16 BLARGG_TEXT_ADDRESS = 0x6004;
+static const u32 BLARGG_TEXT_MAX_LENGTH = 1024;
+static const u8 BLARGG_STATUS_RUNNING = 0x80;
+static const u8 BLARGG_STATUS_NEEDS_RESET = 0x81;
+
+// The test wants the reset button pressed at least 100ms after it asks.
+static const u32 BLARGG_RESET_DELAY_FRAMES = 8;
+
+static bool IsAbsolutePath(const std::string& path)
+{
+  return (!path.empty() && (path[0] == '/' || path[0] == '\\')) || (path.size() > 1 && path[1] == ':');
+}
+
+static std::string GetManifestRelativePath(const char* manifest_filename, const std::string& path)
+{
+  if (IsAbsolutePath(path))
+    return path;
+
+  const char* separator = std::strrchr(manifest_filename, '/');
+  const char* backslash = std::strrchr(manifest_filename, '\\');
+  if (!separator || (backslash && backslash > separator))
+    separator = backslash;
+  if (!separator)
+    return path;
+
+  return std::string(manifest_filename, separator + 1) + path;
+}
+
+static std::vector<std::string> SplitLine(const char* line)
+{
+  std::vector<std::string> tokens;
+  const char* pos = line;
+  for (;;)
+  {
+    while (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n')
+      pos++;
+    if (*pos == '\0')
+      break;
+
+    const char* start = pos;
+    while (*pos != '\0' && *pos != ' ' && *pos != '\t' && *pos != '\r' && *pos != '\n')
+      pos++;
+    tokens.emplace_back(start, pos);
+  }
+
+  return tokens;
+}
+
+static bool ReadLines(const char* filename, std::vector<std::string>* lines)
+{
+  std::FILE* fp = std::fopen(filename, "r");
+  if (!fp)
+    return false;
+
+  char line[1024];
+  while (std::fgets(line, sizeof(line), fp))
+  {
+    size_t length = std::strlen(line);
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+      length--;
+    lines->emplace_back(line, length);
+  }
+
+  std::fclose(fp);
+  return true;
+}
+
+static bool ParseJob(const char* manifest_filename, const std::vector<std::string>& tokens, Job* job)
+{
+  if (tokens.size() < 2)
+    return false;
+
+  char* end;
+  job->rom_path = tokens[0];
+  job->rom_filename = GetManifestRelativePath(manifest_filename, job->rom_path);
+  job->frames = static_cast<u32>(std::strtoul(tokens[1].c_str(), &end, 10));
+  if (*end != '\0' || job->frames == 0)
+    return false;
+
+  job->blargg = false;
+  for (size_t i = 2; i < tokens.size(); i++)
+  {
+    const std::string& token = tokens[i];
+    if (token.compare(0, 6, "input=") == 0)
+    {
+      job->input_path = token.substr(6);
+      job->input_filename = GetManifestRelativePath(manifest_filename, job->input_path);
+      continue;
+    }
+    if (token == "blargg")
+    {
+      job->blargg = true;
+      continue;
+    }
+
+    Checkpoint checkpoint = {};
+    checkpoint.frame = static_cast<u32>(std::strtoul(token.c_str(), &end, 10));
+    if (end == token.c_str() || checkpoint.frame == 0)
+      return false;
+    if (*end == '=')
+    {
+      const char* hash = end + 1;
+      checkpoint.expected_hash = std::strtoull(hash, &end, 16);
+      checkpoint.has_expected_hash = true;
+      if (end == hash)
+        return false;
+    }
+    if (*end != '\0')
+      return false;
+
+    job->checkpoints.push_back(checkpoint);
+  }
+
+  return true;
+}
+
+static std::string FormatJob(const Job& job)
+{
+  char buf[64];
+  std::snprintf(buf, sizeof(buf), " %u", job.frames);
+  std::string line = job.rom_path + buf;
+  if (!job.input_path.empty())
+    line += " input=" + job.input_path;
+  if (job.blargg)
+    line += " blargg";
+
+  for (const Checkpoint& checkpoint : job.checkpoints)
+  {
+    if (checkpoint.has_expected_hash)
+    {
+      std::snprintf(buf, sizeof(buf), " %u=%016llx", checkpoint.frame,
+                    static_cast<unsigned long long>(checkpoint.expected_hash));
+    }
+    else
+    {
+      std::snprintf(buf, sizeof(buf), " %u", checkpoint.frame);
+    }
+    line += buf;
+  }
+
+  return line;
+}
+
+static bool IsJobLine(const std::string& line)
+{
+  const std::vector<std::string> tokens = SplitLine(line.c_str());
+  return !tokens.empty() && tokens[0][0] != '#';
+}
+
+bool LoadManifest(const char* filename, std::vector<Job>* jobs)
+{
+  std::vector<std::string> lines;
+  if (!ReadLines(filename, &lines))
+  {
+    std::fprintf(stderr, "Failed to read manifest '%s'\n", filename);
+    return false;
+  }
+
+  for (size_t i = 0; i < lines.size(); i++)
+  {
+    if (!IsJobLine(lines[i]))
+      continue;
+
+    Job job = {};
+    if (!ParseJob(filename, SplitLine(lines[i].c_str()), &job))
+    {
+      std::fprintf(stderr, "%s:%u: invalid line\n", filename, static_cast<u32>(i + 1));
+      return false;
+    }
+
+    jobs->push_back(std::move(job));
+  }
+
+  return true;
+}
+
+bool SaveManifest(const char* filename, const std::vector<Job>& jobs)
+{
+  // Comments and blank lines are kept, and job lines replaced in order.
+  std::vector<std::string> lines;
+  if (!ReadLines(filename, &lines))
+    return false;
+
+  size_t next_job = 0;
+  for (std::string& line : lines)
+  {
+    if (IsJobLine(line) && next_job < jobs.size())
+      line = FormatJob(jobs[next_job++]);
+  }
+
+  std::FILE* fp = std::fopen(filename, "w");
+  if (!fp)
+    return false;
+
+  for (const std::string& line : lines)
+    std::fprintf(fp, "%s\n", line.c_str());
+
+  return (std::fclose(fp) == 0);
+}
+
+static u64 HashState(System* system, NullDisplay* display)
+{
+  const u64 framebuffer_hash =
+    HashBytes64(display->GetFramebufferPointer(), display->GetFramebufferPitch() * display->GetFramebufferHeight());
+  return HashBytes64(system->GetBus()->GetWRAM(), Bus::WRAM_SIZE, framebuffer_hash);
+}
+
+static bool ReadBlarggStatus(Bus* bus, u8* status)
+{
+  if (bus->ReadCPUAddress(0x6001) != 0xDE || bus->ReadCPUAddress(0x6002) != 0xB0 ||
+      bus->ReadCPUAddress(0x6003) != 0x61)
+  {
+    return false;
+  }
+
+  *status = bus->ReadCPUAddress(BLARGG_STATUS_ADDRESS);
+  return true;
+}
+
+// Returns the test's output, with lines joined.
+static std::string ReadBlarggText(Bus* bus)
+{
+  std::string text;
+  for (u32 i = 0; i < BLARGG_TEXT_MAX_LENGTH; i++)
+  {
+    const char ch = static_cast<char>(bus->ReadCPUAddress(static_cast<u16>(BLARGG_TEXT_ADDRESS + i)));
+    if (ch == '\0')
+      break;
+
+    if (ch == '\n' || ch == '\r')
+    {
+      if (!text.empty() && text.back() != ' ')
+        text += ' ';
+    }
+    else
+    {
+      text += ch;
+    }
+  }
+
+  while (!text.empty() && text.back() == ' ')
+    text.pop_back();
+  return text;
+}
+
+void RunJob(const Job& job, Result* result)
+{
+  result->passed = false;
+  result->message.clear();
+  result->checkpoint_hashes.assign(job.checkpoints.size(), 0);
+  result->frames_run = 0;
+  result->seconds = 0.0;
+
+  Error error;
+  std::unique_ptr<Cartridge> cart = Cartridge::LoadFile(job.rom_filename.c_str(), &error);
+  if (!cart)
+  {
+    result->message = std::string("cartridge load error: ") + error.GetErrorDescription().GetCharArray();
+    return;
+  }
+
+  InputMovie movie;
+  if (!job.input_filename.empty() && !movie.LoadFM2(job.input_filename.c_str()))
+  {
+    result->message = "failed to read input file '" + job.input_filename + "'";
+    return;
+  }
+
+  NullDisplay display;
+  NullAudio audio;
+  StandardController controllers[System::NUM_CONTROLLERS];
+  System system;
+  if (!system.Initialize(&display, &audio, cart.get()))
+  {
+    result->message = "failed to initialize system";
+    return;
+  }
+
+  for (u32 i = 0; i < System::NUM_CONTROLLERS; i++)
+    system.SetController(i, &controllers[i]);
+  system.Reset();
+
+  bool blargg_finished = false;
+  u8 blargg_status = 0;
+  bool blargg_status_valid = false;
+  u32 reset_countdown = 0;
+
+  const Timer::Value start_time = Timer::GetValue();
+  for (u32 frame = 0; frame < job.frames && !blargg_finished; frame++)
+  {
+    movie.ApplyFrame(frame, &system, controllers);
+    if (reset_countdown > 0 && --reset_countdown == 0)
+      system.Reset();
+
+    system.FrameStep();
+    audio.Drain();
+    result->frames_run = frame + 1;
+
+    for (size_t i = 0; i < job.checkpoints.size(); i++)
+    {
+      if (job.checkpoints[i].frame == result->frames_run)
+        result->checkpoint_hashes[i] = HashState(&system, &display);
+    }
+
+    if (job.blargg && reset_countdown == 0 && ReadBlarggStatus(system.GetBus(), &blargg_status))
+    {
+      blargg_status_valid = true;
+      if (blargg_status == BLARGG_STATUS_NEEDS_RESET)
+        reset_countdown = BLARGG_RESET_DELAY_FRAMES;
+      else if (blargg_status < BLARGG_STATUS_RUNNING)
+        blargg_finished = true;
+    }
+  }
+  result->seconds = Timer::ConvertValueToSeconds(Timer::GetValue() - start_time);
+
+  char buf[128];
+  if (job.blargg)
+  {
+    if (!blargg_finished)
+    {
+      if (blargg_status_valid)
+        std::snprintf(buf, sizeof(buf), "no result after %u frames (status $%02X)", job.frames, blargg_status);
+      else
+        std::snprintf(buf, sizeof(buf), "no result after %u frames (no status)", job.frames);
+      result->message = buf;
+      return;
+    }
+
+    const std::string text = ReadBlarggText(system.GetBus());
+    if (blargg_status != 0)
+    {
+      std::snprintf(buf, sizeof(buf), "failed with code %u: ", blargg_status);
+      result->message = buf + text;
+      return;
+    }
+
+    result->message = text;
+  }
+
+  for (size_t i = 0; i < job.checkpoints.size(); i++)
+  {
+    const Checkpoint& checkpoint = job.checkpoints[i];
+    if (checkpoint.frame > result->frames_run)
+    {
+      std::snprintf(buf, sizeof(buf), "frame %u: not reached", checkpoint.frame);
+      result->message = buf;
+      return;
+    }
+
+    if (checkpoint.has_expected_hash && checkpoint.expected_hash != result->checkpoint_hashes[i])
+    {
+      std::snprintf(buf, sizeof(buf), "frame %u: expected %016llx, got %016llx", checkpoint.frame,
+                    static_cast<unsigned long long>(checkpoint.expected_hash),
+                    static_cast<unsigned long long>(result->checkpoint_hashes[i]));
+      result->message = buf;
+      return;
+    }
+  }
+
+  if (result->message.empty())
+  {
+    std::snprintf(buf, sizeof(buf), "checkpoints: %u", static_cast<u32>(job.checkpoints.size()));
+    result->message = buf;
+  }
+  result->passed = true;
+}
+
+int RunManifest(const char* filename, u32 num_threads, bool update)
+{
+  std::vector<Job> jobs;
+  if (!LoadManifest(filename, &jobs))
+    return EXIT_FAILURE;
+  if (jobs.empty())
+  {
+    std::fprintf(stderr, "No jobs in manifest '%s'\n", filename);
+    return EXIT_FAILURE;
+  }
+
+  // In update mode, every checkpoint is recorded rather than checked.
+  if (update)
+  {
+    for (Job& job : jobs)
+    {
+      for (Checkpoint& checkpoint : job.checkpoints)
+        checkpoint.has_expected_hash = false;
+    }
+  }
+
+  // No more threads than jobs.
+  if (num_threads == 0)
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  num_threads = std::min(num_threads, static_cast<u32>(jobs.size()));
+
+  // Longest first, so that the jobs left to steal at the end are the short ones.
+  std::vector<u32> order(jobs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&jobs](u32 lhs, u32 rhs) { return jobs[lhs].frames > jobs[rhs].frames; });
+
+  std::vector<Result> results(jobs.size());
+  const Timer::Value start_time = Timer::GetValue();
+  WorkStealingPool pool(num_threads);
+  pool.Run(order.data(), static_cast<u32>(order.size()),
+           [&jobs, &results](u32 index) { RunJob(jobs[index], &results[index]); });
+  const double total_seconds = Timer::ConvertValueToSeconds(Timer::GetValue() - start_time);
+
+  u32 num_passed = 0;
+  u64 total_frames = 0;
+  for (size_t i = 0; i < jobs.size(); i++)
+  {
+    const Result& result = results[i];
+    const double fps = (result.seconds > 0.0) ? (double(result.frames_run) / result.seconds) : 0.0;
+    std::printf("%s  %-40s %7u frames %9.1f fps  %s\n", result.passed ? "PASS" : "FAIL", jobs[i].rom_path.c_str(),
+                result.frames_run, fps, result.message.c_str());
+
+    num_passed += result.passed ? 1 : 0;
+    total_frames += result.frames_run;
+  }
+
+  std::printf("%u passed, %u failed, %.3f s on %u threads (%.1f frames/s)\n", num_passed,
+              static_cast<u32>(jobs.size()) - num_passed, total_seconds, pool.GetThreadCount(),
+              double(total_frames) / total_seconds);
+
+  if (update)
+  {
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+      for (size_t j = 0; j < jobs[i].checkpoints.size(); j++)
+      {
+        Checkpoint& checkpoint = jobs[i].checkpoints[j];
+        if (checkpoint.frame <= results[i].frames_run)
+        {
+          checkpoint.expected_hash = results[i].checkpoint_hashes[j];
+          checkpoint.has_expected_hash = true;
+        }
+      }
+    }
+
+    if (!SaveManifest(filename, jobs))
+    {
+      std::fprintf(stderr, "Failed to write manifest '%s'\n", filename);
+      return EXIT_FAILURE;
+    }
+  }
+
+  return (num_passed == jobs.size()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace Regression
@@ -0,0 +1,58 @@
+#pragma once
+#include "types.h"
+#include <string>
+#include <vector>
+
+// Runs a manifest of ROMs, each for a number of frames with optional input, and compares the state at chosen frames
+// against golden hashes. The manifest is a text file with one run per line, and '#' starting a comment:
+//
+//   <rom> <frames> [input=<movie.fm2>] [blargg] [<frame>=<hash>]... [<frame>]...
+//
+// Paths are relative to the manifest. A checkpoint hashes the framebuffer and the console's WRAM after that many
+// frames; one without a hash is recorded but not checked, and update mode fills them all in. "blargg" watches the
+// test status at $6000, stopping when the test finishes, and fails the run if it doesn't report success.
+//
+// The runs are spread across all threads, and each one's speed is reported along with its result, so one run finds
+// both accuracy and performance regressions.
+namespace Regression {
+
+struct Checkpoint
+{
+  u32 frame;
+  u64 expected_hash;
+  bool has_expected_hash;
+};
+
+struct Job
+{
+  std::string rom_filename;
+  std::string input_filename;
+  u32 frames;
+  bool blargg;
+  std::vector<Checkpoint> checkpoints;
+
+  // As written in the manifest, for update mode.
+  std::string rom_path;
+  std::string input_path;
+};
+
+struct Result
+{
+  bool passed;
+  std::string message;
+  std::vector<u64> checkpoint_hashes;
+  u32 frames_run;
+  double seconds;
+};
+
+bool LoadManifest(const char* filename, std::vector<Job>* jobs);
+bool SaveManifest(const char* filename, const std::vector<Job>& jobs);
+
+// Runs a single job. Independent jobs can run on different threads.
+void RunJob(const Job& job, Result* result);
+
+// Runs every job in the manifest on the given number of threads (zero for one per core), and prints the results.
+// In update mode, the hashes found are written back to the manifest instead of being checked. Returns the exit code.
+int RunManifest(const char* filename, u32 num_threads, bool update);
+
+} // namespace Regression
@@ -1,5 +1,6 @@
 #include "debuggermodels.h"
 #include "YBaseLib/Assert.h"
+#include "YBaseLib/String.h"
 #include <QtGui/QColor>
 
 namespace QtFrontend {
@@ -8,6 +9,12 @@ const int MAX_CODE_ROWS = 1024;
 const CPUDebugInterface::ProgramCounterType MAX_CODE_DISTANCE = 4096;
 const int NUM_COLUMNS = 3;
 
+// CPU::Disassemble() puts the instruction after the address and bytes.
+const int DISASSEMBLY_INSTRUCTION_COLUMN = 16;
+
+// A, X, Y, P, S and PC.
+const uint32 NUM_REGISTERS = 6;
+
 DebuggerCodeModel::DebuggerCodeModel(CPUDebugInterface* intf, QObject* parent /*= nullptr*/)
   : QAbstractTableModel(parent), m_interface(intf)
 
@@ -45,43 +52,34 @@ QVariant DebuggerCodeModel::data(const QModelIndex& index, int role /*= Qt::Disp
       case 0:
       {
         // Address
-        return QVariant(QString::asprintf("0x%08X", address));
+        return QVariant(QString::asprintf("$%04X", address));
       }
 
       case 1:
       {
-#if 0
         // Bytes
-        uint32 instruction_length;
-        if (!m_interface->DisassembleCode(address, nullptr, &instruction_length))
+        SmallString instruction;
+        u16 instruction_length;
+        if (!m_interface->DisassembleInstruction(address, &instruction, &instruction_length))
           return "<invalid>";
 
         SmallString value;
-        for (uint32 i = 0; i < instruction_length; i++)
+        for (u16 i = 0; i < instruction_length; i++)
         {
-          uint8 byte_value;
-          if (!m_interface->ReadMemoryByte(address + i, &byte_value))
-            break;
+          const u8 byte_value = m_interface->ReadMemoryByte(static_cast<u16>(address + i));
           value.AppendFormattedString("%s%02X", (i == 0) ? "" : " ", ZeroExtend32(byte_value));
         }
         return value.GetCharArray();
-#else
-        return "<invalid>";
-#endif
       }
 
       case 2:
       {
-#if 0
         // Instruction
-        String instruction;
-        if (!m_interface->DisassembleCode(address, &instruction, nullptr))
+        SmallString instruction;
+        if (!m_interface->DisassembleInstruction(address, &instruction, nullptr))
           return "<invalid>";
 
-        return instruction.GetCharArray();
-#else
-        return "<invalid>";
-#endif
+        return QString::fromUtf8(instruction.GetCharArray()).mid(DISASSEMBLY_INSTRUCTION_COLUMN);
       }
 
       default:
@@ -95,10 +93,10 @@ QVariant DebuggerCodeModel::data(const QModelIndex& index, int role /*= Qt::Disp
     if (!getAddressForRow(&address, row))
       return QVariant();
 
-    // breakpoint
-    // return QVariant(QColor(171, 97, 107));
     if (address == m_last_instruction_pointer)
       return QVariant(QColor(255, 241, 129));
+    else if (hasBreakpoint(address))
+      return QVariant(QColor(171, 97, 107));
     else
       return QVariant();
   }
@@ -175,14 +173,13 @@ int DebuggerCodeModel::getRowForAddress(CPUDebugInterface::ProgramCounterType ad
     }
 
     // Get the instruction length
-    uint32 instruction_size = 1;
-#if 0
-    if (!m_interface->DisassembleCode(current_address, nullptr, &instruction_size))
+    SmallString instruction;
+    u16 instruction_size;
+    if (!m_interface->DisassembleInstruction(current_address, &instruction, &instruction_size))
     {
       resetCodeView(address);
       return 0;
     }
-#endif
 
     row++;
     current_address += instruction_size;
@@ -229,11 +226,10 @@ bool DebuggerCodeModel::getAddressForRow(CPUDebugInterface::ProgramCounterType*
   while (last_row < row)
   {
     // Get the instruction length
-    uint32 instruction_size = 1;
-#if 0
-    if (!m_interface->DisassembleCode(last_address, nullptr, &instruction_size))
+    SmallString instruction;
+    u16 instruction_size;
+    if (!m_interface->DisassembleInstruction(last_address, &instruction, &instruction_size))
       return false;
-#endif
 
     last_address += static_cast<CPUDebugInterface::ProgramCounterType>(instruction_size);
     last_row++;
@@ -246,7 +242,10 @@ bool DebuggerCodeModel::getAddressForRow(CPUDebugInterface::ProgramCounterType*
 
 int DebuggerCodeModel::updateInstructionPointer()
 {
-  CPUDebugInterface::ProgramCounterType ip = 0; // m_interface->GetInstructionPointer();
+  // Code and banks may have changed since the rows were found.
+  resetCodeView(m_start_instruction_pointer);
+
+  CPUDebugInterface::ProgramCounterType ip = m_interface->GetProgramCounter();
   int new_row = getRowForAddress(ip);
   if (m_last_instruction_pointer == ip)
     return new_row;
@@ -263,6 +262,23 @@ int DebuggerCodeModel::updateInstructionPointer()
   return new_row;
 }
 
+bool DebuggerCodeModel::hasBreakpoint(CPUDebugInterface::ProgramCounterType address) const
+{
+  return (m_breakpoint_locations.find(m_interface->GetBreakpointLocation(address)) != m_breakpoint_locations.end());
+}
+
+void DebuggerCodeModel::setBreakpoint(CPUDebugInterface::ProgramCounterType address, bool enabled)
+{
+  const u32 location = m_interface->GetBreakpointLocation(address);
+  if (enabled)
+    m_breakpoint_locations.insert(location);
+  else
+    m_breakpoint_locations.erase(location);
+
+  const int row = getRowForAddress(address);
+  emit dataChanged(index(row, 0), index(row, NUM_COLUMNS - 1));
+}
+
 DebuggerRegistersModel::DebuggerRegistersModel(CPUDebugInterface* intf, QObject* parent /*= nullptr*/)
   : QAbstractListModel(parent), m_interface(intf)
 {
@@ -272,8 +288,7 @@ DebuggerRegistersModel::~DebuggerRegistersModel() {}
 
 int DebuggerRegistersModel::rowCount(const QModelIndex& parent /*= QModelIndex()*/) const
 {
-  // return static_cast<int>(m_interface->GetRegisterCount());
-  return 4;
+  return NUM_REGISTERS;
 }
 
 int DebuggerRegistersModel::columnCount(const QModelIndex& parent /*= QModelIndex()*/) const
@@ -284,8 +299,7 @@ int DebuggerRegistersModel::columnCount(const QModelIndex& parent /*= QModelInde
 QVariant DebuggerRegistersModel::data(const QModelIndex& index, int role /*= Qt::DisplayRole*/) const
 {
   uint32 reg_index = static_cast<uint32>(index.row());
-  // if (reg_index > m_interface->GetRegisterCount())
-  if (reg_index > 4)
+  if (reg_index >= NUM_REGISTERS)
     return QVariant();
 
   if (index.column() < 0 || index.column() > 1)
@@ -294,29 +308,34 @@ QVariant DebuggerRegistersModel::data(const QModelIndex& index, int role /*= Qt:
   if (role != Qt::DisplayRole)
     return QVariant();
 
+  static const char* register_names[NUM_REGISTERS] = {"A", "X", "Y", "P", "S", "PC"};
   if (index.column() == 0)
+    return register_names[reg_index];
+
+  const CPU::Registers* registers = m_interface->GetRegisters();
+  switch (reg_index)
   {
-    // return m_interface->GetRegisterName(reg_index);
-    return "<reg>";
-  }
-  else
-  {
-#if 0
-    DebuggerInterface::RegisterType type = m_interface->GetRegisterType(reg_index);
-    DebuggerInterface::RegisterValue value = m_interface->GetRegisterValue(reg_index);
-    switch (type)
+    case 0:
+      return QString::asprintf("$%02X", ZeroExtend32(registers->A));
+    case 1:
+      return QString::asprintf("$%02X", ZeroExtend32(registers->X));
+    case 2:
+      return QString::asprintf("$%02X", ZeroExtend32(registers->Y));
+    case 3:
     {
-      case DebuggerInterface::RegisterType::Byte:
-        return QString::asprintf("0x%02X", ZeroExtend32(value.val_byte));
-      case DebuggerInterface::RegisterType::Word:
-        return QString::asprintf("0x%04X", ZeroExtend32(value.val_word));
-      case DebuggerInterface::RegisterType::DWord:
-        return QString::asprintf("0x%08X", value.val_dword);
-      default:
-        return QString();
+      // With the flags set shown as letters.
+      static const char flag_names[] = "CZIDBUVN";
+      QString flags;
+      for (int i = 7; i >= 0; i--)
+        flags += ((registers->P >> i) & 1) ? QLatin1Char(flag_names[i]) : QLatin1Char('-');
+      return QString::asprintf("$%02X ", ZeroExtend32(registers->P)) + flags;
     }
-#endif
-    return QString();
+    case 4:
+      return QString::asprintf("$%02X", ZeroExtend32(registers->S));
+    case 5:
+      return QString::asprintf("$%04X", ZeroExtend32(registers->PC));
+    default:
+      return QString();
   }
 }
 
@@ -384,19 +403,8 @@ DebuggerStackModel::~DebuggerStackModel() {}
 
 int DebuggerStackModel::rowCount(const QModelIndex& parent /*= QModelIndex()*/) const
 {
-#if 0
-  LinearMemoryAddress stack_bottom = m_interface->GetStackBottom();
-  LinearMemoryAddress stack_top = m_interface->GetStackTop();
-  if (stack_bottom < stack_top)
-    return 0;
-
-  DebuggerInterface::RegisterType width = m_interface->GetStackValueType();
-  LinearMemoryAddress value_size = (width == DebuggerInterface::RegisterType::Word) ? 2 : 4;
-  int num_rows = static_cast<int>((stack_bottom - stack_top) / value_size) + 1;
-  return std::min(num_rows, 1024);
-#else
-  return 0;
-#endif
+  // From the top of the stack down to $01FF.
+  return 0xFF - static_cast<int>(m_interface->GetRegisters()->S);
 }
 
 int DebuggerStackModel::columnCount(const QModelIndex& parent /*= QModelIndex()*/) const
@@ -412,30 +420,11 @@ QVariant DebuggerStackModel::data(const QModelIndex& index, int role /*= Qt::Dis
   if (role != Qt::DisplayRole)
     return QVariant();
 
-#if 0
-  DebuggerInterface::RegisterType width = m_interface->GetStackValueType();
-  LinearMemoryAddress value_size = (width == DebuggerInterface::RegisterType::Word) ? 2 : 4;
-  LinearMemoryAddress address = m_interface->GetStackTop() + static_cast<LinearMemoryAddress>(index.row()) * value_size;
-
+  const u16 address = CPU::STACK_BASE + u16(m_interface->GetRegisters()->S) + 1 + static_cast<u16>(index.row());
   if (index.column() == 0)
-    return QString::asprintf("0x%08X", address);
-
-  if (width == DebuggerInterface::RegisterType::Word)
-  {
-    uint16 value;
-    if (!m_interface->ReadMemoryWord(address, &value))
-      return QVariant();
-    return QString::asprintf("0x%04X", ZeroExtend32(value));
-  }
+    return QString::asprintf("$%04X", ZeroExtend32(address));
   else
-  {
-    uint32 value;
-    if (!m_interface->ReadMemoryDWord(address, &value))
-      return QVariant();
-    return QString::asprintf("0x%08X", ZeroExtend32(value));
-  }
-#endif
-  return QString();
+    return QString::asprintf("$%02X", ZeroExtend32(m_interface->ReadMemoryByte(address)));
 }
 
 QVariant DebuggerStackModel::headerData(int section, Qt::Orientation orientation, int role /*= Qt::DisplayRole*/) const
@@ -3,6 +3,7 @@
 #include <QtCore/QAbstractListModel>
 #include <QtCore/QAbstractTableModel>
 #include <map>
+#include <set>
 
 namespace QtFrontend {
 
@@ -24,8 +25,13 @@ public:
 
   int updateInstructionPointer();
 
+  // Breakpoints are tracked here as well as in the system, so showing them doesn't race with commands changing them.
+  bool hasBreakpoint(CPUDebugInterface::ProgramCounterType address) const;
+  void setBreakpoint(CPUDebugInterface::ProgramCounterType address, bool enabled);
+
 private:
   CPUDebugInterface* m_interface;
+  std::set<u32> m_breakpoint_locations;
 
   CPUDebugInterface::ProgramCounterType m_start_instruction_pointer = 0;
   CPUDebugInterface::ProgramCounterType m_last_instruction_pointer = 0;
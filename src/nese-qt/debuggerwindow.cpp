@@ -2,32 +2,78 @@
 #include "debuggermodels.h"
 #include "nese/cpu_debug_interface.h"
 #include "ui_debuggerwindow.h"
+#include <QtCore/QItemSelectionModel>
 #include <QtWidgets/QFileDialog>
+#include <QtWidgets/QInputDialog>
 #include <QtWidgets/QMessageBox>
 
 namespace QtFrontend {
 
-DebuggerWindow::DebuggerWindow(CPUDebugInterface* debugger_interface, QWidget* parent /* = nullptr */)
-  : QMainWindow(parent), m_debugger_interface(debugger_interface)
+DebuggerWindow::DebuggerWindow(EmuThread* emu_thread, CPUDebugInterface* debugger_interface,
+                               QWidget* parent /* = nullptr */)
+  : QMainWindow(parent), m_emu_thread(emu_thread), m_debugger_interface(debugger_interface)
 {
   m_ui = std::make_unique<Ui::DebuggerWindow>();
   m_ui->setupUi(this);
+  createActions();
   connectSignals();
   createModels();
-  onExecutionStopped();
+
+  // The emulation thread is polled for stops, as it has no signal for them.
+  m_last_stop_count = m_emu_thread->getDebuggerStopCount();
+  m_poll_timer = new QTimer(this);
+  m_poll_timer->setInterval(50);
+  connect(m_poll_timer, &QTimer::timeout, this, &DebuggerWindow::pollExecutionState);
+  m_poll_timer->start();
+  onExecutionContinued();
 }
 
-DebuggerWindow::~DebuggerWindow() {}
+DebuggerWindow::~DebuggerWindow()
+{
+  // Don't leave the system stopped, or stopping at breakpoints nobody can see.
+  m_emu_thread->queueDebuggerCommand(EmuThread::DebuggerCommand::Type::ClearAllBreakpoints);
+  m_emu_thread->queueDebuggerCommand(EmuThread::DebuggerCommand::Type::ClearAllWatchpoints);
+  m_emu_thread->queueDebuggerCommand(EmuThread::DebuggerCommand::Type::Continue);
+}
 
 void DebuggerWindow::onExecutionContinued()
 {
+  m_stopped = false;
   setMonitorUIState(false);
 }
 
 void DebuggerWindow::onExecutionStopped()
 {
+  m_stopped = true;
   setMonitorUIState(true);
   refreshAll();
+
+  const CPUDebugInterface::WatchpointHit* hit = m_debugger_interface->GetWatchpointHit();
+  if (!hit)
+  {
+    m_ui->statusbar->clearMessage();
+    return;
+  }
+
+  const QString space = (hit->space == CPUDebugInterface::AddressSpace::PPU) ? tr("PPU") : tr("CPU");
+  if (hit->flag == Bus::WATCH_WRITE)
+  {
+    m_ui->statusbar->showMessage(tr("Watchpoint: %1 write $%2 at PC $%3, $%4 -> $%5")
+                                   .arg(space)
+                                   .arg(hit->address, 4, 16, QLatin1Char('0'))
+                                   .arg(hit->pc, 4, 16, QLatin1Char('0'))
+                                   .arg(hit->old_value, 2, 16, QLatin1Char('0'))
+                                   .arg(hit->new_value, 2, 16, QLatin1Char('0')));
+  }
+  else
+  {
+    m_ui->statusbar->showMessage(tr("Watchpoint: %1 %2 $%3 at PC $%4, $%5")
+                                   .arg(space)
+                                   .arg((hit->flag == Bus::WATCH_READ) ? tr("read") : tr("execute"))
+                                   .arg(hit->address, 4, 16, QLatin1Char('0'))
+                                   .arg(hit->pc, 4, 16, QLatin1Char('0'))
+                                   .arg(hit->new_value, 2, 16, QLatin1Char('0')));
+  }
 }
 
 void DebuggerWindow::refreshAll()
@@ -36,33 +82,35 @@ void DebuggerWindow::refreshAll()
   m_stack_model->invalidateView();
   int row = m_code_model->updateInstructionPointer();
   if (row >= 0)
+  {
     m_ui->codeView->scrollTo(m_code_model->index(row, 0));
+    m_ui->codeView->setCurrentIndex(m_code_model->index(row, 0));
+  }
 }
 
 void DebuggerWindow::onCloseActionTriggered() {}
 
 void DebuggerWindow::onRunActionTriggered(bool checked)
 {
-#if 0
-  if (m_debugger_interface->IsStepping() == !checked)
+  if (checked == !m_stopped)
     return;
 
   if (checked)
   {
-    m_debugger_interface->SetStepping(false);
-    onExecutionContinued();
+    resumeExecution(EmuThread::DebuggerCommand::Type::Continue);
   }
   else
   {
-    m_debugger_interface->SetStepping(true);
-    onExecutionStopped();
+    // Stays checked until the emulation thread has actually stopped.
+    m_ui->actionPause_Continue->setChecked(true);
+    m_emu_thread->queueDebuggerCommand(EmuThread::DebuggerCommand::Type::Break);
   }
-#endif
 }
 
 void DebuggerWindow::onSingleStepActionTriggered()
 {
-  // m_debugger_interface->SetStepping(true, 1);
+  if (m_stopped)
+    resumeExecution(EmuThread::DebuggerCommand::Type::StepInto);
 }
 
 void DebuggerWindow::connectSignals()
@@ -70,29 +118,134 @@ void DebuggerWindow::connectSignals()
   connect(m_ui->actionPause_Continue, SIGNAL(triggered(bool)), this, SLOT(onRunActionTriggered(bool)));
   connect(m_ui->actionStep_Into, SIGNAL(triggered()), this, SLOT(onSingleStepActionTriggered()));
   connect(m_ui->action_Close, SIGNAL(triggered()), this, SLOT(onCloseActionTriggered()));
+  connect(m_ui->actionStep_Over, &QAction::triggered, this, [this]() {
+    if (m_stopped)
+      resumeExecution(EmuThread::DebuggerCommand::Type::StepOver);
+  });
+  connect(m_step_out_action, &QAction::triggered, this, [this]() {
+    if (m_stopped)
+      resumeExecution(EmuThread::DebuggerCommand::Type::StepOut);
+  });
+  connect(m_run_to_cursor_action, &QAction::triggered, this, [this]() {
+    u16 address;
+    if (m_stopped && getSelectedAddress(&address))
+      resumeExecution(EmuThread::DebuggerCommand::Type::RunToAddress, address);
+  });
+  connect(m_add_watchpoint_action, &QAction::triggered, this, &DebuggerWindow::addWatchpoint);
+  connect(m_clear_watchpoints_action, &QAction::triggered, this, [this]() {
+    m_emu_thread->queueDebuggerCommand(EmuThread::DebuggerCommand::Type::ClearAllWatchpoints);
+  });
+  connect(m_ui->actionToggle_Breakpoint, &QAction::triggered, this, [this]() {
+    u16 address;
+    if (!m_stopped || !getSelectedAddress(&address))
+      return;
+
+    const bool enabled = !m_code_model->hasBreakpoint(address);
+    m_code_model->setBreakpoint(address, enabled);
+    m_emu_thread->queueDebuggerCommand(enabled ? EmuThread::DebuggerCommand::Type::SetBreakpoint :
+                                                 EmuThread::DebuggerCommand::Type::ClearBreakpoint,
+                                       address);
+  });
+}
+
+void DebuggerWindow::createActions()
+{
+  // Not in the .ui, so that ui_debuggerwindow.h needn't be regenerated.
+  m_step_out_action = new QAction(tr("Step Out"), this);
+  m_run_to_cursor_action = new QAction(tr("Run to Cursor"), this);
+  m_ui->menu_Debugger->insertAction(m_ui->actionToggle_Breakpoint, m_step_out_action);
+  m_ui->menu_Debugger->insertAction(m_ui->actionToggle_Breakpoint, m_run_to_cursor_action);
+  m_ui->menu_Debugger->insertSeparator(m_ui->actionToggle_Breakpoint);
+
+  // Watchpoints can be changed while running, as the commands are run between frames.
+  m_add_watchpoint_action = new QAction(tr("Add Watchpoint..."), this);
+  m_clear_watchpoints_action = new QAction(tr("Clear Watchpoints"), this);
+  m_ui->menu_Debugger->insertAction(m_ui->action_Close, m_add_watchpoint_action);
+  m_ui->menu_Debugger->insertAction(m_ui->action_Close, m_clear_watchpoints_action);
+  m_ui->menu_Debugger->insertSeparator(m_ui->action_Close);
+  m_ui->toolBar->insertAction(m_ui->actionToggle_Breakpoint, m_step_out_action);
+
+  m_ui->actionPause_Continue->setShortcut(Qt::Key_F5);
+  m_ui->actionStep_Into->setShortcut(Qt::Key_F11);
+  m_ui->actionStep_Over->setShortcut(Qt::Key_F10);
+  m_step_out_action->setShortcut(Qt::SHIFT + Qt::Key_F11);
+  m_run_to_cursor_action->setShortcut(Qt::CTRL + Qt::Key_F10);
+  m_ui->actionToggle_Breakpoint->setShortcut(Qt::Key_F9);
 }
 
 void DebuggerWindow::createModels()
 {
   m_code_model = std::make_unique<DebuggerCodeModel>(m_debugger_interface);
-  m_ui->codeView->setModel(m_code_model.get());
-
   m_registers_model = std::make_unique<DebuggerRegistersModel>(m_debugger_interface);
-  m_ui->registerView->setModel(m_registers_model.get());
-  // m_ui->registerView->resizeRowsToContents();
-
   m_stack_model = std::make_unique<DebuggerStackModel>(m_debugger_interface);
-  m_ui->stackView->setModel(m_stack_model.get());
 }
 
 void DebuggerWindow::setMonitorUIState(bool enabled)
 {
+  // The models read the system, so they're only attached to the views while it's stopped. Views don't delete the
+  // selection model they replace.
+  const auto set_model = [enabled](QAbstractItemView* view, QAbstractItemModel* model) {
+    QItemSelectionModel* old_selection_model = view->selectionModel();
+    view->setModel(enabled ? model : nullptr);
+    if (view->selectionModel() != old_selection_model)
+      delete old_selection_model;
+  };
+  set_model(m_ui->codeView, m_code_model.get());
+  set_model(m_ui->registerView, m_registers_model.get());
+  set_model(m_ui->stackView, m_stack_model.get());
+
   // Disable all UI elements that depend on execution state
   m_ui->actionPause_Continue->setChecked(!enabled);
+  m_ui->actionStep_Into->setEnabled(enabled);
+  m_ui->actionStep_Over->setEnabled(enabled);
+  m_step_out_action->setEnabled(enabled);
+  m_run_to_cursor_action->setEnabled(enabled);
+  m_ui->actionToggle_Breakpoint->setEnabled(enabled);
   m_ui->codeView->setDisabled(!enabled);
   m_ui->registerView->setDisabled(!enabled);
   m_ui->stackView->setDisabled(!enabled);
   // m_ui->tabMemoryView
 }
 
-} // namespace QtFrontend
\ No newline at end of file
+void DebuggerWindow::pollExecutionState()
+{
+  const u32 stop_count = m_emu_thread->getDebuggerStopCount();
+  if (stop_count == m_last_stop_count)
+    return;
+
+  m_last_stop_count = stop_count;
+  onExecutionStopped();
+}
+
+bool DebuggerWindow::getSelectedAddress(u16* address) const
+{
+  const QModelIndex index = m_ui->codeView->currentIndex();
+  return index.isValid() && m_code_model->getAddressForRow(address, index.row());
+}
+
+void DebuggerWindow::addWatchpoint()
+{
+  const QString text =
+    QInputDialog::getText(this, tr("Add Watchpoint"),
+                          tr("Watchpoint, as [ppu:]<r|w|x>:<start>[-<end>][=<value>] in hex, e.g. w:0300-03FF:"));
+  if (text.isEmpty())
+    return;
+
+  CPUDebugInterface::Watchpoint watchpoint;
+  if (!CPUDebugInterface::ParseWatchpoint(text.trimmed().toLatin1().constData(), &watchpoint))
+  {
+    QMessageBox::critical(this, tr("Add Watchpoint"), tr("Invalid watchpoint '%1'.").arg(text));
+    return;
+  }
+
+  m_emu_thread->queueAddWatchpoint(watchpoint);
+}
+
+void DebuggerWindow::resumeExecution(EmuThread::DebuggerCommand::Type type, u16 address /* = 0 */)
+{
+  // Detach the views before the emulation thread starts running.
+  onExecutionContinued();
+  m_emu_thread->queueDebuggerCommand(type, address);
+}
+
+} // namespace QtFrontend
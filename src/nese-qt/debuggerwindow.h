@@ -1,4 +1,6 @@
 #pragma once
+#include "emuthread.h"
+#include <QtCore/QTimer>
 #include <QtWidgets/QMainWindow>
 #include <memory>
 
@@ -20,7 +22,9 @@ class DebuggerWindow : public QMainWindow
   Q_OBJECT
 
 public:
-  explicit DebuggerWindow(CPUDebugInterface* debugger_interface, QWidget* parent = nullptr);
+  // Execution is controlled with commands queued to the emulation thread, and the views only read the system while
+  // it's stopped in the debugger.
+  DebuggerWindow(EmuThread* emu_thread, CPUDebugInterface* debugger_interface, QWidget* parent = nullptr);
   ~DebuggerWindow();
 
   void onExecutionContinued();
@@ -34,11 +38,27 @@ public Q_SLOTS:
 
 private:
   void connectSignals();
+  void createActions();
   void createModels();
   void setMonitorUIState(bool enabled);
+  void pollExecutionState();
+  bool getSelectedAddress(u16* address) const;
+  void addWatchpoint();
 
+  // Resumes execution with a command, which stops again later.
+  void resumeExecution(EmuThread::DebuggerCommand::Type type, u16 address = 0);
+
+  EmuThread* m_emu_thread;
   CPUDebugInterface* m_debugger_interface;
 
+  QAction* m_step_out_action = nullptr;
+  QAction* m_run_to_cursor_action = nullptr;
+  QAction* m_add_watchpoint_action = nullptr;
+  QAction* m_clear_watchpoints_action = nullptr;
+  QTimer* m_poll_timer = nullptr;
+  u32 m_last_stop_count = 0;
+  bool m_stopped = false;
+
   std::unique_ptr<Ui::DebuggerWindow> m_ui;
 
   std::unique_ptr<DebuggerCodeModel> m_code_model;
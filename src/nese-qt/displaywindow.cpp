@@ -264,6 +264,7 @@ void DisplayWindow::ResizeFramebuffer(uint32 width, uint32 height)
 void DisplayWindow::DisplayFramebuffer()
 {
   AddFrameRendered();
+  DrawOverlay();
 
   // This shouldn't be needed, but it complains if we don't do it after swapping...
   if (!m_gl_context->makeCurrent(this))
@@ -1,10 +1,11 @@
 #include "emuthread.h"
-#include "YBaseLib/ByteStream.h"
 #include "YBaseLib/Error.h"
 #include "audio.h"
 #include "displaywindow.h"
 #include "nese/cartridge.h"
 #include "nese/controller.h"
+#include "nese/cpu_debug_interface.h"
+#include "nese/rewind_buffer.h"
 #include "nese/system.h"
 #include <QtCore/QEventLoop>
 #include <QtGui/QKeyEvent>
@@ -20,28 +21,17 @@ EmuThread::~EmuThread() = default;
 
 void EmuThread::onStartEmulation(const QString cartridge_filename)
 {
-  ByteStream* stream;
-  if (!ByteStream_OpenFileStream(cartridge_filename.toStdString().c_str(),
-                                 BYTESTREAM_OPEN_READ | BYTESTREAM_OPEN_STREAMED, &stream))
-  {
-    emit emulationErrorEvent(QString::asprintf("Failed to open file '%s'", cartridge_filename.toStdString().c_str()));
-    Stop();
-    return;
-  }
-
   // Parse cartridge.
   Error error;
-  m_cartridge = Cartridge::Load(stream, &error);
+  m_cartridge = Cartridge::LoadFile(cartridge_filename.toStdString().c_str(), &error);
   if (!m_cartridge)
   {
-    stream->Release();
     emit emulationErrorEvent(error.GetErrorCodeAndDescription().GetCharArray());
     Stop();
     return;
   }
 
   // Create system.
-  stream->Release();
   m_system = std::make_unique<System>();
 
   // Attach controllers.
@@ -57,6 +47,12 @@ void EmuThread::onStartEmulation(const QString cartridge_filename)
   }
 
   m_system->Reset();
+  m_rewind_buffer = std::make_unique<RewindBuffer>(m_system.get());
+  m_debug_interface.store(m_system->GetDebugInterface());
+
+  m_frame_skip.Reset();
+  m_stats_timer.Reset();
+  m_stats_frames = 0;
 
   emit emulationStartedEvent();
 
@@ -69,6 +65,12 @@ void EmuThread::onEmulationPauseRequest(bool paused)
     return;
 
   m_paused = paused;
+  if (!paused)
+  {
+    // Don't count the time spent paused as lag.
+    m_frame_skip.Reset();
+  }
+
   emit emulationPausedEvent(paused);
 }
 
@@ -98,16 +100,49 @@ void EmuThread::run()
   {
     // Process all events.
     eventloop.processEvents(QEventLoop::AllEvents, 1000);
+    ProcessDebuggerCommands();
 
     // If we're not paused, execute.
-    while (!m_paused)
+    while (!m_paused && !m_system->GetDebugInterface()->IsStopped())
     {
-      m_system->FrameStep();
+      m_system->SetRunAheadFrames(m_run_ahead_frames.load());
+      if (m_system->IsStatsEnabled() != m_show_performance_stats.load())
+      {
+        // The overlay appears with the next stats update.
+        m_system->SetStatsEnabled(!m_system->IsStatsEnabled());
+        if (!m_system->IsStatsEnabled())
+          m_display_window->SetOverlayText(std::string());
+      }
+
+      m_system->SetVideoEnabled(m_frame_skip.BeginFrame());
+      if (m_rewinding.load())
+      {
+        m_rewind_buffer->Rewind();
+        m_system->FrameStep();
+      }
+      else
+      {
+        m_system->FrameStep();
+        if (!m_system->GetDebugInterface()->IsStopped())
+          m_rewind_buffer->FrameCompleted();
+      }
+
+      if (m_system->GetDebugInterface()->IsStopped())
+      {
+        // Hit a breakpoint or finished a step part-way through the frame, which continues when resumed.
+        m_debugger_stop_count++;
+        break;
+      }
+
+      UpdateStats();
       eventloop.processEvents(QEventLoop::AllEvents);
+      ProcessDebuggerCommands();
     }
   }
 
   // Destroy all resources we created here.
+  m_debug_interface.store(nullptr);
+  m_rewind_buffer.reset();
   m_system.reset();
   m_cartridge.reset();
   m_controller_1.reset();
@@ -122,6 +157,121 @@ void EmuThread::run()
   exit();
 }
 
+EmuThread::Stats EmuThread::getStats() const
+{
+  std::lock_guard<std::mutex> guard(m_stats_mutex);
+  return m_stats;
+}
+
+void EmuThread::UpdateStats()
+{
+  m_stats_frames++;
+
+  const double elapsed = m_stats_timer.GetTimeSeconds();
+  if (elapsed < 1.0)
+    return;
+
+  std::lock_guard<std::mutex> guard(m_stats_mutex);
+  m_stats.speed = float(double(m_stats_frames) / elapsed / FrameSkipController::NTSC_FRAME_RATE);
+  m_stats.fps = m_display_window->GetFramesPerSecond();
+  m_stats.skip_rate = m_frame_skip.GetStats().skip_rate;
+  if (m_system->IsStatsEnabled())
+    m_display_window->SetOverlayText(PerfCounters::FormatStats(m_system->GetStats()));
+
+  m_stats_timer.Reset();
+  m_stats_frames = 0;
+}
+
+void EmuThread::queueDebuggerCommand(DebuggerCommand::Type type, u16 address /* = 0 */)
+{
+  std::lock_guard<std::mutex> guard(m_debugger_command_mutex);
+  m_debugger_commands.push_back(DebuggerCommand{type, address, {}});
+}
+
+void EmuThread::queueAddWatchpoint(const CPUDebugInterface::Watchpoint& watchpoint)
+{
+  std::lock_guard<std::mutex> guard(m_debugger_command_mutex);
+  m_debugger_commands.push_back(DebuggerCommand{DebuggerCommand::Type::AddWatchpoint, 0, watchpoint});
+}
+
+void EmuThread::ProcessDebuggerCommands()
+{
+  {
+    std::lock_guard<std::mutex> guard(m_debugger_command_mutex);
+    m_debugger_commands_to_run.swap(m_debugger_commands);
+  }
+
+  CPUDebugInterface* debug_interface = m_system ? m_system->GetDebugInterface() : nullptr;
+  if (!debug_interface)
+  {
+    m_debugger_commands_to_run.clear();
+    return;
+  }
+
+  const bool was_stopped = debug_interface->IsStopped();
+  for (const DebuggerCommand& command : m_debugger_commands_to_run)
+  {
+    switch (command.type)
+    {
+      case DebuggerCommand::Type::Break:
+      {
+        if (!debug_interface->IsStopped())
+        {
+          debug_interface->Break();
+          m_debugger_stop_count++;
+        }
+      }
+      break;
+
+      case DebuggerCommand::Type::Continue:
+        debug_interface->Continue();
+        break;
+
+      case DebuggerCommand::Type::StepInto:
+        debug_interface->StepInto();
+        break;
+
+      case DebuggerCommand::Type::StepOver:
+        debug_interface->StepOver();
+        break;
+
+      case DebuggerCommand::Type::StepOut:
+        debug_interface->StepOut();
+        break;
+
+      case DebuggerCommand::Type::RunToAddress:
+        debug_interface->RunToAddress(command.address);
+        break;
+
+      case DebuggerCommand::Type::SetBreakpoint:
+        debug_interface->SetBreakpoint(command.address, true);
+        break;
+
+      case DebuggerCommand::Type::ClearBreakpoint:
+        debug_interface->SetBreakpoint(command.address, false);
+        break;
+
+      case DebuggerCommand::Type::ClearAllBreakpoints:
+        debug_interface->ClearBreakpoints();
+        break;
+
+      case DebuggerCommand::Type::AddWatchpoint:
+        debug_interface->AddWatchpoint(command.watchpoint);
+        break;
+
+      case DebuggerCommand::Type::ClearAllWatchpoints:
+        debug_interface->ClearWatchpoints();
+        break;
+    }
+  }
+
+  m_debugger_commands_to_run.clear();
+
+  // Don't count the time spent stopped as lag.
+  if (was_stopped && !debug_interface->IsStopped())
+    m_frame_skip.Reset();
+}
+
 void EmuThread::Stop()
 {
   m_paused = true;
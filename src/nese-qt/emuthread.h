@@ -1,11 +1,18 @@
 #pragma once
+#include "YBaseLib/Timer.h"
+#include "nese/cpu_debug_interface.h"
+#include "nese/frame_skip_controller.h"
 #include "nese/types.h"
 #include <QtCore/QThread>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 class QKeyEvent;
 
 class Cartridge;
+class RewindBuffer;
 class StandardController;
 class System;
 
@@ -22,6 +29,61 @@ public:
   EmuThread(DisplayWindow* display_widget, Audio* audio, QThread* owner_thread);
   ~EmuThread();
 
+  // Can be called from any thread. While set, the emulator steps backwards through the rewind buffer.
+  void setRewinding(bool rewinding) { m_rewinding.store(rewinding); }
+
+  // Can be called from any thread. Applied at the start of the next frame.
+  void setRunAheadFrames(u32 frames) { m_run_ahead_frames.store(frames); }
+
+  // Can be called from any thread. Collects performance counters and draws them over the picture.
+  void setShowPerformanceStats(bool show) { m_show_performance_stats.store(show); }
+
+  // Averages over the last second, updated while running.
+  struct Stats
+  {
+    float speed;     // Emulated frames per real-time frame.
+    float fps;       // Frames presented per second.
+    float skip_rate; // Fraction of frames skipped.
+  };
+
+  // Can be called from any thread.
+  Stats getStats() const;
+
+  // Commands for the debugger, which run on the emulation thread between frames, or while stopped in the debugger.
+  struct DebuggerCommand
+  {
+    enum class Type
+    {
+      Break,
+      Continue,
+      StepInto,
+      StepOver,
+      StepOut,
+      RunToAddress,
+      SetBreakpoint,
+      ClearBreakpoint,
+      ClearAllBreakpoints,
+      AddWatchpoint,
+      ClearAllWatchpoints
+    };
+
+    Type type;
+    u16 address;
+    CPUDebugInterface::Watchpoint watchpoint;
+  };
+
+  // Can be called from any thread.
+  void queueDebuggerCommand(DebuggerCommand::Type type, u16 address = 0);
+  void queueAddWatchpoint(const CPUDebugInterface::Watchpoint& watchpoint);
+
+  // Can be called from any thread. Valid from the emulation started event until the stopped event. Its state may only
+  // be read while stopped in the debugger, and only changed with commands.
+  CPUDebugInterface* getDebugInterface() const { return m_debug_interface.load(); }
+
+  // Can be called from any thread. Incremented each time execution stops in the debugger, after which the debug
+  // interface can be read until a command resumes execution.
+  u32 getDebuggerStopCount() const { return m_debugger_stop_count.load(); }
+
 Q_SIGNALS:
   void emulationErrorEvent(QString error_text);
   void emulationStartedEvent();
@@ -44,6 +106,8 @@ protected:
 
 private:
   void Stop();
+  void UpdateStats();
+  void ProcessDebuggerCommands();
 
   DisplayWindow* m_display_window;
   Audio* m_audio;
@@ -52,9 +116,26 @@ private:
   std::unique_ptr<StandardController> m_controller_1;
   std::unique_ptr<Cartridge> m_cartridge;
   std::unique_ptr<System> m_system;
+  std::unique_ptr<RewindBuffer> m_rewind_buffer;
 
   bool m_paused = true;
   bool m_stopped = false;
+  std::atomic_bool m_rewinding{false};
+  std::atomic<u32> m_run_ahead_frames{0};
+  std::atomic_bool m_show_performance_stats{false};
+
+  FrameSkipController m_frame_skip;
+  Timer m_stats_timer;
+  u32 m_stats_frames = 0;
+
+  mutable std::mutex m_stats_mutex;
+  Stats m_stats = {};
+
+  std::atomic<CPUDebugInterface*> m_debug_interface{nullptr};
+  std::atomic<u32> m_debugger_stop_count{0};
+  std::mutex m_debugger_command_mutex;
+  std::vector<DebuggerCommand> m_debugger_commands;
+  std::vector<DebuggerCommand> m_debugger_commands_to_run;
 };
 
 } // namespace QtFrontend
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "emuthread.h"
 #include "nese/controller.h"
 #include <QtGui/QKeyEvent>
+#include <QtWidgets/QActionGroup>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QFileDialog>
 #include <QtWidgets/QMessageBox>
@@ -32,9 +33,13 @@ MainWindow::MainWindow(QWidget* parent /*= nullptr*/) : QMainWindow(parent)
   m_ui->statusbar->addWidget(m_status_speed, 0);
   m_status_fps = new QLabel(this);
   m_ui->statusbar->addWidget(m_status_fps, 0);
+  m_status_timer = new QTimer(this);
+  m_status_timer->setInterval(1000);
 
   m_audio = std::make_unique<Audio>();
 
+  createRunAheadMenu();
+  createPerformanceStatsAction();
   connectSignals();
   adjustSize();
 }
@@ -73,13 +78,20 @@ void MainWindow::onResetActionTriggered() {}
 
 void MainWindow::onEnableDebuggerActionToggled(bool selected)
 {
-  // TODO: Ensure the system is paused.
   if (selected)
   {
     if (m_debugger_window)
       return;
 
-    m_debugger_window = new DebuggerWindow(nullptr, this);
+    // Needs a running system.
+    CPUDebugInterface* debug_interface = m_emu_thread ? m_emu_thread->getDebugInterface() : nullptr;
+    if (!debug_interface)
+    {
+      m_ui->actionEnableDebugger->setChecked(false);
+      return;
+    }
+
+    m_debugger_window = new DebuggerWindow(m_emu_thread, debug_interface, this);
     m_debugger_window->show();
   }
   else
@@ -141,6 +153,10 @@ void MainWindow::onDisplayWindowKeyPressed(QKeyEvent* event)
       emit queueSetControllerButtonState(0, StandardController::Button_A, true);
       break;
 
+    case Qt::Key_Backspace:
+      m_emu_thread->setRewinding(true);
+      break;
+
     default:
       break;
   }
@@ -190,6 +206,14 @@ void MainWindow::onDisplayWindowKeyReleased(QKeyEvent* event)
       emit queueSetControllerButtonState(0, StandardController::Button_A, false);
       break;
 
+    case Qt::Key_Backspace:
+    {
+      // Ignore the release events generated by key auto-repeat.
+      if (!event->isAutoRepeat())
+        m_emu_thread->setRewinding(false);
+    }
+    break;
+
     default:
       break;
   }
@@ -200,7 +224,10 @@ void MainWindow::onEmulationError(QString error_text)
   QMessageBox::critical(this, tr("Emulation Error"), error_text);
 }
 
-void MainWindow::onEmulationStarted() {}
+void MainWindow::onEmulationStarted()
+{
+  m_status_timer->start();
+}
 
 void MainWindow::onEmulationPaused(bool paused) {}
 
@@ -208,7 +235,20 @@ void MainWindow::onEmulationStopped()
 {
   // Move the GL context back to the main thread.
   m_display_window->makeOpenGLContextCurrent();
+
+  // The debugger queues its last commands to the thread as it closes.
+  if (m_debugger_window)
+  {
+    delete m_debugger_window;
+    m_debugger_window = nullptr;
+    m_ui->actionEnableDebugger->setChecked(false);
+  }
+
   m_emu_thread = nullptr;
+
+  m_status_timer->stop();
+  m_status_speed->clear();
+  m_status_fps->clear();
 }
 
 void MainWindow::connectSignals()
@@ -220,11 +260,64 @@ void MainWindow::connectSignals()
 
   connect(m_display_window, SIGNAL(keyPressed(QKeyEvent*)), this, SLOT(onDisplayWindowKeyPressed(QKeyEvent*)));
   connect(m_display_window, SIGNAL(keyReleased(QKeyEvent*)), this, SLOT(onDisplayWindowKeyReleased(QKeyEvent*)));
+  connect(m_status_timer, &QTimer::timeout, this, &MainWindow::updateStatusBar);
+}
+
+void MainWindow::createRunAheadMenu()
+{
+  // Not in the .ui, as the entries are generated.
+  QMenu* menu = m_ui->menu_System->addMenu(tr("&Run-Ahead"));
+  QActionGroup* group = new QActionGroup(menu);
+  for (u32 frames = 0; frames <= MAX_RUN_AHEAD_FRAMES; frames++)
+  {
+    QAction* action = menu->addAction((frames == 0) ? tr("Disabled") : tr("%n Frame(s)", nullptr, int(frames)));
+    action->setCheckable(true);
+    action->setChecked(frames == m_run_ahead_frames);
+    group->addAction(action);
+    connect(action, &QAction::triggered, this, [this, frames]() {
+      m_run_ahead_frames = frames;
+      if (m_emu_thread)
+        m_emu_thread->setRunAheadFrames(frames);
+    });
+  }
+}
+
+void MainWindow::createPerformanceStatsAction()
+{
+  // Not in the .ui, so that ui_mainwindow.h needn't be regenerated.
+  QAction* action = m_ui->menu_View->addAction(tr("Show &Performance Stats"));
+  action->setCheckable(true);
+  action->setShortcut(Qt::Key_F3);
+  connect(action, &QAction::toggled, this, [this](bool checked) {
+    m_show_performance_stats = checked;
+    if (m_emu_thread)
+      m_emu_thread->setShowPerformanceStats(checked);
+  });
+}
+
+void MainWindow::updateStatusBar()
+{
+  if (!m_emu_thread)
+    return;
+
+  const EmuThread::Stats stats = m_emu_thread->getStats();
+  m_status_speed->setText(tr("%1% speed").arg(int(stats.speed * 100.0f + 0.5f)));
+  if (stats.skip_rate > 0.0f)
+  {
+    m_status_fps->setText(
+      tr("%1 fps (%2% skipped)").arg(double(stats.fps), 0, 'f', 1).arg(int(stats.skip_rate * 100.0f + 0.5f)));
+  }
+  else
+  {
+    m_status_fps->setText(tr("%1 fps").arg(double(stats.fps), 0, 'f', 1));
+  }
 }
 
 void MainWindow::createEmuThread()
 {
   m_emu_thread = new EmuThread(m_display_window, m_audio.get(), QThread::currentThread());
+  m_emu_thread->setRunAheadFrames(m_run_ahead_frames);
+  m_emu_thread->setShowPerformanceStats(m_show_performance_stats);
   m_display_window->moveOpenGLContextToThread(m_emu_thread);
   m_emu_thread->moveToThread(m_emu_thread);
   m_emu_thread->start();
@@ -3,6 +3,7 @@
 #include "common/types.h"
 #include "ui_mainwindow.h"
 #include <QtCore/QThread>
+#include <QtCore/QTimer>
 #include <QtWidgets/QLabel>
 #include <QtWidgets/QMainWindow>
 #include <memory>
@@ -49,8 +50,13 @@ Q_SIGNALS:
   void queueFrameStep();
 
 private:
+  static const u32 MAX_RUN_AHEAD_FRAMES = 4;
+
   void connectSignals();
   void createEmuThread();
+  void createRunAheadMenu();
+  void createPerformanceStatsAction();
+  void updateStatusBar();
 
   std::unique_ptr<Ui::MainWindow> m_ui;
 
@@ -59,10 +65,13 @@ private:
   QLabel* m_status_message = nullptr;
   QLabel* m_status_speed = nullptr;
   QLabel* m_status_fps = nullptr;
+  QTimer* m_status_timer = nullptr;
 
   std::unique_ptr<Audio> m_audio;
 
   EmuThread* m_emu_thread = nullptr;
+  u32 m_run_ahead_frames = 0;
+  bool m_show_performance_stats = false;
 
   DebuggerWindow* m_debugger_window = nullptr;
 };
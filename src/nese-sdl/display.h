@@ -25,6 +25,9 @@ public:
   bool IsFullscreen() const;
   void SetFullscreen(bool enable);
 
+  // Presentation waits for vertical blank by default, which paces emulation to the display's refresh rate.
+  virtual void SetVSync(bool enabled) = 0;
+
 protected:
   virtual u32 GetAdditionalWindowCreateFlags() { return 0; }
   virtual bool Initialize();
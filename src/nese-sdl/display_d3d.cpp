@@ -210,6 +210,7 @@ void DisplayD3D::DisplayFramebuffer()
   // Unmap framebuffer before displaying.
   if (m_framebuffer_texture_mapped)
   {
+    DrawOverlay();
     m_context->Unmap(m_framebuffer_texture.Get(), 0);
     m_framebuffer_texture_mapped = false;
   }
@@ -241,8 +242,7 @@ void DisplayD3D::DisplayFramebuffer()
 
   m_context->Draw(3, 0);
 
-  // m_swap_chain->Present(0, 0);
-  m_swap_chain->Present(1, 0);
+  m_swap_chain->Present(m_vsync ? 1 : 0, 0);
 
   // Re-map framebuffer texture.
   for (;;)
@@ -264,6 +264,11 @@ void DisplayD3D::DisplayFramebuffer()
   AddFrameRendered();
 }
 
+void DisplayD3D::SetVSync(bool enabled)
+{
+  m_vsync = enabled;
+}
+
 void DisplayD3D::OnWindowResized()
 {
   Display::OnWindowResized();
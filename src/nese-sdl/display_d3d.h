@@ -18,6 +18,7 @@ public:
 
   void ResizeFramebuffer(u32 width, u32 height) override;
   void DisplayFramebuffer() override;
+  void SetVSync(bool enabled) override;
 
 protected:
   bool Initialize() override;
@@ -40,6 +41,7 @@ private:
   Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_framebuffer_texture_srv = nullptr;
 
   bool m_framebuffer_texture_mapped = false;
+  bool m_vsync = true;
 };
 } // namespace SDLFrontend
 
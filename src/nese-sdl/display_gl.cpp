@@ -39,12 +39,15 @@ bool DisplayGL::Initialize()
 
   SDL_GL_MakeCurrent(m_window, m_gl_context);
 
-  // SDL_GL_SetSwapInterval(0);
-
   ResizeFramebuffer(m_framebuffer_width, m_framebuffer_height);
   return true;
 }
 
+void DisplayGL::SetVSync(bool enabled)
+{
+  SDL_GL_SetSwapInterval(enabled ? 1 : 0);
+}
+
 u32 DisplayGL::GetAdditionalWindowCreateFlags()
 {
   return SDL_WINDOW_OPENGL;
@@ -77,6 +80,8 @@ void DisplayGL::ResizeFramebuffer(uint32 width, uint32 height)
 
 void DisplayGL::DisplayFramebuffer()
 {
+  DrawOverlay();
+
   s32 viewport_x, viewport_y;
   u32 viewport_width, viewport_height;
   CalculateDrawRectangle(&viewport_x, &viewport_y, &viewport_width, &viewport_height);
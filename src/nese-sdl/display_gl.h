@@ -14,6 +14,7 @@ public:
 
   void ResizeFramebuffer(uint32 width, uint32 height) override;
   void DisplayFramebuffer() override;
+  void SetVSync(bool enabled) override;
 
 protected:
   virtual u32 GetAdditionalWindowCreateFlags() override;
@@ -1,16 +1,24 @@
 #define SDL_MAIN_HANDLED 1
-#include "YBaseLib/ByteStream.h"
 #include "YBaseLib/Error.h"
 #include "YBaseLib/Log.h"
+#include "YBaseLib/Timer.h"
 #include "audio.h"
 #include "nese-sdl/display_d3d.h"
 #include "nese-sdl/display_gl.h"
+#include "nese/apu.h"
 #include "nese/cartridge.h"
 #include "nese/controller.h"
+#include "nese/event_timeline.h"
+#include "nese/frame_skip_controller.h"
+#include "nese/nsf_player.h"
+#include "nese/rewind_buffer.h"
 #include "nese/system.h"
 #include <SDL/SDL.h>
+#include <algorithm>
+#include <cctype>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <map>
 Log_SetChannel(Main);
 
@@ -18,17 +26,8 @@ bool g_running = true;
 
 static std::unique_ptr<Cartridge> LoadCartridge(const char* filename)
 {
-  ByteStream* stream;
-  if (!ByteStream_OpenFileStream(filename, BYTESTREAM_OPEN_READ | BYTESTREAM_OPEN_STREAMED, &stream))
-  {
-    Log_ErrorPrintf("Failed to open file '%s'.", filename);
-    return nullptr;
-  }
-
   Error load_error;
-  std::unique_ptr<Cartridge> cart = Cartridge::Load(stream, &load_error);
-  stream->Release();
-
+  std::unique_ptr<Cartridge> cart = Cartridge::LoadFile(filename, &load_error);
   if (!cart)
   {
     Log_ErrorPrintf("Cartridge load error: %s", load_error.GetErrorDescription().GetCharArray());
@@ -134,19 +133,161 @@ static void HandleControllerButtonEvent(const SDL_Event* ev, StandardController*
   }
 }
 
+static bool ConfigureLowLatencyAudio(System* system, SDLFrontend::Audio* audio, u32 target_latency_samples)
+{
+  // Paced on audio, writes block when the ring is full. Latency is then the two device periods in the ring plus the
+  // one being played.
+  u32 period = 32;
+  while ((period * 2 * 3) <= target_latency_samples)
+    period *= 2;
+
+  if (!audio->Reconfigure(APU::GetAudioQualitySampleRate(system->GetAudioQuality()), 1, period, 2))
+    return false;
+
+  // Mix at least twice per period, so the ring never waits on a whole quantum.
+  audio->PauseOutput(false);
+  system->GetAPU()->SetMixQuantum(
+    static_cast<CycleCount>((u64(period / 2) * APU::CPU_CLOCK_RATE) / audio->GetOutputSampleRate()));
+  Log_InfoPrintf("Low-latency audio: %u sample periods, %d cycle mix quantum", period,
+                 system->GetAPU()->GetMixQuantum());
+  return true;
+}
+
+static bool IsNSFFilename(const char* filename)
+{
+  const size_t length = std::strlen(filename);
+  if (length < 4)
+    return false;
+
+  const char* extension = filename + length - 4;
+  return (extension[0] == '.' && std::tolower(extension[1]) == 'n' && std::tolower(extension[2]) == 's' &&
+          std::tolower(extension[3]) == 'f');
+}
+
+// Plays a song from an NSF without a window, paced by the audio device, or renders it to a WAV file as fast as it
+// can be emulated. Songs are numbered from one, zero selects the file's default.
+static int PlayNSF(const char* filename, u32 song, u32 seconds, const char* wav_filename, APU::AudioQuality quality)
+{
+  Error error;
+  NSFPlayer::NSFData data;
+  if (!NSFPlayer::LoadDataFromFile(filename, &data, &error))
+  {
+    Log_ErrorPrintf("NSF load error: %s", error.GetErrorDescription().GetCharArray());
+    return EXIT_FAILURE;
+  }
+
+  std::unique_ptr<::Audio> audio;
+  if (wav_filename)
+  {
+    audio = FileAudio::Create(wav_filename);
+  }
+  else
+  {
+    if (SDL_Init(SDL_INIT_AUDIO) < 0)
+    {
+      Panic("SDL initialization failed");
+      return EXIT_FAILURE;
+    }
+
+    // Nothing else paces the player.
+    audio = std::make_unique<SDLFrontend::Audio>();
+    audio->SetBlockingWrites(true);
+  }
+
+  NSFPlayer player;
+  player.SetAudioQuality(quality);
+  if (!player.Initialize(data, audio.get(), &error))
+  {
+    Log_ErrorPrintf("NSF player error: %s", error.GetErrorDescription().GetCharArray());
+    return EXIT_FAILURE;
+  }
+
+  if (song > 0)
+    player.StartSong(song - 1);
+
+  Log_InfoPrintf("%s - %s (%s), song %u of %u", data.title.c_str(), data.artist.c_str(), data.copyright.c_str(),
+                 player.GetCurrentSong() + 1, player.GetSongCount());
+
+  Timer timer;
+  for (u32 i = 0; i < seconds; i++)
+    player.Execute(APU::CPU_CLOCK_RATE);
+
+  if (wav_filename)
+  {
+    const double elapsed = timer.GetTimeSeconds();
+    Log_InfoPrintf("Rendered %u seconds to %s in %.3f seconds (%.0fx real time)", seconds, wav_filename, elapsed,
+                   double(seconds) / std::max(elapsed, 0.001));
+  }
+
+  audio->Shutdown();
+  return EXIT_SUCCESS;
+}
+
 int main(int argc, char* argv[])
 {
   // set log flags
   g_pLog->SetConsoleOutputParams(true);
   // g_pLog->SetDebugOutputParams(true);
 
-  if (argc < 2)
+  const char* filename = nullptr;
+  u32 run_ahead_frames = 0;
+  bool sync_to_audio = false;
+  u32 audio_latency = 0;
+  bool pipeline_audio = false;
+  APU::AudioQuality audio_quality = APU::AudioQuality::Standard;
+  u32 max_skipped_frames = FrameSkipController::DEFAULT_MAX_SKIPPED_FRAMES;
+  bool show_stats = false;
+  u32 nsf_song = 0;
+  u32 nsf_seconds = 120;
+  const char* wav_filename = nullptr;
+  for (int i = 1; i < argc; i++)
   {
-    std::fprintf(stderr, "usage: %s <path to .nes>\n", argv[0]);
+    if (std::strcmp(argv[i], "-runahead") == 0 && (i + 1) < argc)
+      run_ahead_frames = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "-sync") == 0 && (i + 1) < argc)
+      sync_to_audio = (std::strcmp(argv[++i], "audio") == 0);
+    else if (std::strcmp(argv[i], "-latency") == 0 && (i + 1) < argc)
+      audio_latency = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "-frameskip") == 0 && (i + 1) < argc)
+      max_skipped_frames = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "-pipeline-audio") == 0)
+      pipeline_audio = true;
+    else if (std::strcmp(argv[i], "-stats") == 0)
+      show_stats = true;
+    else if (std::strcmp(argv[i], "-audio-quality") == 0 && (i + 1) < argc)
+    {
+      const char* name = argv[++i];
+      for (u32 j = 0; j < u32(APU::AudioQuality::Count); j++)
+      {
+        if (std::strcmp(name, APU::GetAudioQualityName(static_cast<APU::AudioQuality>(j))) == 0)
+          audio_quality = static_cast<APU::AudioQuality>(j);
+      }
+    }
+    else if (std::strcmp(argv[i], "-song") == 0 && (i + 1) < argc)
+      nsf_song = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "-length") == 0 && (i + 1) < argc)
+      nsf_seconds = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "-wav") == 0 && (i + 1) < argc)
+      wav_filename = argv[++i];
+    else
+      filename = argv[i];
+  }
+
+  if (!filename)
+  {
+    std::fprintf(stderr,
+                 "usage: %s [-runahead <frames>] [-sync video|audio] [-latency <samples>] [-pipeline-audio] "
+                 "[-frameskip <max frames>] [-stats] [-audio-quality fast|standard|high] <path to .nes>\n"
+                 "       %s [-song <n>] [-length <seconds>] [-wav <output.wav>] [-audio-quality fast|standard|high] "
+                 "<path to .nsf>\n",
+                 argv[0], argv[0]);
     return EXIT_FAILURE;
   }
 
-  std::unique_ptr<Cartridge> cart = LoadCartridge(argv[1]);
+  if (IsNSFFilename(filename))
+    return PlayNSF(filename, nsf_song, nsf_seconds, wav_filename, audio_quality);
+
+  std::unique_ptr<Cartridge> cart = LoadCartridge(filename);
   if (!cart)
     return EXIT_FAILURE;
 
@@ -180,16 +321,93 @@ int main(int argc, char* argv[])
   std::unique_ptr<StandardController> controller = std::make_unique<StandardController>();
 
   std::unique_ptr<System> system = std::make_unique<System>();
+  system->SetAudioQuality(audio_quality);
   system->Initialize(display.get(), audio.get(), cart.get());
   system->SetController(0, controller.get());
+  system->SetRunAheadFrames(run_ahead_frames);
   system->Reset();
 
+  // When pacing on vsync, the audio is resampled slightly to follow the display. When pacing on audio, vsync is
+  // disabled and the emulator waits for the device to consume samples instead. A latency target implies the latter,
+  // as the ring is smaller than a frame of audio.
+  if (audio_latency > 0)
+  {
+    sync_to_audio = true;
+    if (!ConfigureLowLatencyAudio(system.get(), audio.get(), audio_latency))
+      return EXIT_FAILURE;
+  }
+  display->SetVSync(!sync_to_audio);
+  audio->SetBlockingWrites(sync_to_audio);
+  system->GetAPU()->SetDynamicRateControl(!sync_to_audio);
+  system->GetAPU()->SetPipelined(pipeline_audio);
+  u32 frame_number = 0;
+
+  // When the host can't keep up, frames are emulated without being rendered. Real time is the display's refresh
+  // rate when it paces emulation.
+  FrameSkipController frame_skip;
+  frame_skip.SetMaxSkippedFrames(max_skipped_frames);
+  SDL_DisplayMode display_mode;
+  if (!sync_to_audio && SDL_GetWindowDisplayMode(display->GetSDLWindow(), &display_mode) == 0 &&
+      display_mode.refresh_rate > 0)
+  {
+    frame_skip.SetFramePeriod(1.0 / double(display_mode.refresh_rate));
+  }
+
+  // Speed and frame skipping are shown in the window title, once a second. F3 toggles the performance counters,
+  // shown over the picture. F4 starts recording the event timeline, and pressing it again writes it out.
+  Timer stats_timer;
+  u32 stats_frame_number = 0;
+  system->SetStatsEnabled(show_stats);
+
+  // Rewind is always on, holding backspace steps backwards.
+  std::unique_ptr<RewindBuffer> rewind_buffer = std::make_unique<RewindBuffer>(system.get());
+  bool rewinding = false;
+
   display->SetDisplayScale(2);
   display->ResizeDisplay();
 
   while (g_running)
   {
-    system->FrameStep();
+    system->SetVideoEnabled(frame_skip.BeginFrame());
+    if (rewinding)
+    {
+      rewind_buffer->Rewind();
+      system->FrameStep();
+    }
+    else
+    {
+      system->FrameStep();
+      rewind_buffer->FrameCompleted();
+    }
+
+    if (stats_timer.GetTimeSeconds() >= 1.0)
+    {
+      const FrameSkipController::Stats& fs = frame_skip.GetStats();
+      const double speed = double(frame_number + 1 - stats_frame_number) / stats_timer.GetTimeSeconds() /
+                           FrameSkipController::NTSC_FRAME_RATE;
+      char title[128];
+      std::snprintf(title, sizeof(title),
+                    "nese - %.0f%% speed, %.1f fps, %.0f%% skipped (%.1f ms rendered, %.1f ms skipped)", speed * 100.0,
+                    display->GetFramesPerSecond(), fs.skip_rate * 100.0f, fs.rendered_frame_ms, fs.skipped_frame_ms);
+      SDL_SetWindowTitle(display->GetSDLWindow(), title);
+      if (system->IsStatsEnabled())
+        display->SetOverlayText(PerfCounters::FormatStats(system->GetStats()));
+
+      stats_timer.Reset();
+      stats_frame_number = frame_number + 1;
+    }
+
+    if ((++frame_number % 600) == 0)
+    {
+      const APU::OutputStats stats = system->GetAPU()->GetOutputStats();
+      const APU::RateControlStats& rc = stats.rate_control;
+      Log_DevPrintf("Audio: latency %.1f ms, drift %+.0f ppm, correction %+.0f..%+.0f ppm, fill %.0f%%, %llu underrun, "
+                    "%llu overrun",
+                    stats.latency_ms, (rc.average_ratio - 1.0) * 1e6, (rc.min_ratio - 1.0) * 1e6,
+                    (rc.max_ratio - 1.0) * 1e6, rc.fill_level * 100.0f,
+                    static_cast<unsigned long long>(stats.underrun_samples),
+                    static_cast<unsigned long long>(stats.overrun_samples));
+    }
 
     // SDL event loop...
     for (;;)
@@ -208,7 +426,36 @@ int main(int argc, char* argv[])
         {
           HandleKeyEvent(&ev, controller.get());
           if (ev.type == SDL_KEYUP && ev.key.keysym.sym == SDLK_PAUSE)
+          {
             system->Reset();
+            rewind_buffer->Clear();
+          }
+          else if (ev.key.keysym.sym == SDLK_BACKSPACE)
+          {
+            rewinding = (ev.type == SDL_KEYDOWN);
+          }
+          else if (ev.type == SDL_KEYUP && ev.key.keysym.sym == SDLK_F3)
+          {
+            // The overlay appears with the next update of the title.
+            system->SetStatsEnabled(!system->IsStatsEnabled());
+            if (!system->IsStatsEnabled())
+              display->SetOverlayText(std::string());
+          }
+          else if (ev.type == SDL_KEYUP && ev.key.keysym.sym == SDLK_F4)
+          {
+            if (const EventTimeline* timeline = system->GetEventTimeline())
+            {
+              static const char trace_filename[] = "nese_trace.json";
+              if (timeline->WriteChromeTrace(trace_filename))
+                Log_InfoPrintf("Wrote %u events to %s", timeline->GetEventCount(), trace_filename);
+              system->SetEventTimelineEnabled(false);
+            }
+            else
+            {
+              Log_InfoPrintf("Recording event timeline");
+              system->SetEventTimelineEnabled(true);
+            }
+          }
         }
         break;
 
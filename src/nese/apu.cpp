@@ -1,15 +1,24 @@
 #include "apu.h"
-#include "YBaseLib/Timer.h"
+#include "YBaseLib/Assert.h"
+#include "YBaseLib/Log.h"
 #include "bus.h"
 #include "common/audio.h"
-#include "nes_apu/Blip_Buffer.h"
+#include "common/state_wrapper.h"
+#include "event_timeline.h"
+#include "nes_apu/Multi_Buffer.h"
 #include "nes_apu/Nes_Apu.h"
+#include "nes_apu/Nonlinear_Buffer.h"
 #include "nes_apu/apu_snapshot.h"
+#include "perf_counters.h"
+Log_SetChannel(APU);
 
-APU::APU() : m_apu(std::make_unique<Nes_Apu>()), m_buffer(std::make_unique<Blip_Buffer>()) {}
+APU::APU() : m_apu(std::make_unique<Nes_Apu>()) {}
 
 APU::~APU()
 {
+  if (m_synth_thread_active)
+    StopSynthThread();
+
   if (m_audio)
     m_audio->PauseOutput(true);
 }
@@ -19,25 +28,271 @@ void APU::Initialize(Bus* bus, Audio* audio)
   m_bus = bus;
   m_audio = audio;
 
-  m_buffer->clock_rate(1789773);
-  m_buffer->sample_rate(m_audio->GetOutputSampleRate());
-  m_apu->output(m_buffer.get());
+  m_audio_quality = m_audio_quality_requested;
+  CreateBuffers();
+  SetOutputs(m_apu.get(), m_buffer.get(), m_timing_only || !m_audio);
   m_apu->dmc_reader(DMCReadCallback, this);
   m_apu->irq_notifier(IRQNotifierCallback, this);
 
-  m_audio->PauseOutput(false);
+  if (m_audio)
+    m_audio->PauseOutput(false);
 
-  // m_mix_interval = (1789773 + (m_audio->GetBufferSize() - 1)) / m_audio->GetBufferSize();
-  m_mix_interval = (1789773 + (60 - 1)) / 60;
-  std::fprintf(stderr, "Audio output every %d cycles\n", m_mix_interval);
+  Log_DevPrintf("Audio output every %d cycles", m_mix_interval);
+}
+
+void APU::SetMixQuantum(CycleCount cycles)
+{
+  FlushSamples();
+  if (m_synth_thread_active)
+    SyncSynthThread();
+
+  m_mix_interval = std::max(cycles, CycleCount(MIN_MIX_QUANTUM));
+  Log_DevPrintf("Audio output every %d cycles", m_mix_interval);
+}
+
+APU::OutputStats APU::GetOutputStats() const
+{
+  OutputStats stats = {};
+  stats.rate_control = GetRateControlStats();
+  if (m_audio && m_audio->GetOutputSampleRate() > 0)
+  {
+    const float sample_rate = float(m_audio->GetOutputSampleRate());
+    const float quantum_samples = float(m_mix_interval) * sample_rate / float(CPU_CLOCK_RATE);
+    stats.latency_samples = u32(quantum_samples * 0.5f) + m_audio->GetLatencySamples();
+    stats.latency_ms = float(stats.latency_samples) * 1000.0f / sample_rate;
+    stats.underrun_samples = m_audio->GetUnderrunSampleCount();
+    stats.overrun_samples = m_audio->GetOverrunSampleCount();
+  }
+
+  return stats;
+}
+
+void APU::SetDynamicRateControl(bool enabled, float max_adjustment /* = DEFAULT_MAX_RATE_ADJUSTMENT */)
+{
+  if (m_synth_thread_active)
+    SyncSynthThread();
+
+  m_rate_control_enabled = enabled;
+  m_max_rate_adjustment = max_adjustment;
+  if (!enabled && m_buffer)
+    m_buffer->clock_rate(CPU_CLOCK_RATE);
+  if (!enabled && m_synth_buffer)
+    m_synth_buffer->clock_rate(CPU_CLOCK_RATE);
+
+  ResetRateControlStats();
+}
+
+APU::RateControlStats APU::GetRateControlStats() const
+{
+  std::lock_guard<std::mutex> guard(m_rate_control_stats_lock);
+  return m_rate_control_stats;
+}
+
+void APU::ResetRateControlStats()
+{
+  std::lock_guard<std::mutex> guard(m_rate_control_stats_lock);
+  m_rate_control_stats = {};
+  m_rate_control_stats.current_ratio = 1.0;
+  m_rate_control_stats.average_ratio = 1.0;
+  m_rate_control_stats.min_ratio = 1.0;
+  m_rate_control_stats.max_ratio = 1.0;
+  m_rate_control_stats.fill_level = 0.5f;
+  m_rate_control_ratio_sum = 0.0;
 }
 
 void APU::Reset()
 {
+  // The worker writes to the output too, so it has to be idle before the output is emptied, and the output is paused
+  // meanwhile so the device's thread isn't reading it.
+  const bool synth_thread_active = (m_synth_thread_active && !m_speculating);
+  if (synth_thread_active)
+    SyncSynthThread();
+  if (m_audio)
+  {
+    const bool paused = m_audio->IsOutputPaused();
+    m_audio->PauseOutput(true);
+    m_audio->EmptyBuffers();
+    m_audio->PauseOutput(paused);
+  }
+
   m_time_since_last_mix = 0;
+  m_apu_frame_start = 0;
   m_cycles_until_irq = -1;
   m_apu->reset(false, 0);
   UpdateIRQDelay();
+
+  if (synth_thread_active)
+  {
+    m_synth_apu->reset(false, 0);
+    m_synth_dmc_bytes.clear();
+    m_synth_dmc_read_position = 0;
+  }
+}
+
+bool APU::DoState(StateWrapper& sw)
+{
+  sw.DoMarker("APU");
+
+  // Nes_Apu only runs when something needs it to, and its snapshot is taken wherever it has got to, so saving has no
+  // side effects. Loading starts a time frame at the snapshot's point in the mix, so later mixes don't move either.
+  apu_snapshot_t snapshot = {};
+  CycleCount time_since_last_mix = m_time_since_last_mix;
+  CycleCount snapshot_time = 0;
+  if (sw.IsWriting())
+  {
+    m_apu->save_snapshot(&snapshot);
+    snapshot_time = m_apu_frame_start + CycleCount(m_apu->last_run_time());
+  }
+
+  sw.DoPOD(&snapshot);
+  sw.Do(&time_since_last_mix);
+  sw.Do(&snapshot_time);
+  if (sw.HasError())
+    return false;
+
+  if (sw.IsReading())
+  {
+    m_time_since_last_mix = time_since_last_mix;
+    m_apu_frame_start = snapshot_time;
+    LoadSnapshot(m_apu.get(), snapshot);
+    UpdateIRQDelay();
+
+    // The snapshot comes from the timing-only copy when pipelined, so the tone channels' phases are approximate. They
+    // can't be observed by the CPU, and the worker only needs them to be continuous.
+    if (IsForwardingToSynthThread())
+    {
+      SyncSynthThread();
+      m_synth_apu->load_snapshot(snapshot);
+      m_synth_dmc_bytes.clear();
+      m_synth_dmc_read_position = 0;
+    }
+  }
+
+  return true;
+}
+
+void APU::UpdateOutputMode()
+{
+  // Only switched between time frames, so every copy handed over starts at the same point. The speculative copy is
+  // always timing-only, and the real APU is switched once it's back.
+  const bool pipelined = (m_pipelined_requested && m_audio);
+  if (m_speculating || (m_timing_only == m_timing_only_requested && m_synth_thread_active == pipelined &&
+                        m_audio_quality == m_audio_quality_requested))
+  {
+    return;
+  }
+
+  // The worker has to hand the buffers back before they can be replaced.
+  if (m_synth_thread_active && (!pipelined || m_audio_quality != m_audio_quality_requested))
+    StopSynthThread();
+
+  if (m_audio_quality != m_audio_quality_requested)
+  {
+    m_audio_quality = m_audio_quality_requested;
+    CreateBuffers();
+  }
+
+  m_timing_only = m_timing_only_requested;
+  if (pipelined && !m_synth_thread_active)
+    StartSynthThread();
+  else if (m_synth_thread_active)
+    PushSynthCommand({0, 0, u8(m_timing_only), SynthCommand::SetOutputMode});
+
+  // When pipelined, the copy here only has to provide timing, as does one with no output.
+  SetOutputs(m_apu.get(), m_buffer.get(), m_timing_only || m_synth_thread_active || !m_audio);
+}
+
+std::unique_ptr<Multi_Buffer> APU::CreateBuffer() const
+{
+  std::unique_ptr<Multi_Buffer> buffer;
+  if (m_audio_quality == AudioQuality::High)
+  {
+    buffer = std::make_unique<Nonlinear_Buffer>();
+  }
+  else
+  {
+    // The fast tier skips band-limiting, so each channel transition is a single add rather than a filter kernel.
+    std::unique_ptr<Mono_Buffer> mono_buffer = std::make_unique<Mono_Buffer>();
+    mono_buffer->center()->point_sampled(m_audio_quality == AudioQuality::Fast);
+    buffer = std::move(mono_buffer);
+  }
+
+  buffer->clock_rate(CPU_CLOCK_RATE);
+  buffer->sample_rate(GetSampleRate(), BUFFER_LENGTH_MS);
+  return buffer;
+}
+
+void APU::CreateBuffers()
+{
+  m_buffer = CreateBuffer();
+  if (m_audio_quality == AudioQuality::High)
+    static_cast<Nonlinear_Buffer*>(m_buffer.get())->enable_nonlinearity(*m_apu, true);
+  else
+    m_apu->volume(1.0);
+
+  // The other buffers only ever have their output discarded, so are just recreated to match when next needed.
+  m_speculative_buffer.reset();
+  m_synth_buffer.reset();
+}
+
+void APU::DiscardSamples(Multi_Buffer* buffer)
+{
+  // Read rather than removed, as the nonlinear buffer has to process every sample.
+  Audio::SampleType samples[512];
+  while (buffer->samples_avail() > 0)
+    buffer->read_samples(samples, countof(samples));
+}
+
+void APU::SetOutputs(Nes_Apu* apu, Multi_Buffer* buffer, bool timing_only)
+{
+  // Nes_Apu doesn't run muted channels at all. That's fine for the tone channels, whose phase isn't visible to the
+  // CPU, but the DMC has to keep running for its DMA reads and IRQ. Its output is a few transitions per sample at
+  // most, and is thrown away.
+  static const int DMC_OSC_INDEX = 4;
+  for (int i = 0; i < Nes_Apu::osc_count; i++)
+    apu->osc_output(i, (timing_only && i != DMC_OSC_INDEX) ? nullptr : buffer->channel(i).center);
+}
+
+void APU::BeginSpeculation()
+{
+  DebugAssert(!m_speculating);
+
+  if (!m_speculative_apu)
+    m_speculative_apu = std::make_unique<Nes_Apu>();
+  if (!m_speculative_buffer)
+  {
+    m_speculative_buffer = CreateBuffer();
+    SetOutputs(m_speculative_apu.get(), m_speculative_buffer.get(), true);
+  }
+
+  // As with saving state, the real APU is left exactly where it is, and the copy starts a time frame from there.
+  // The IRQ line is already correct for this state, so don't let the copy update it while loading.
+  apu_snapshot_t snapshot = {};
+  m_apu->save_snapshot(&snapshot);
+  m_speculative_apu->irq_notifier(nullptr);
+  LoadSnapshot(m_speculative_apu.get(), snapshot);
+  m_speculative_apu->irq_notifier(IRQNotifierCallback, this);
+  m_speculative_buffer->clear();
+
+  m_real_apu_frame_start = m_apu_frame_start;
+  m_apu_frame_start += CycleCount(m_apu->last_run_time());
+  m_apu.swap(m_speculative_apu);
+  m_buffer.swap(m_speculative_buffer);
+  m_speculating = true;
+}
+
+void APU::EndSpeculation()
+{
+  DebugAssert(m_speculating);
+
+  // The copy is dropped without running it any further, which would fetch DMC bytes over the restored state. The real
+  // APU is resumed from its state at BeginSpeculation(), so this is only correct if the system state was also restored
+  // to that point.
+  m_apu.swap(m_speculative_apu);
+  m_buffer.swap(m_speculative_buffer);
+  m_apu_frame_start = m_real_apu_frame_start;
+  m_speculating = false;
+  UpdateIRQDelay();
 }
 
 u8 APU::ReadRegister(u8 address)
@@ -45,7 +300,7 @@ u8 APU::ReadRegister(u8 address)
   if (address == 0x15) // SND_CHN
   {
     // m_bus->SetCPUIRQLine(false);
-    return m_apu->read_status(m_time_since_last_mix + m_bus->GetPendingCycles());
+    return m_apu->read_status(GetAPUTime());
   }
   else
   {
@@ -58,89 +313,362 @@ void APU::WriteRegister(u8 address, u8 value)
   // if (address == 0x15)
   // m_bus->SetCPUIRQLine(false);
 
-  m_apu->write_register(m_time_since_last_mix + m_bus->GetPendingCycles(), 0x4000 | cpu_addr_t(address),
-                        int(unsigned(value)));
+  const CycleCount time = GetAPUTime();
+  m_apu->write_register(time, 0x4000 | cpu_addr_t(address), int(unsigned(value)));
+  if (IsForwardingToSynthThread())
+    PushSynthCommand({s32(time), u16(0x4000 | address), value, SynthCommand::WriteRegister});
 }
 
 CycleCount APU::GetMaxExecutionDelay() const
 {
-  return (m_mix_interval - m_time_since_last_mix);
+  const CycleCount cycles_until_mix = m_mix_interval - m_time_since_last_mix;
+  CycleCount delay = (m_cycles_until_irq > 0) ? std::min(cycles_until_mix, m_cycles_until_irq) : cycles_until_mix;
+
+  // Stop once the CPU passes the next DMC fetch, so Execute() can make it there.
+  const cpu_time_t dmc_read_time = m_apu->next_dmc_read();
+  if (dmc_read_time != Nes_Apu::no_irq)
+    delay = std::min(delay, std::max(CycleCount(dmc_read_time) + 1 - GetAPUTime(), CycleCount(1)));
+
+  return delay;
 }
 
 void APU::Execute(CycleCount cycles)
 {
+  // Nes_Apu otherwise only runs at the next register access or mix, and its DMC fetches stall the CPU when it does. So
+  // a fetch the CPU has passed is made now, at the first instruction boundary after it, wherever the mixes fall.
+  const CycleCount apu_time = m_time_since_last_mix + cycles - m_apu_frame_start;
+  if (m_apu->next_dmc_read() < apu_time)
+    m_apu->run_until(apu_time);
+
   m_time_since_last_mix += cycles;
 
-  if (m_time_since_last_mix >= m_mix_interval)
+  if (m_cycles_until_irq >= 0)
   {
-    m_apu->end_frame(m_time_since_last_mix);
-    m_buffer->end_frame(m_time_since_last_mix);
-    m_time_since_last_mix = 0;
-
-    while (m_buffer->samples_avail() > 0)
+    m_cycles_until_irq -= cycles;
+    if (m_cycles_until_irq <= 0)
     {
-      Audio::SampleType* samples;
-      u32 free_sample_count;
-      m_audio->BeginWrite(&samples, &free_sample_count);
-
-      u32 max_samples = std::min(u32(m_buffer->samples_avail()), free_sample_count);
+      m_bus->SetCPUIRQLine(true, Bus::IRQSource::APU);
+      m_cycles_until_irq = -1;
+    }
+  }
 
-      u32 num_samples_read = m_buffer->read_samples(samples, max_samples);
-      m_audio->EndWrite(max_samples);
+  if (m_time_since_last_mix >= m_mix_interval)
+    FlushSamples();
+}
 
-#if 0
-      static Timer t;
-      static u32 s;
-      s += num_samples_read;
-      if (t.GetTimeSeconds() > 1.0f)
-      {
-        std::fprintf(stderr, "%u samples in %f seconds (%f fps)\n", s, t.GetTimeSeconds(), s / t.GetTimeSeconds());
-        t.Reset();
-        s = 0;
-      }
-#endif
-    }
+void APU::FlushSamples()
+{
+  if (m_time_since_last_mix == 0)
+  {
+    UpdateOutputMode();
+    return;
   }
 
-  if (m_cycles_until_irq >= 0)
+  const CycleCount frame_length = m_time_since_last_mix - m_apu_frame_start;
+  m_apu->end_frame(frame_length);
+  m_buffer->end_frame(frame_length);
+  m_time_since_last_mix = 0;
+  m_apu_frame_start = 0;
+
+  if (m_speculating || m_timing_only || m_synth_thread_active || !m_audio)
   {
-    if (cycles >= m_cycles_until_irq)
+    DiscardSamples(m_buffer.get());
+    if (IsForwardingToSynthThread())
     {
-      // m_bus->SetCPUIRQLine(true);
-      // m_cycles_until_irq = -1;
+      m_synth_frames_queued.fetch_add(1);
+      PushSynthCommand({s32(frame_length), 0, 0, SynthCommand::EndFrame});
+
+      // Don't get further ahead of the output than a couple of mixes, so blocking writes still pace emulation.
+      PerfCounters::Scope scope(m_perf_counters, PerfCounters::Section::AudioOutput);
+      WaitForSynthThread([this]() { return (m_synth_frames_queued.load() <= MAX_SYNTH_FRAMES_QUEUED); });
     }
-    else
+
+    UpdateOutputMode();
+    return;
+  }
+
+  PerfCounters::Scope scope(m_perf_counters, PerfCounters::Section::AudioOutput);
+  OutputSamples(m_buffer.get(), frame_length);
+  UpdateOutputMode();
+}
+
+void APU::OutputSamples(Multi_Buffer* buffer, CycleCount frame_length)
+{
+  while (buffer->samples_avail() > 0)
+  {
+    Audio::SampleType* samples;
+    u32 free_sample_count;
+    m_audio->BeginWrite(&samples, &free_sample_count);
+    if (free_sample_count == 0)
     {
-      // m_cycles_until_irq -= cycles;
+      // Output is behind, drop the rest of this frame rather than waiting for it.
+      m_audio->DropSamples(u32(buffer->samples_avail()));
+      DiscardSamples(buffer);
+      break;
     }
+
+    u32 max_samples = std::min(u32(buffer->samples_avail()), free_sample_count);
+
+    buffer->read_samples(samples, max_samples);
+    m_audio->EndWrite(max_samples);
   }
+
+  if (m_rate_control_enabled)
+    UpdateRateControl(buffer, frame_length);
+}
+
+void APU::UpdateRateControl(Multi_Buffer* buffer, CycleCount frame_length)
+{
+  if (m_audio->GetRingSize() == 0)
+    return;
+
+  // The device reads in large blocks, so the instantaneous fill level jumps around. Average it over about a second,
+  // regardless of how often samples are mixed.
+  static constexpr float FILL_SMOOTHING_PER_FRAME = 0.02f;
+  const float smoothing =
+    std::min(FILL_SMOOTHING_PER_FRAME * float(frame_length) / float(DEFAULT_MIX_QUANTUM), 1.0f);
+  const float fill_level = float(m_audio->GetBufferedSamples()) / float(m_audio->GetRingSize());
+  std::lock_guard<std::mutex> guard(m_rate_control_stats_lock);
+  RateControlStats& stats = m_rate_control_stats;
+  stats.fill_level += (fill_level - stats.fill_level) * smoothing;
+
+  // Produce more samples when below half full, fewer when above. Lowering the clock rate Blip_Buffer thinks the
+  // APU runs at produces more samples per emulated cycle.
+  const double ratio = 1.0 + double(m_max_rate_adjustment) * (1.0 - 2.0 * double(stats.fill_level));
+  buffer->clock_rate(static_cast<long>(double(CPU_CLOCK_RATE) / ratio + 0.5));
+
+  stats.current_ratio = ratio;
+  stats.update_count++;
+  m_rate_control_ratio_sum += ratio;
+  stats.average_ratio = m_rate_control_ratio_sum / double(stats.update_count);
+  stats.min_ratio = (stats.update_count == 1) ? ratio : std::min(stats.min_ratio, ratio);
+  stats.max_ratio = (stats.update_count == 1) ? ratio : std::max(stats.max_ratio, ratio);
+}
+
+const char* APU::GetAudioQualityName(AudioQuality quality)
+{
+  static const char* names[] = {"fast", "standard", "high"};
+  static_assert(countof(names) == size_t(AudioQuality::Count), "all qualities have names");
+  return names[size_t(quality)];
+}
+
+u32 APU::GetAudioQualitySampleRate(AudioQuality quality)
+{
+  return (quality == AudioQuality::High) ? 48000 : u32(Audio::DefaultOutputSampleRate);
+}
+
+CycleCount APU::GetAPUTime() const
+{
+  return m_time_since_last_mix + m_bus->GetPendingCycles() - m_apu_frame_start;
+}
+
+void APU::LoadSnapshot(Nes_Apu* apu, const apu_snapshot_t& snapshot)
+{
+  // Loading restarts the DMC, which fetches a byte that the snapshot then overwrites, so keep that off the bus.
+  apu->dmc_reader(NullDMCReadCallback, nullptr);
+  apu->load_snapshot(snapshot);
+  apu->dmc_reader(DMCReadCallback, this);
+}
+
+u32 APU::GetSampleRate() const
+{
+  return m_audio ? m_audio->GetOutputSampleRate() : u32(Audio::DefaultOutputSampleRate);
 }
 
 void APU::UpdateIRQDelay()
 {
-  cpu_time_t earliest_irq = m_apu->earliest_irq();
+  // Nes_Apu only sets its IRQ flags when it is next run, which may not be until the next mix. It does predict when
+  // they will be set though, so the line is raised from Execute() on that cycle. The prediction is left in the past
+  // once the IRQ fires, until the game acknowledges it.
+  const cpu_time_t earliest_irq = m_apu->earliest_irq();
+  const CycleCount current_time = GetAPUTime();
   if (earliest_irq == Nes_Apu::no_irq)
   {
-    m_bus->SetCPUIRQLine(false);
+    m_bus->SetCPUIRQLine(false, Bus::IRQSource::APU);
     m_cycles_until_irq = -1;
   }
-  else if (earliest_irq == Nes_Apu::irq_waiting)
+  else if (earliest_irq <= current_time)
   {
-    m_bus->SetCPUIRQLine(true);
+    m_bus->SetCPUIRQLine(true, Bus::IRQSource::APU);
     m_cycles_until_irq = -1;
   }
   else
   {
-    m_bus->SetCPUIRQLine(false);
-    m_cycles_until_irq = earliest_irq - m_time_since_last_mix;
+    m_bus->SetCPUIRQLine(false, Bus::IRQSource::APU);
+    m_cycles_until_irq = CycleCount(earliest_irq) - (m_time_since_last_mix - m_apu_frame_start);
+  }
+}
+
+void APU::StartSynthThread()
+{
+  if (!m_synth_apu)
+    m_synth_apu = std::make_unique<Nes_Apu>();
+  if (!m_synth_buffer)
+    m_synth_buffer = CreateBuffer();
+  if (!m_synth_queue)
+    m_synth_queue = std::make_unique<SPSCQueue<SynthCommand>>(SYNTH_QUEUE_SIZE);
+
+  // Hand the audible APU and buffer over to the worker, so the output continues seamlessly, and carry on here with a
+  // copy which only provides timing. Called between time frames, so both start in the same place.
+  apu_snapshot_t snapshot = {};
+  m_apu->save_snapshot(&snapshot);
+  m_synth_apu->irq_notifier(nullptr);
+  LoadSnapshot(m_synth_apu.get(), snapshot);
+  m_synth_apu->irq_notifier(IRQNotifierCallback, this);
+  m_apu.swap(m_synth_apu);
+  m_buffer.swap(m_synth_buffer);
+  m_synth_apu->dmc_reader(SynthDMCReadCallback, this);
+  m_synth_apu->irq_notifier(nullptr);
+  m_synth_dmc_bytes.clear();
+  m_synth_dmc_read_position = 0;
+
+  m_synth_timing_only = m_timing_only;
+  SetOutputs(m_synth_apu.get(), m_synth_buffer.get(), m_synth_timing_only);
+
+  m_synth_queue->Clear();
+  m_synth_frames_queued.store(0);
+  m_synth_thread_stop.store(false);
+  m_synth_thread = std::thread(&APU::SynthThreadEntry, this);
+  m_synth_thread_active = true;
+  Log_DevPrintf("Started audio synthesis thread");
+}
+
+void APU::StopSynthThread()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_synth_wake_lock);
+    m_synth_thread_stop.store(true);
+    m_synth_wake.notify_one();
+  }
+
+  // The worker drains the queue before exiting.
+  m_synth_thread.join();
+  m_synth_thread_active = false;
+
+  // Take the audible APU back. It never sees $4015 reads, so the frame IRQ flag is the only state that can differ.
+  apu_snapshot_t snapshot = {};
+  m_apu->save_snapshot(&snapshot);
+  m_apu.swap(m_synth_apu);
+  m_buffer.swap(m_synth_buffer);
+  m_apu->dmc_reader(DMCReadCallback, this);
+  if (!snapshot.irq_flag)
+    m_apu->read_status(0);
+  m_apu->irq_notifier(IRQNotifierCallback, this);
+  Log_DevPrintf("Stopped audio synthesis thread");
+}
+
+template<typename Predicate>
+void APU::WaitForSynthThread(Predicate predicate)
+{
+  std::unique_lock<std::mutex> lock(m_synth_wake_lock);
+  m_synth_wake.notify_one();
+  m_synth_progress.wait(lock, predicate);
+}
+
+void APU::PushSynthCommand(const SynthCommand& command)
+{
+  // Only fills up if the output blocks, in which case the worker is the one holding things up. There's room once it
+  // has run out of commands, if not before.
+  if (!m_synth_queue->TryPush(command))
+    WaitForSynthThread([this, &command]() { return m_synth_queue->TryPush(command); });
+}
+
+void APU::SyncSynthThread()
+{
+  WaitForSynthThread([this]() { return m_synth_queue->IsEmpty(); });
+}
+
+void APU::SynthThreadEntry()
+{
+  for (;;)
+  {
+    const SynthCommand* command = m_synth_queue->Peek();
+    if (command)
+    {
+      const bool end_frame = (command->type == SynthCommand::EndFrame);
+      ExecuteSynthCommand(*command);
+      m_synth_queue->Pop();
+      if (end_frame)
+      {
+        std::unique_lock<std::mutex> lock(m_synth_wake_lock);
+        m_synth_progress.notify_one();
+      }
+
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(m_synth_wake_lock);
+    m_synth_progress.notify_one();
+    if (m_synth_thread_stop.load())
+      break;
+
+    m_synth_wake.wait(lock, [this]() { return (!m_synth_queue->IsEmpty() || m_synth_thread_stop.load()); });
+  }
+}
+
+void APU::ExecuteSynthCommand(const SynthCommand& command)
+{
+  switch (command.type)
+  {
+    case SynthCommand::WriteRegister:
+      m_synth_apu->write_register(cpu_time_t(command.time), cpu_addr_t(command.address), int(unsigned(command.value)));
+      break;
+
+    case SynthCommand::DMCByte:
+      m_synth_dmc_bytes.push_back(command.value);
+      break;
+
+    case SynthCommand::SetOutputMode:
+      m_synth_timing_only = (command.value != 0);
+      SetOutputs(m_synth_apu.get(), m_synth_buffer.get(), m_synth_timing_only);
+      break;
+
+    case SynthCommand::EndFrame:
+    {
+      m_synth_apu->end_frame(cpu_time_t(command.time));
+      m_synth_buffer->end_frame(cpu_time_t(command.time));
+      m_synth_dmc_bytes.clear();
+      m_synth_dmc_read_position = 0;
+
+      if (m_synth_timing_only)
+        DiscardSamples(m_synth_buffer.get());
+      else
+        OutputSamples(m_synth_buffer.get(), CycleCount(command.time));
+
+      m_synth_frames_queued.fetch_sub(1);
+    }
+    break;
   }
 }
 
 int APU::DMCReadCallback(void* userdata, unsigned address)
 {
   APU* const apu = reinterpret_cast<APU*>(userdata);
-  apu->m_bus->StallCPU(1);
-  return int(unsigned(apu->m_bus->ReadCPUAddress(address)));
+  const u32 stall_cycles = apu->m_bus->StallCPU(1);
+  if (EventTimeline* timeline = apu->m_bus->GetEventTimeline())
+    timeline->Record(EventTimeline::Type::DMCStall, static_cast<u16>(address), 0, stall_cycles);
+
+  const u8 value = apu->m_bus->ReadCPUAddress(address);
+  if (apu->IsForwardingToSynthThread())
+    apu->PushSynthCommand({0, 0, value, SynthCommand::DMCByte});
+
+  return int(unsigned(value));
+}
+
+int APU::NullDMCReadCallback(void* userdata, unsigned address)
+{
+  return 0;
+}
+
+int APU::SynthDMCReadCallback(void* userdata, unsigned address)
+{
+  // The worker's DMC fetches at exactly the same points as the emulated one, and the bytes are queued before anything
+  // that makes it run up to them. The only other fetch is the one made while loading a snapshot, which is discarded.
+  APU* const apu = reinterpret_cast<APU*>(userdata);
+  if (apu->m_synth_dmc_read_position == apu->m_synth_dmc_bytes.size())
+    return 0;
+
+  return int(unsigned(apu->m_synth_dmc_bytes[apu->m_synth_dmc_read_position++]));
 }
 
 void APU::IRQNotifierCallback(void* userdata)
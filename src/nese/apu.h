@@ -1,41 +1,226 @@
 #pragma once
+#include "common/spsc_queue.h"
 #include "types.h"
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 class Audio;
 class Bus;
+class Multi_Buffer;
 class Nes_Apu;
-class Blip_Buffer;
+class PerfCounters;
+class StateWrapper;
+struct apu_snapshot_t;
 
 class APU
 {
 public:
+  // Samples are pushed to the audio output every frame, so the buffer only needs to hold a few frames.
+  static const int BUFFER_LENGTH_MS = 100;
+
+  static const u32 CPU_CLOCK_RATE = 1789773;
+  static constexpr float DEFAULT_MAX_RATE_ADJUSTMENT = 0.005f;
+
   APU();
   ~APU();
 
+  // Audio may be null, in which case nothing is synthesized, as in timing-only mode.
   void Initialize(Bus* bus, Audio* audio);
+
+  // Also empties the audio output, once the synthesis worker is idle.
   void Reset();
+  bool DoState(StateWrapper& sw);
 
   u8 ReadRegister(u8 address);
   void WriteRegister(u8 address, u8 value);
 
+  // Timing-only mode skips synthesis of the square, triangle and noise channels, and sends nothing to the audio
+  // output. Length counters, the frame sequencer, DMC DMA and IRQs still run exactly as normal, so everything the CPU
+  // can observe is unchanged, and the mode can be switched at any point without affecting determinism. The switch
+  // takes effect at the next mix.
+  bool IsTimingOnly() const { return m_timing_only_requested; }
+  void SetTimingOnly(bool enabled) { m_timing_only_requested = enabled; }
+
+  // Pipelined synthesis moves waveform synthesis and audio output to a worker thread. The emulation thread keeps a
+  // timing-only copy of the sound hardware for everything the CPU sees, and passes timestamped register writes and
+  // DMC sample bytes to the worker through a lock-free queue. The worker replays them into its own copy, so the
+  // output is identical to synthesizing inline. Like timing-only mode, the switch takes effect at the next mix.
+  bool IsPipelined() const { return m_pipelined_requested; }
+  void SetPipelined(bool enabled) { m_pipelined_requested = enabled; }
+
+  // Synthesis quality. Fast point-samples the channels without band-limiting, which aliases but costs far less, for
+  // fast-forward and batch capture. Standard is full band-limited synthesis. High adds the nonlinear mixing of the
+  // real hardware's DACs, and is intended for a 48 kHz output. None of them affect emulation, and like timing-only
+  // mode, the switch takes effect at the next mix.
+  enum class AudioQuality : u8
+  {
+    Fast,
+    Standard,
+    High,
+    Count
+  };
+  static const char* GetAudioQualityName(AudioQuality quality);
+  static u32 GetAudioQualitySampleRate(AudioQuality quality);
+  AudioQuality GetAudioQuality() const { return m_audio_quality_requested; }
+  void SetAudioQuality(AudioQuality quality) { m_audio_quality_requested = quality; }
+
+  // Speculative execution (e.g. run-ahead) runs on a copy of the sound hardware which discards its output.
+  // The audible state is left untouched, and resumes without glitches when speculation ends, regardless of any
+  // state loaded in between. The emulated behaviour visible to the CPU is identical.
+  void BeginSpeculation();
+  void EndSpeculation();
+
+  // Dynamic rate control. Resamples the output by up to max_adjustment (a fraction, e.g. 0.005 for 0.5%) to keep the
+  // audio ring half full, so a frontend paced on video neither drops nor runs out of samples when the host's audio
+  // clock drifts from the emulated one. The adjustment is inaudible, and does not affect emulation.
+  struct RateControlStats
+  {
+    double current_ratio;  // Output samples per nominal sample, currently applied.
+    double average_ratio;  // Mean ratio since the stats were reset, i.e. the measured clock drift.
+    double min_ratio;
+    double max_ratio;
+    float fill_level;      // Smoothed fill level of the ring, 0-1.
+    u32 update_count;
+  };
+  void SetDynamicRateControl(bool enabled, float max_adjustment = DEFAULT_MAX_RATE_ADJUSTMENT);
+  bool IsDynamicRateControlEnabled() const { return m_rate_control_enabled; }
+  RateControlStats GetRateControlStats() const;
+  void ResetRateControlStats();
+
+  // Samples are generated and pushed to the audio output every mix quantum of emulated time. The default is one
+  // frame; a smaller quantum, down to about 1ms, lowers latency at the cost of more frequent CPU time slices. DMC
+  // fetches stall the CPU at the first instruction boundary after they fall due, not at the next mix, so the quantum
+  // doesn't affect emulation, and can be changed between frame steps.
+  static const CycleCount DEFAULT_MIX_QUANTUM = (CPU_CLOCK_RATE + (60 - 1)) / 60;
+  static const CycleCount MIN_MIX_QUANTUM = CPU_CLOCK_RATE / 1000;
+  CycleCount GetMixQuantum() const { return m_mix_interval; }
+  void SetMixQuantum(CycleCount cycles);
+
+  struct OutputStats
+  {
+    RateControlStats rate_control;
+    float latency_ms;       // End-to-end: half a mix quantum on average, plus the measured output latency.
+    u32 latency_samples;
+    u64 underrun_samples;
+    u64 overrun_samples;
+  };
+  OutputStats GetOutputStats() const;
+
+  // Cycles until the next mix, APU/DMC IRQ or DMC fetch, whichever comes first, so each lands on the right cycle.
   CycleCount GetMaxExecutionDelay() const;
 
   void Execute(CycleCount cycles);
 
+  // Times output to the audio device when set, on the emulation thread only. See System::SetStatsEnabled().
+  void SetPerfCounters(PerfCounters* counters) { m_perf_counters = counters; }
+
 private:
+  struct SynthCommand
+  {
+    enum : u8
+    {
+      WriteRegister,
+      DMCByte,
+      SetOutputMode,
+      EndFrame
+    };
+
+    s32 time;
+    u16 address;
+    u8 value;
+    u8 type;
+  };
+
+  // Ends the current Nes_Apu time frame, and pushes the generated samples to the audio output.
+  void FlushSamples();
+  void OutputSamples(Multi_Buffer* buffer, CycleCount frame_length);
+  static void DiscardSamples(Multi_Buffer* buffer);
+  u32 GetSampleRate() const;
+
+  // Time in Nes_Apu's current time frame which the CPU has reached.
+  CycleCount GetAPUTime() const;
+  void LoadSnapshot(Nes_Apu* apu, const apu_snapshot_t& snapshot);
+  void UpdateOutputMode();
+  std::unique_ptr<Multi_Buffer> CreateBuffer() const;
+  void CreateBuffers();
+  static void SetOutputs(Nes_Apu* apu, Multi_Buffer* buffer, bool timing_only);
+  void UpdateRateControl(Multi_Buffer* buffer, CycleCount frame_length);
   void UpdateIRQDelay();
 
+  bool IsForwardingToSynthThread() const { return (m_synth_thread_active && !m_speculating); }
+  void StartSynthThread();
+  void StopSynthThread();
+  void PushSynthCommand(const SynthCommand& command);
+
+  // Wakes the worker, and sleeps until the predicate holds. The worker signals when it finishes a mix, and when it runs
+  // out of commands.
+  template<typename Predicate>
+  void WaitForSynthThread(Predicate predicate);
+
+  // Waits for the worker to finish everything queued. It then doesn't touch its state until the next push.
+  void SyncSynthThread();
+  void SynthThreadEntry();
+  void ExecuteSynthCommand(const SynthCommand& command);
+
   static int DMCReadCallback(void* userdata, unsigned address);
+  static int NullDMCReadCallback(void* userdata, unsigned address);
+  static int SynthDMCReadCallback(void* userdata, unsigned address);
   static void IRQNotifierCallback(void* userdata);
 
   Bus* m_bus = nullptr;
   Audio* m_audio = nullptr;
 
   std::unique_ptr<Nes_Apu> m_apu;
-  std::unique_ptr<Blip_Buffer> m_buffer;
+  std::unique_ptr<Multi_Buffer> m_buffer;
+
+  // Swapped with m_apu/m_buffer while speculating.
+  std::unique_ptr<Nes_Apu> m_speculative_apu;
+  std::unique_ptr<Multi_Buffer> m_speculative_buffer;
+  bool m_speculating = false;
+  bool m_timing_only = false;
+  bool m_timing_only_requested = false;
+  AudioQuality m_audio_quality = AudioQuality::Standard;
+  AudioQuality m_audio_quality_requested = AudioQuality::Standard;
+
+  // Pipelined synthesis. While the worker is running it owns everything prefixed m_synth_ below the queue, and
+  // m_synth_apu/m_synth_buffer are the audible copy, swapped with m_apu/m_buffer when it starts and stops. Allocated
+  // when the worker first starts, so systems which never pipeline don't pay for them.
+  static const u32 SYNTH_QUEUE_SIZE = 8192;
+  static const u32 MAX_SYNTH_FRAMES_QUEUED = 2;
+  std::unique_ptr<SPSCQueue<SynthCommand>> m_synth_queue;
+  std::atomic<u32> m_synth_frames_queued{0};
+  std::unique_ptr<Nes_Apu> m_synth_apu;
+  std::unique_ptr<Multi_Buffer> m_synth_buffer;
+  std::vector<u8> m_synth_dmc_bytes;
+  size_t m_synth_dmc_read_position = 0;
+  bool m_synth_timing_only = false;
+  std::thread m_synth_thread;
+  std::mutex m_synth_wake_lock;
+  std::condition_variable m_synth_wake;
+  std::condition_variable m_synth_progress;
+  std::atomic_bool m_synth_thread_stop{false};
+  bool m_synth_thread_active = false;
+  bool m_pipelined_requested = false;
 
   CycleCount m_time_since_last_mix = 0;
-  CycleCount m_mix_interval = 1;
+
+  // Cycles into the mix at which Nes_Apu's time frame started. Only nonzero after loading a state or starting
+  // speculation part-way through a mix, until the next mix. The real APU's is kept aside while speculating.
+  CycleCount m_apu_frame_start = 0;
+  CycleCount m_real_apu_frame_start = 0;
+  CycleCount m_mix_interval = DEFAULT_MIX_QUANTUM;
   CycleCount m_cycles_until_irq = -1;
+
+  PerfCounters* m_perf_counters = nullptr;
+
+  // Updated by whichever thread outputs samples.
+  mutable std::mutex m_rate_control_stats_lock;
+  RateControlStats m_rate_control_stats = {};
+  double m_rate_control_ratio_sum = 0.0;
+  float m_max_rate_adjustment = DEFAULT_MAX_RATE_ADJUSTMENT;
+  bool m_rate_control_enabled = false;
 };
@@ -1,8 +1,12 @@
 #include "bus.h"
 #include "apu.h"
 #include "cartridge.h"
+#include "common/state_wrapper.h"
 #include "controller.h"
 #include "cpu.h"
+#include "cpu_debug_interface.h"
+#include "event_timeline.h"
+#include "perf_counters.h"
 #include "ppu.h"
 #include <cstring>
 
@@ -24,6 +28,17 @@ void Bus::Reset()
   std::memset(m_vram, 0x00, sizeof(m_vram));
   m_cpu->SetNMILine(false);
   m_cpu->SetIRQLine(false);
+  m_irq_sources = 0;
+}
+
+bool Bus::DoState(StateWrapper& sw)
+{
+  sw.DoMarker("BUS");
+  sw.Do(&m_pending_cycles);
+  sw.Do(&m_irq_sources);
+  sw.DoArray(m_wram);
+  sw.DoArray(m_vram);
+  return !sw.HasError();
 }
 
 void Bus::ExecutePendingCycles()
@@ -31,18 +46,58 @@ void Bus::ExecutePendingCycles()
   if (m_pending_cycles == 0)
     return;
 
+  if (m_perf_counters)
+    m_perf_counters->AddSync(m_pending_cycles);
+  if (m_event_timeline)
+    m_event_timeline->BeginSync();
+
   // 3 PPU cycles per CPU cycle.
-  m_ppu->Execute(m_pending_cycles * 3);
-  m_apu->Execute(m_pending_cycles);
+  if (m_ppu)
+  {
+    PerfCounters::Scope scope(m_perf_counters, PerfCounters::Section::PPU);
+    m_ppu->Execute(m_pending_cycles * 3);
+  }
+  if (m_apu)
+  {
+    PerfCounters::Scope scope(m_perf_counters, PerfCounters::Section::APU);
+    m_apu->Execute(m_pending_cycles);
+  }
+
+  if (m_event_timeline)
+    m_event_timeline->EndSync(m_pending_cycles);
   m_pending_cycles = 0;
 }
 
+void Bus::ClearPageWatchFlags()
+{
+  std::memset(m_cpu_page_watch_flags, 0, sizeof(m_cpu_page_watch_flags));
+  std::memset(m_ppu_page_watch_flags, 0, sizeof(m_ppu_page_watch_flags));
+}
+
 void Bus::EndScanline()
 {
   // TODO: This will eventually link up to Cartridge.
 }
 
 u8 Bus::ReadCPUAddress(u16 address)
+{
+  const u8 value = DoReadCPUAddress(address);
+  if (m_watchpoint_handler && (m_cpu_page_watch_flags[address >> 8] & WATCH_READ))
+    m_watchpoint_handler->OnWatchedAccess(CPUDebugInterface::AddressSpace::CPU, WATCH_READ, address, value);
+
+  return value;
+}
+
+void Bus::WriteCPUAddress(u16 address, u8 value)
+{
+  // Before the write, so the old value can be read.
+  if (m_watchpoint_handler && (m_cpu_page_watch_flags[address >> 8] & WATCH_WRITE))
+    m_watchpoint_handler->OnWatchedAccess(CPUDebugInterface::AddressSpace::CPU, WATCH_WRITE, address, value);
+
+  DoWriteCPUAddress(address, value);
+}
+
+u8 Bus::DoReadCPUAddress(u16 address)
 {
   switch (address >> 12)
   {
@@ -57,6 +112,9 @@ u8 Bus::ReadCPUAddress(u16 address)
     case 0x3: // 0x3000
     {
       // ppu registers
+      if (!m_ppu)
+        return 0;
+
       ExecutePendingCycles();
       return m_ppu->ReadRegister(address & 0x7);
     }
@@ -86,6 +144,9 @@ u8 Bus::ReadCPUAddress(u16 address)
         case 0x13: // $4013 - DMC_LEN
         case 0x15: // $4015 - SND_CHN
         {
+          if (!m_apu)
+            return 0;
+
           ExecutePendingCycles();
           return m_apu->ReadRegister(address & 0xFF);
         }
@@ -118,7 +179,7 @@ u8 Bus::ReadCPUAddress(u16 address)
   }
 }
 
-void Bus::WriteCPUAddress(u16 address, u8 value)
+void Bus::DoWriteCPUAddress(u16 address, u8 value)
 {
   switch (address >> 12)
   {
@@ -134,7 +195,13 @@ void Bus::WriteCPUAddress(u16 address, u8 value)
     case 0x3: // 0x3000
     {
       // ppu registers
+      if (!m_ppu)
+        return;
+
       ExecutePendingCycles();
+      if (m_event_timeline)
+        m_event_timeline->Record(EventTimeline::Type::PPUWrite, address & 0x7, value);
+
       m_ppu->WriteRegister(address & 0x7, value);
       return;
     }
@@ -165,6 +232,9 @@ void Bus::WriteCPUAddress(u16 address, u8 value)
         case 0x15: // $4013 - SND_CHN
         case 0x17: // $4017 - Frame counter control
         {
+          if (!m_apu)
+            return;
+
           ExecutePendingCycles();
           m_apu->WriteRegister(address & 0xFF, value);
           return;
@@ -172,6 +242,9 @@ void Bus::WriteCPUAddress(u16 address, u8 value)
 
         case 0x14: // $4014 - OAMDMA
         {
+          if (!m_ppu)
+            return;
+
           ExecutePendingCycles();
           m_ppu->WriteDMA(value);
           return;
@@ -200,6 +273,9 @@ void Bus::WriteCPUAddress(u16 address, u8 value)
     default:
     {
       // Redirect rest to cartridge.
+      if (m_event_timeline && address >= 0x8000)
+        m_event_timeline->Record(EventTimeline::Type::MapperWrite, address, value);
+
       return m_cartridge->WriteCPUAddress(this, address, value);
     }
   }
@@ -208,29 +284,47 @@ void Bus::WriteCPUAddress(u16 address, u8 value)
 u8 Bus::ReadPPUAddress(u16 address)
 {
   // All PPU accesses go to the cartridge.
-  return m_cartridge->ReadPPUAddress(this, address);
+  const u8 value = m_cartridge->ReadPPUAddress(this, address);
+  if (m_watchpoint_handler && (GetPPUPageWatchFlags(address) & WATCH_READ))
+    m_watchpoint_handler->OnWatchedAccess(CPUDebugInterface::AddressSpace::PPU, WATCH_READ, address, value);
+
+  return value;
 }
 
 void Bus::WritePPUAddress(u16 address, u8 value)
 {
+  if (m_watchpoint_handler && (GetPPUPageWatchFlags(address) & WATCH_WRITE))
+    m_watchpoint_handler->OnWatchedAccess(CPUDebugInterface::AddressSpace::PPU, WATCH_WRITE, address, value);
+
   m_cartridge->WritePPUAddress(this, address, value);
 }
 
-void Bus::StallCPU(u32 num_cycles)
+u32 Bus::StallCPU(u32 num_cycles)
 {
   // Extra tick on odd cycles
   uint32 stall_cycles = num_cycles + (m_cpu->GetCyclesSinceReset() & 1);
   m_cpu->Stall(stall_cycles);
+  return stall_cycles;
 }
 
 void Bus::SetCPUNMILine(bool active)
 {
+  if (m_event_timeline && active != m_cpu->GetNMILineState())
+    m_event_timeline->Record(active ? EventTimeline::Type::NMIRaise : EventTimeline::Type::NMIClear);
+
   m_cpu->SetNMILine(active);
 }
 
-void Bus::SetCPUIRQLine(bool active)
+void Bus::SetCPUIRQLine(bool active, IRQSource source)
 {
-  m_cpu->SetIRQLine(active);
+  // Each source's edges are recorded, so the timeline shows which of them is holding the line.
+  const u8 bit = static_cast<u8>(1u << static_cast<u8>(source));
+  const u8 sources = active ? (m_irq_sources | bit) : (m_irq_sources & ~bit);
+  if (m_event_timeline && sources != m_irq_sources)
+    m_event_timeline->Record(active ? EventTimeline::Type::IRQAssert : EventTimeline::Type::IRQClear, 0, u8(source));
+
+  m_irq_sources = sources;
+  m_cpu->SetIRQLine(sources != 0);
 }
 
 void Bus::PPUScanline(u32 line, bool rendering_enabled)
@@ -7,6 +7,10 @@ class PPU;
 class APU;
 class Cartridge;
 class Controller;
+class CPUDebugInterface;
+class EventTimeline;
+class PerfCounters;
+class StateWrapper;
 
 class Bus
 {
@@ -14,16 +18,52 @@ public:
   static const u32 WRAM_SIZE = 2048;
   static const u32 VRAM_SIZE = 2048; // Also known as "CIRAM".
   static const u32 NUM_CONTROLLERS = 2;
+  static const u32 NUM_CPU_PAGES = 256; // 256 byte pages, for watchpoints.
+  static const u32 NUM_PPU_PAGES = 64;
+
+  // Accesses watched on a page.
+  enum WATCH_FLAG : u8
+  {
+    WATCH_READ = (1 << 0),
+    WATCH_WRITE = (1 << 1),
+    WATCH_EXECUTE = (1 << 2)
+  };
+
+  // What raised or lowered the IRQ line. The line is asserted while any source is.
+  enum class IRQSource : u8
+  {
+    APU,
+    Mapper
+  };
 
   Bus();
   ~Bus();
 
+  // The PPU and APU may be null, for sound-only playback and component benchmarks, in which case their registers read
+  // as zero and ignore writes.
   void Initialize(CPU* cpu, PPU* ppu, APU* apu);
   void Reset();
+  bool DoState(StateWrapper& sw);
 
   void SetController(uint32 index, Controller* controller) { m_controllers[index] = controller; }
   void SetCartridge(Cartridge* cartridge) { m_cartridge = cartridge; }
 
+  // Counts syncs and times the PPU and APU when set. See System::SetStatsEnabled().
+  void SetPerfCounters(PerfCounters* counters) { m_perf_counters = counters; }
+
+  // Events are recorded here when set, by the bus and the components attached to it. See System.
+  EventTimeline* GetEventTimeline() const { return m_event_timeline; }
+  void SetEventTimeline(EventTimeline* timeline) { m_event_timeline = timeline; }
+
+  // Accesses to pages with watch flags are passed to the handler, which is only set while any page is flagged, so
+  // everything else costs a null check. See CPUDebugInterface.
+  void SetWatchpointHandler(CPUDebugInterface* handler) { m_watchpoint_handler = handler; }
+  u8 GetCPUPageWatchFlags(u16 address) const { return m_cpu_page_watch_flags[address >> 8]; }
+  u8 GetPPUPageWatchFlags(u16 address) const { return m_ppu_page_watch_flags[(address >> 8) & 0x3F]; }
+  void AddCPUPageWatchFlags(u32 page, u8 flags) { m_cpu_page_watch_flags[page] |= flags; }
+  void AddPPUPageWatchFlags(u32 page, u8 flags) { m_ppu_page_watch_flags[page] |= flags; }
+  void ClearPageWatchFlags();
+
   CycleCount GetPendingCycles() const { return m_pending_cycles; }
   void AddPendingCycles(CycleCount cycles) { m_pending_cycles += cycles; }
   void ExecutePendingCycles();
@@ -45,28 +85,41 @@ public:
   u8 ReadPPUAddress(u16 address);
   void WritePPUAddress(u16 address, u8 value);
 
-  // Holds the bus for a specified number of cycles, preventing CPU access.
-  void StallCPU(u32 num_cycles);
+  // Holds the bus for a specified number of cycles, preventing CPU access. Returns the cycles actually stalled, which
+  // includes an extra one on odd cycles.
+  u32 StallCPU(u32 num_cycles);
 
   // Sets/clears the NMI line on the CPU.
   void SetCPUNMILine(bool active);
 
-  // Sets/clears the IRQ line on the CPU.
-  void SetCPUIRQLine(bool active);
+  // Sets/clears a source's IRQ. The CPU's line is the OR of every source's.
+  void SetCPUIRQLine(bool active, IRQSource source);
 
   // Notifies other components when the PPU finishes rendering a scanline.
   void PPUScanline(u32 line, bool rendering_enabled);
 
 private:
+  u8 DoReadCPUAddress(u16 address);
+  void DoWriteCPUAddress(u16 address, u8 value);
+
   CPU* m_cpu = nullptr;
   PPU* m_ppu = nullptr;
   APU* m_apu = nullptr;
 
   Cartridge* m_cartridge = nullptr;
   Controller* m_controllers[2] = {};
+  PerfCounters* m_perf_counters = nullptr;
+  EventTimeline* m_event_timeline = nullptr;
+  CPUDebugInterface* m_watchpoint_handler = nullptr;
 
   CycleCount m_pending_cycles = 0;
 
+  // One bit per IRQSource currently asserting the IRQ line.
+  u8 m_irq_sources = 0;
+
   byte m_wram[WRAM_SIZE];
   byte m_vram[VRAM_SIZE];
+
+  u8 m_cpu_page_watch_flags[NUM_CPU_PAGES] = {};
+  u8 m_ppu_page_watch_flags[NUM_PPU_PAGES] = {};
 };
@@ -3,12 +3,16 @@
 #include "YBaseLib/Error.h"
 #include "YBaseLib/Log.h"
 #include "bus.h"
+#include "common/hash.h"
+#include "common/mapped_file.h"
+#include "common/state_wrapper.h"
 #include "mappers/axrom.h"
 #include "mappers/gxrom.h"
 #include "mappers/mmc1.h"
 #include "mappers/mmc3.h"
 #include "mappers/nrom.h"
 #include "mappers/uxrom.h"
+#include <cstring>
 Log_SetChannel(Cartridge);
 
 #pragma pack(push, 1)
@@ -19,11 +23,15 @@ struct INES_HEADER
   uint8 NumCHR;
   uint8 Control1;
   uint8 Control2;
-  uint8 NumRam;
-  uint8 Padding[7];
+  uint8 NumRam;      // NES 2.0: mapper bits 8-11, submapper
+  uint8 SizeMSB;     // NES 2.0: PRG/CHR-ROM size bits 8-11
+  uint8 PRGRAMShift; // NES 2.0: PRG-RAM/NVRAM size as 64 << shift
+  uint8 CHRRAMShift; // NES 2.0: CHR-RAM/NVRAM size as 64 << shift
+  uint8 Padding[4];
 };
 #pragma pack(pop)
 static const uint32 INES_MAGIC = 0x1a53454e;
+static const uint32 INES_TRAINER_SIZE = 512;
 
 Cartridge::Cartridge() = default;
 
@@ -37,20 +45,36 @@ bool Cartridge::Initialize(CartridgeData& data, Error* error)
     return false;
   }
 
-  m_prg_rom = std::move(data.prg_rom);
+  m_prg_rom = data.prg_rom;
   m_prg_rom_bank_count = u8(m_prg_rom.size() / INES_PRG_ROM_BANK_SIZE);
-  m_chr_rom = std::move(data.chr_rom);
+  m_chr_rom = data.chr_rom;
   m_chr_rom_bank_count = u8(m_chr_rom.size() / INES_CHR_ROM_BANK_SIZE);
   m_prg_ram.resize(data.prg_ram_size);
   m_chr_ram.resize(data.chr_ram_size);
+  m_image_hash = data.image_hash;
   m_mapper = data.mapper_id;
   m_mirror = static_cast<MirrorMode>(data.mirror);
   m_battery = data.battery;
   return true;
 }
 
+std::unique_ptr<Cartridge> Cartridge::Clone() const
+{
+  return std::make_unique<Cartridge>(*this);
+}
+
 void Cartridge::Reset() {}
 
+bool Cartridge::DoState(StateWrapper& sw)
+{
+  // ROM is immutable, so only RAM and banking state is saved.
+  sw.DoMarker("CART");
+  sw.DoBytes(&m_prg_ram);
+  sw.DoBytes(&m_chr_ram);
+  sw.Do(&m_mirror);
+  return !sw.HasError();
+}
+
 uint8 Cartridge::ReadCPUAddress(Bus* bus, u16 address)
 {
   return m_chr_rom[address & 0x3FFF];
@@ -58,6 +82,11 @@ uint8 Cartridge::ReadCPUAddress(Bus* bus, u16 address)
 
 void Cartridge::WriteCPUAddress(Bus* bus, u16 address, u8 value) {}
 
+bool Cartridge::GetPRGROMOffset(u16 address, u32* offset) const
+{
+  return false;
+}
+
 uint8 Cartridge::ReadPPUAddress(Bus* bus, u16 address)
 {
   if (address < 0x2000)
@@ -90,107 +119,181 @@ void Cartridge::WritePPUAddress(Bus* bus, u16 address, u8 value)
 
 void Cartridge::PPUScanline(Bus* bus, u32 line, bool rendering_enabled) {}
 
-std::unique_ptr<Cartridge> Cartridge::Load(ByteStream* stream, Error* error)
+bool Cartridge::LoadDataFromFile(const char* filename, CartridgeData* data, Error* error)
 {
-  uint32 cartSize = (uint32)stream->GetSize();
+  std::shared_ptr<MappedFile> mf = MappedFile::Open(filename, error);
+  if (!mf)
+    return false;
+
+  const byte* image = mf->GetData();
+  const size_t image_size = mf->GetSize();
+  return LoadDataFromMemory(std::move(mf), image, image_size, data, error);
+}
 
-  // read magic
+bool Cartridge::LoadDataFromMemory(std::shared_ptr<const void> owner, const byte* image, size_t image_size,
+                                   CartridgeData* data, Error* error)
+{
+  // check known magic
   uint32 magic;
-  if (!stream->Read2(&magic, sizeof(magic)))
+  if (image_size < sizeof(magic))
   {
     error->SetErrorUser(1, "Failed to read magic");
-    return nullptr;
+    return false;
   }
 
-  // check known magic
+  std::memcpy(&magic, image, sizeof(magic));
   if (magic == INES_MAGIC)
-    return LoadINES(stream, error);
+    return ParseINES(owner, image, image_size, data, error);
 
   // not known file type
   error->SetErrorUser(1, "Unknown file type");
-  return nullptr;
+  return false;
 }
 
-std::unique_ptr<Cartridge> Cartridge::LoadINES(ByteStream* stream, Error* error)
+bool Cartridge::LoadData(ByteStream* stream, CartridgeData* data, Error* error)
 {
-  // return to start
-  if (!stream->SeekAbsolute(0))
+  auto image = std::make_shared<DataType>(static_cast<size_t>(stream->GetSize()));
+  if (!stream->SeekAbsolute(0) || !stream->Read2(image->data(), static_cast<uint32>(image->size())))
+  {
+    error->SetErrorUser(1, "Failed to read file");
     return false;
+  }
 
-  // read ines header
-  INES_HEADER header;
-  if (!stream->Read2(&header, sizeof(header)))
-  {
-    error->SetErrorUser(1, "Failed to read header");
+  const byte* image_data = image->data();
+  const size_t image_size = image->size();
+  return LoadDataFromMemory(std::move(image), image_data, image_size, data, error);
+}
+
+std::unique_ptr<Cartridge> Cartridge::Load(ByteStream* stream, Error* error)
+{
+  CartridgeData data;
+  if (!LoadData(stream, &data, error))
     return nullptr;
-  }
 
-  // find mapper
+  return Create(data, error);
+}
+
+std::unique_ptr<Cartridge> Cartridge::LoadFile(const char* filename, Error* error)
+{
   CartridgeData data;
-  data.mapper_id = (header.Control1 >> 4) | ((header.Control2 >> 4) << 4);
-  data.mirror = (header.Control1 & 1);
-  data.battery = (header.Control1 >> 1) & 1;
+  if (!LoadDataFromFile(filename, &data, error))
+    return nullptr;
 
-  // four-screen/vram
-  if (header.Control1 & 0x08)
-    data.mirror = MirrorModeMirrorFour;
+  return Create(data, error);
+}
 
-  // trainer.. wtf?
-  if (header.Control1 & 4)
+bool Cartridge::ParseINES(const std::shared_ptr<const void>& owner, const byte* image, size_t image_size,
+                          CartridgeData* data, Error* error)
+{
+  // The header is validated in place, no copy of the image is made.
+  if (image_size < sizeof(INES_HEADER))
   {
-    if (!stream->SeekRelative(512))
-      return nullptr;
+    error->SetErrorUser(1, "Failed to read header");
+    return false;
   }
 
-  // if there is no CHR ROM, assume CHR RAM
-  data.chr_ram_size = data.chr_rom.empty() ? 8192 : 0;
+  const INES_HEADER* header = reinterpret_cast<const INES_HEADER*>(image);
+  const bool nes2 = ((header->Control2 & 0x0C) == 0x08);
 
-  // PRG RAM
-  if (header.Control1 & 0x02)
+  // find mapper
+  data->mapper_id = (header->Control1 >> 4) | (header->Control2 & 0xF0);
+  if (nes2)
   {
-    if (header.NumRam == 0)
-      data.prg_ram_size = INES_PRG_RAM_BANK_SIZE;
-    else
-      data.prg_ram_size = header.NumRam * INES_PRG_RAM_BANK_SIZE;
+    data->mapper_id |= u16(header->NumRam & 0x0F) << 8;
   }
-  else
+  else if (header->Padding[0] | header->Padding[1] | header->Padding[2] | header->Padding[3])
   {
-    data.prg_ram_size = 0;
+    // Old dumps have garbage ("DiskDude!") in bytes 7-15, so the upper mapper bits can't be trusted.
+    Log_WarningPrintf("Header has garbage in reserved bytes, ignoring upper mapper bits");
+    data->mapper_id &= 0x0F;
   }
 
-  // read prg banks
-  data.prg_rom.resize(INES_PRG_ROM_BANK_SIZE * header.NumPRG);
-  for (uint32 i = 0; i < header.NumPRG; i++)
+  data->mirror = (header->Control1 & 1);
+  data->battery = (header->Control1 >> 1) & 1;
+
+  // four-screen/vram
+  if (header->Control1 & 0x08)
+    data->mirror = MirrorModeMirrorFour;
+
+  u32 prg_bank_count = header->NumPRG;
+  u32 chr_bank_count = header->NumCHR;
+  if (nes2)
   {
-    if (!stream->Read2(&data.prg_rom[i * INES_PRG_ROM_BANK_SIZE], INES_PRG_ROM_BANK_SIZE))
+    // Exponent-multiplier sizes are only used by large homebrew/multicarts.
+    if ((header->SizeMSB & 0x0F) == 0x0F || (header->SizeMSB & 0xF0) == 0xF0)
     {
-      error->SetErrorUserFormatted(1, "Failed to read PRG-ROM bank %u", i);
+      error->SetErrorUser(1, "NES 2.0 exponent-multiplier ROM sizes are not supported");
       return false;
     }
-  }
 
-  // read chr banks
-  data.chr_rom.resize(INES_CHR_ROM_BANK_SIZE * header.NumCHR);
-  for (uint32 i = 0; i < header.NumCHR; i++)
+    prg_bank_count |= u32(header->SizeMSB & 0x0F) << 8;
+    chr_bank_count |= u32(header->SizeMSB & 0xF0) << 4;
+
+    // Volatile and battery-backed RAM are both mapped to the same place.
+    const auto shift_size = [](u8 shift) -> u32 { return (shift != 0) ? (64u << shift) : 0u; };
+    data->prg_ram_size = shift_size(header->PRGRAMShift & 0x0F) + shift_size(header->PRGRAMShift >> 4);
+    data->chr_ram_size = shift_size(header->CHRRAMShift & 0x0F) + shift_size(header->CHRRAMShift >> 4);
+  }
+  else
   {
-    if (!stream->Read2(&data.chr_rom[i * INES_CHR_ROM_BANK_SIZE], INES_CHR_ROM_BANK_SIZE))
+    // if there is no CHR ROM, assume CHR RAM
+    data->chr_ram_size = (chr_bank_count == 0) ? 8192 : 0;
+
+    // PRG RAM
+    if (header->Control1 & 0x02)
     {
-      error->SetErrorUserFormatted(1, "Failed to read CHR-ROM bank %u", i);
-      return false;
+      if (header->NumRam == 0)
+        data->prg_ram_size = INES_PRG_RAM_BANK_SIZE;
+      else
+        data->prg_ram_size = header->NumRam * INES_PRG_RAM_BANK_SIZE;
+    }
+    else
+    {
+      data->prg_ram_size = 0;
     }
   }
 
-  Log_InfoPrintf("Parsing INES file:");
-  Log_InfoPrintf("  Mapper ID: %u", data.mapper_id);
-  Log_InfoPrintf("  Mirroring: %u", data.mirror);
-  Log_InfoPrintf("  Battery: %s", data.battery ? "yes" : "no");
-  Log_InfoPrintf("  CHR ROM: %u (0x%x) bytes, %u 8KB banks", unsigned(data.chr_rom.size()),
-                 unsigned(data.prg_rom.size()), header.NumCHR);
-  Log_InfoPrintf("  CHR RAM: %u (0x%x) bytes", data.chr_ram_size);
-  Log_InfoPrintf("  PRG ROM: %u (0x%x) bytes, %u 16K banks", unsigned(data.prg_rom.size()),
-                 unsigned(data.prg_rom.size()), header.NumPRG);
-  Log_InfoPrintf("  PRG RAM: %u (0x%x) bytes", data.prg_ram_size);
+  if (prg_bank_count > 0xFF || chr_bank_count > 0xFF)
+  {
+    error->SetErrorUserFormatted(1, "ROM too large (%u PRG banks, %u CHR banks)", prg_bank_count, chr_bank_count);
+    return false;
+  }
+
+  // trainer.. wtf?
+  size_t offset = sizeof(INES_HEADER);
+  if (header->Control1 & 4)
+    offset += INES_TRAINER_SIZE;
 
+  const size_t prg_rom_size = size_t(prg_bank_count) * INES_PRG_ROM_BANK_SIZE;
+  const size_t chr_rom_size = size_t(chr_bank_count) * INES_CHR_ROM_BANK_SIZE;
+  if ((offset + prg_rom_size + chr_rom_size) > image_size)
+  {
+    error->SetErrorUserFormatted(1, "File is truncated (%u bytes, header specifies %u bytes)", unsigned(image_size),
+                                 unsigned(offset + prg_rom_size + chr_rom_size));
+    return false;
+  }
+
+  // Point the banks directly into the image.
+  data->prg_rom = ROMView(owner, image + offset, static_cast<u32>(prg_rom_size));
+  data->chr_rom = ROMView(owner, image + offset + prg_rom_size, static_cast<u32>(chr_rom_size));
+  data->image_hash = HashBytes64(image, image_size);
+
+  Log_InfoPrintf("Parsing %s file:", nes2 ? "NES 2.0" : "INES");
+  Log_InfoPrintf("  Mapper ID: %u", data->mapper_id);
+  Log_InfoPrintf("  Mirroring: %u", data->mirror);
+  Log_InfoPrintf("  Battery: %s", data->battery ? "yes" : "no");
+  Log_InfoPrintf("  CHR ROM: %u (0x%x) bytes, %u 8KB banks", data->chr_rom.size(), data->chr_rom.size(),
+                 chr_bank_count);
+  Log_InfoPrintf("  CHR RAM: %u (0x%x) bytes", data->chr_ram_size, data->chr_ram_size);
+  Log_InfoPrintf("  PRG ROM: %u (0x%x) bytes, %u 16K banks", data->prg_rom.size(), data->prg_rom.size(),
+                 prg_bank_count);
+  Log_InfoPrintf("  PRG RAM: %u (0x%x) bytes", data->prg_ram_size, data->prg_ram_size);
+  Log_InfoPrintf("  Hash: %016llX", static_cast<unsigned long long>(data->image_hash));
+  return true;
+}
+
+std::unique_ptr<Cartridge> Cartridge::Create(const CartridgeData& data, Error* error)
+{
   // allocate cartridge
   std::unique_ptr<Cartridge> cart;
   switch (data.mapper_id)
@@ -224,7 +327,9 @@ std::unique_ptr<Cartridge> Cartridge::LoadINES(ByteStream* stream, Error* error)
       return nullptr;
   }
 
-  if (!cart->Initialize(data, error))
+  // Mappers may adjust the RAM sizes, so they get their own copy. The ROM is shared.
+  CartridgeData cart_data = data;
+  if (!cart->Initialize(cart_data, error))
     cart.reset();
 
   return cart;
@@ -6,6 +6,7 @@
 class Bus;
 class ByteStream;
 class Error;
+class StateWrapper;
 
 class Cartridge
 {
@@ -16,6 +17,28 @@ public:
 
   using DataType = std::vector<byte>;
 
+  // Read-only view of ROM data. The memory backing it (a buffer or a file mapping) is reference counted, and
+  // shared by every cartridge created from the same data, including clones.
+  class ROMView
+  {
+  public:
+    ROMView() = default;
+    ROMView(std::shared_ptr<const void> owner, const byte* pointer, u32 size)
+      : m_owner(std::move(owner)), m_pointer(pointer), m_size(size)
+    {
+    }
+
+    const byte& operator[](u32 offset) const { return m_pointer[offset]; }
+    const byte* data() const { return m_pointer; }
+    u32 size() const { return m_size; }
+    bool empty() const { return (m_size == 0); }
+
+  private:
+    std::shared_ptr<const void> m_owner;
+    const byte* m_pointer = nullptr;
+    u32 m_size = 0;
+  };
+
   enum MirrorMode
   {
     MirrorModeMirrorHorizontal,
@@ -29,50 +52,79 @@ public:
   Cartridge();
   virtual ~Cartridge();
 
-  const DataType& GetPRGROM() const { return m_prg_rom; }
-  const DataType& GetCHRROM() const { return m_chr_rom; }
+  const ROMView& GetPRGROM() const { return m_prg_rom; }
+  const ROMView& GetCHRROM() const { return m_chr_rom; }
   const DataType& GetPRGRAM() const { return m_prg_ram; }
   const DataType& GetCHRRAM() const { return m_chr_ram; }
   const MirrorMode GetMirrorMode() const { return m_mirror; }
 
+  // Hash of the whole file, for identifying ROMs.
+  u64 GetImageHash() const { return m_image_hash; }
+
+  // Parsed cartridge file. ROM data is reference counted, so a file can be loaded once and used to create any
+  // number of cartridges, which all share the same ROM. RAM is allocated per cartridge.
+  struct CartridgeData
+  {
+    ROMView prg_rom;
+    ROMView chr_rom;
+    u64 image_hash;
+    u32 prg_ram_size;
+    u32 chr_ram_size;
+    u16 mapper_id;
+    u8 mirror;
+    bool battery;
+  };
+
+  // Memory-maps the file, and points the ROM data directly into the mapping.
+  static bool LoadDataFromFile(const char* filename, CartridgeData* data, Error* error);
+
+  // Parses an image which is already in memory. The owner keeps the memory alive while cartridges reference it.
+  static bool LoadDataFromMemory(std::shared_ptr<const void> owner, const byte* image, size_t image_size,
+                                 CartridgeData* data, Error* error);
+
+  // Reads the whole stream into memory.
+  static bool LoadData(ByteStream* stream, CartridgeData* data, Error* error);
+
+  static std::unique_ptr<Cartridge> Create(const CartridgeData& data, Error* error);
+
+  // Loads the file and creates a cartridge from it.
+  static std::unique_ptr<Cartridge> Load(ByteStream* stream, Error* error);
+  static std::unique_ptr<Cartridge> LoadFile(const char* filename, Error* error);
+
+  // Creates a copy of the cartridge in its current state. ROM is shared, RAM and registers are copied.
+  virtual std::unique_ptr<Cartridge> Clone() const;
+
   // mapper
   virtual void Reset();
+  virtual bool DoState(StateWrapper& sw);
   virtual u8 ReadCPUAddress(Bus* bus, u16 address);
   virtual void WriteCPUAddress(Bus* bus, u16 address, u8 value);
   virtual u8 ReadPPUAddress(Bus* bus, u16 address);
   virtual void WritePPUAddress(Bus* bus, u16 address, u8 value);
   virtual void PPUScanline(Bus* bus, u32 line, bool rendering_enabled);
 
-  static std::unique_ptr<Cartridge> Load(ByteStream* stream, Error* error);
+  // Finds the PRG ROM byte currently mapped at a CPU address, for the debugger. Returns false if it isn't ROM.
+  virtual bool GetPRGROMOffset(u16 address, u32* offset) const;
 
 private:
-  static std::unique_ptr<Cartridge> LoadINES(ByteStream* stream, Error* error);
+  static bool ParseINES(const std::shared_ptr<const void>& owner, const byte* image, size_t image_size,
+                        CartridgeData* data, Error* error);
 
 protected:
-  struct CartridgeData
-  {
-    DataType prg_rom;
-    DataType chr_rom;
-    u32 prg_ram_size;
-    u32 chr_ram_size;
-    u8 mapper_id;
-    u8 mirror;
-    bool battery;
-  };
-
   virtual bool Initialize(CartridgeData& data, Error* error);
 
   static u16 MirrorAddress(MirrorMode mode, u16 offset);
 
-  DataType m_prg_rom;
-  DataType m_chr_rom;
+  ROMView m_prg_rom;
+  ROMView m_chr_rom;
   DataType m_prg_ram;
   DataType m_chr_ram;
 
   u8 m_prg_rom_bank_count = 0; // in 16KB banks
   u8 m_chr_rom_bank_count = 0; // in 8KB banks
 
-  u8 m_mapper = 0;
+  u64 m_image_hash = 0;
+  u16 m_mapper = 0;
   MirrorMode m_mirror = MirrorModeMirrorVertical;
   bool m_battery = false;
 };
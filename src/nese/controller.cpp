@@ -1,7 +1,13 @@
 #include "controller.h"
+#include "common/state_wrapper.h"
 
 StandardController::StandardController() = default;
 
+std::unique_ptr<Controller> StandardController::Clone() const
+{
+  return std::make_unique<StandardController>(*this);
+}
+
 void StandardController::WriteStrobe(bool active)
 {
   if (m_strobe && !active)
@@ -25,6 +31,13 @@ uint8 StandardController::ReadData()
   return value;
 }
 
+bool StandardController::DoState(StateWrapper& sw)
+{
+  sw.Do(&m_shift_register);
+  sw.Do(&m_strobe);
+  return !sw.HasError();
+}
+
 void StandardController::ReloadShiftRegister()
 {
   m_shift_register = 0;
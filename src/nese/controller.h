@@ -1,11 +1,22 @@
 #pragma once
 #include "types.h"
+#include <memory>
+
+class StateWrapper;
 
 class Controller
 {
 public:
+  virtual ~Controller() = default;
+
+  // Creates a copy of the controller, including its current button states.
+  virtual std::unique_ptr<Controller> Clone() const = 0;
+
   virtual void WriteStrobe(bool active) = 0;
   virtual uint8 ReadData() = 0;
+
+  // Button states are host input, and are not part of the saved state.
+  virtual bool DoState(StateWrapper& sw) = 0;
 };
 
 class StandardController final : public Controller
@@ -26,8 +37,10 @@ public:
 
   StandardController();
 
+  std::unique_ptr<Controller> Clone() const override final;
   void WriteStrobe(bool active) override final;
   uint8 ReadData() override final;
+  bool DoState(StateWrapper& sw) override final;
 
   bool GetButtonState(uint8 button) const { return m_button_states[button]; }
   void SetButtonState(uint8 button, bool state) { m_button_states[button] = state; }
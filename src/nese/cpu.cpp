@@ -3,7 +3,10 @@
 #include "YBaseLib/Log.h"
 #include "YBaseLib/Memory.h"
 #include "YBaseLib/String.h"
+#include "common/state_wrapper.h"
 #include "nese/bus.h"
+#include "nese/cpu_debug_interface.h"
+#include "nese/event_timeline.h"
 #include "nese/system.h"
 Log_SetChannel(CPU);
 
@@ -34,9 +37,28 @@ void CPU::Reset()
   /// m_registers.PC = 0xC000;
 }
 
-static bool disasm_enabled = false;
+bool CPU::DoState(StateWrapper& sw)
+{
+  sw.DoMarker("CPU");
+  sw.DoPOD(&m_registers);
+  sw.Do(&m_cycle_counter);
+  sw.Do(&m_stall_cycles);
+  sw.Do(&m_nmi_pending);
+  sw.Do(&m_nmi_line_state);
+  sw.Do(&m_irq_line_state);
+  return !sw.HasError();
+}
 
 void CPU::Execute(CycleCount cycles)
+{
+  if (m_debug_interface && m_debug_interface->IsActive())
+    ExecuteCycles<true>(cycles);
+  else
+    ExecuteCycles<false>(cycles);
+}
+
+template<bool debug>
+void CPU::ExecuteCycles(CycleCount cycles)
 {
   CycleCount executed_cycles = 0;
   while (cycles > 0)
@@ -50,6 +72,10 @@ void CPU::Execute(CycleCount cycles)
       m_stall_cycles -= stall_cycle_count;
       AddCycles(stall_cycle_count);
     }
+    else if (debug && m_debug_interface->CheckBreak(m_registers.PC, m_registers.S))
+    {
+      break;
+    }
     else if (m_nmi_pending)
     {
       HandleNMI();
@@ -60,25 +86,22 @@ void CPU::Execute(CycleCount cycles)
     }
     else
     {
-      // debug
-      if (disasm_enabled)
+      if (m_trace_output)
       {
         SmallString disasm;
         if (Disassemble(&disasm, m_registers.PC, nullptr))
         {
-          // Log_DevPrintf("exec: %s", disasm.GetCharArray());
-          // Log_DevPrintf("%-48sA:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%3u SL:0", disasm.GetCharArray(),
-          // m_registers.A, m_registers.X, m_registers.Y, m_registers.P, m_registers.S, 0, 0);
-          std::fprintf(stdout, "%-48sA:%02X X:%02X Y:%02X P:%02X SP:%02X\n", disasm.GetCharArray(), m_registers.A,
-                       m_registers.X, m_registers.Y, m_registers.P, m_registers.S);
+          std::fprintf(m_trace_output, "%-48sA:%02X X:%02X Y:%02X P:%02X SP:%02X\n", disasm.GetCharArray(),
+                       m_registers.A, m_registers.X, m_registers.Y, m_registers.P, m_registers.S);
         }
         else
         {
-          std::fprintf(stdout, "disasm fail at %04X\n", m_registers.PC);
+          std::fprintf(m_trace_output, "disasm fail at %04X\n", m_registers.PC);
         }
       }
 
       ExecuteInstruction();
+      m_instruction_counter++;
     }
 
     // Handle u32 overflow.
@@ -192,6 +215,9 @@ void CPU::Stall(u32 cycles)
 void CPU::HandleNMI()
 {
   // Log_DevPrintf("NMI");
+  if (EventTimeline* timeline = m_bus->GetEventTimeline())
+    timeline->Record(EventTimeline::Type::NMITaken);
+
   m_nmi_pending = false;
   PushWord(m_registers.PC);
   PushByte(m_registers.P);
@@ -203,6 +229,9 @@ void CPU::HandleNMI()
 void CPU::HandleIRQ()
 {
   // Log_DevPrintf("IRQ");
+  if (EventTimeline* timeline = m_bus->GetEventTimeline())
+    timeline->Record(EventTimeline::Type::IRQTaken);
+
   PushWord(m_registers.PC);
   PushByte(m_registers.P);
   m_registers.PC = MemoryReadWord(0xFFFE);
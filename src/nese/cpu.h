@@ -1,7 +1,10 @@
 #pragma once
 #include "types.h"
+#include <cstdio>
 
 class Bus;
+class CPUDebugInterface;
+class StateWrapper;
 class String;
 class System;
 
@@ -159,17 +162,29 @@ public:
   // Total number of cycles executed since reset.
   u32 GetCyclesSinceReset() const { return m_cycle_counter; }
 
+  // Total number of instructions executed, for measurement. Isn't saved in states, so only ever counts up.
+  u32 GetInstructionsExecuted() const { return m_instruction_counter; }
+
   // reset
   void Initialize(System* system, Bus* bus);
   void Reset();
+  bool DoState(StateWrapper& sw);
 
-  // Executes cycles.
+  // Executes cycles. Returns early if the debugger stops execution.
   void Execute(CycleCount cycles);
 
+  // Consulted while active, before each instruction. May be null.
+  void SetDebugInterface(CPUDebugInterface* debug_interface) { m_debug_interface = debug_interface; }
+
   // disassemble an instruction
   bool Disassemble(String* pDestination, u16 address, u16* size);
 
+  // Writes every instruction executed, with the registers, to the file. Null turns tracing off.
+  void SetTraceOutput(std::FILE* fp) { m_trace_output = fp; }
+
   // trigger a NMI, IRQ
+  bool GetNMILineState() const { return m_nmi_line_state; }
+  bool GetIRQLineState() const { return m_irq_line_state; }
   void SetNMILine(bool state);
   void SetIRQLine(bool state);
 
@@ -211,6 +226,10 @@ private:
   void HandleNMI();
   void HandleIRQ();
 
+  // Breakpoints and stepping are only checked by the debug instantiation, so the normal loop doesn't pay for them.
+  template<bool debug>
+  void ExecuteCycles(CycleCount cycles);
+
   void ExecuteInstruction();
 
   // instruction handlers
@@ -288,12 +307,14 @@ private:
   // pointer to rest of system
   System* m_system = nullptr;
   Bus* m_bus = nullptr;
+  CPUDebugInterface* m_debug_interface = nullptr;
 
   // registers
   Registers m_registers = {};
 
   // clock values
   u32 m_cycle_counter = 0;
+  u32 m_instruction_counter = 0;
   u32 m_stall_cycles = 0;
 
   // nmi/irq pending
@@ -301,6 +322,8 @@ private:
   bool m_nmi_line_state = false;
   bool m_irq_line_state = false;
 
+  std::FILE* m_trace_output = nullptr;
+
   // instruction wrappers
   template<void (CPU::*instruction)(uint8)>
   inline void WrapReadAccumulator();
@@ -0,0 +1,382 @@
+#include "cpu_debug_interface.h"
+#include "bus.h"
+#include "cartridge.h"
+#include "system.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+CPUDebugInterface::CPUDebugInterface(System* system) : m_system(system) {}
+
+CPUDebugInterface::~CPUDebugInterface() = default;
+
+const CPU::Registers* CPUDebugInterface::GetRegisters() const
+{
+  return m_system->GetCPU()->GetRegisters();
+}
+
+u8 CPUDebugInterface::ReadMemoryByte(u16 address) const
+{
+  if (address < 0x2000)
+    return m_system->GetBus()->ReadWRAM(address & 0x7FF);
+  else if (address < 0x4020)
+    return 0;
+  else
+    return m_system->GetCartridge()->ReadCPUAddress(m_system->GetBus(), address);
+}
+
+u8 CPUDebugInterface::ReadPPUMemoryByte(u16 address) const
+{
+  return m_system->GetCartridge()->ReadPPUAddress(m_system->GetBus(), address & 0x3FFF);
+}
+
+bool CPUDebugInterface::DisassembleInstruction(ProgramCounterType address, String* text, u16* size) const
+{
+  return m_system->GetCPU()->Disassemble(text, address, size);
+}
+
+u32 CPUDebugInterface::GetBreakpointLocation(ProgramCounterType address) const
+{
+  u32 offset;
+  if (address >= 0x4020 && m_system->GetCartridge()->GetPRGROMOffset(address, &offset))
+    return ROM_LOCATION_BASE + offset;
+  else
+    return address;
+}
+
+bool CPUDebugInterface::HasBreakpoint(ProgramCounterType address) const
+{
+  const u32 location = GetBreakpointLocation(address);
+  const u32 index = location / 8;
+  return (index < m_breakpoints.size() && (m_breakpoints[index] & (1u << (location % 8))) != 0);
+}
+
+void CPUDebugInterface::SetBreakpoint(ProgramCounterType address, bool enabled)
+{
+  const u32 location = GetBreakpointLocation(address);
+  const u32 index = location / 8;
+  const u8 bit = static_cast<u8>(1u << (location % 8));
+  if (index >= m_breakpoints.size())
+  {
+    if (!enabled)
+      return;
+
+    // Sized for the whole ROM the first time, so it's only resized for a different cartridge.
+    const u32 size = ROM_LOCATION_BASE + static_cast<u32>(m_system->GetCartridge()->GetPRGROM().size());
+    m_breakpoints.resize(std::max(size, location + 1) / 8 + 1);
+  }
+
+  if (((m_breakpoints[index] & bit) != 0) == enabled)
+    return;
+
+  m_breakpoints[index] ^= bit;
+  m_breakpoint_count = enabled ? (m_breakpoint_count + 1) : (m_breakpoint_count - 1);
+  UpdateActive();
+}
+
+void CPUDebugInterface::ClearBreakpoints()
+{
+  m_breakpoints.clear();
+  m_breakpoint_count = 0;
+  UpdateActive();
+}
+
+void CPUDebugInterface::AddWatchpoint(const Watchpoint& watchpoint)
+{
+  m_watchpoints.push_back(watchpoint);
+  UpdateWatchedPages();
+}
+
+void CPUDebugInterface::RemoveWatchpoint(u32 index)
+{
+  m_watchpoints.erase(m_watchpoints.begin() + index);
+  UpdateWatchedPages();
+}
+
+void CPUDebugInterface::ClearWatchpoints()
+{
+  m_watchpoints.clear();
+  UpdateWatchedPages();
+}
+
+bool CPUDebugInterface::ParseWatchpoint(const char* text, Watchpoint* watchpoint)
+{
+  Watchpoint wp = {};
+  wp.space = AddressSpace::CPU;
+  if (std::strncmp(text, "ppu:", 4) == 0)
+  {
+    wp.space = AddressSpace::PPU;
+    text += 4;
+  }
+  else if (std::strncmp(text, "cpu:", 4) == 0)
+  {
+    text += 4;
+  }
+
+  for (; *text != ':'; text++)
+  {
+    switch (*text)
+    {
+      case 'r':
+        wp.flags |= Bus::WATCH_READ;
+        break;
+      case 'w':
+        wp.flags |= Bus::WATCH_WRITE;
+        break;
+      case 'x':
+        wp.flags |= Bus::WATCH_EXECUTE;
+        break;
+      default:
+        return false;
+    }
+  }
+  if (wp.flags == 0 || (wp.space == AddressSpace::PPU && (wp.flags & Bus::WATCH_EXECUTE)))
+    return false;
+
+  const unsigned long max_address = (wp.space == AddressSpace::PPU) ? 0x3FFF : 0xFFFF;
+  const char* start = text + 1;
+  char* end;
+  const unsigned long start_address = std::strtoul(start, &end, 16);
+  unsigned long end_address = start_address;
+  if (end == start || start_address > max_address)
+    return false;
+
+  if (*end == '-')
+  {
+    start = end + 1;
+    end_address = std::strtoul(start, &end, 16);
+    if (end == start || end_address < start_address || end_address > max_address)
+      return false;
+  }
+
+  if (*end == '=')
+  {
+    start = end + 1;
+    const unsigned long value = std::strtoul(start, &end, 16);
+    if (end == start || value > 0xFF)
+      return false;
+
+    wp.match_value = true;
+    wp.value = static_cast<u8>(value);
+  }
+
+  if (*end != '\0')
+    return false;
+
+  wp.start_address = static_cast<u16>(start_address);
+  wp.end_address = static_cast<u16>(end_address);
+  *watchpoint = wp;
+  return true;
+}
+
+void CPUDebugInterface::UpdateWatchedPages()
+{
+  Bus* bus = m_system->GetBus();
+  bus->ClearPageWatchFlags();
+  m_watching_execute = false;
+  for (const Watchpoint& wp : m_watchpoints)
+  {
+    for (u32 page = wp.start_address >> 8; page <= u32(wp.end_address >> 8); page++)
+    {
+      if (wp.space == AddressSpace::PPU)
+      {
+        bus->AddPPUPageWatchFlags(page, wp.flags);
+      }
+      else if (page < 0x20)
+      {
+        // RAM is mirrored every 2KB up to $2000.
+        for (u32 mirror_page = page & 0x07; mirror_page < 0x20; mirror_page += 0x08)
+          bus->AddCPUPageWatchFlags(mirror_page, wp.flags);
+      }
+      else
+      {
+        bus->AddCPUPageWatchFlags(page, wp.flags);
+      }
+    }
+
+    m_watching_execute |= ((wp.flags & Bus::WATCH_EXECUTE) != 0);
+  }
+
+  bus->SetWatchpointHandler(m_watchpoints.empty() ? nullptr : this);
+  UpdateActive();
+}
+
+static bool WatchpointContains(const CPUDebugInterface::Watchpoint& wp, u16 address)
+{
+  if (wp.space == CPUDebugInterface::AddressSpace::CPU && address < 0x2000)
+  {
+    for (u32 mirror = address & 0x7FF; mirror < 0x2000; mirror += 0x800)
+    {
+      if (mirror >= wp.start_address && mirror <= wp.end_address)
+        return true;
+    }
+
+    return false;
+  }
+
+  return (address >= wp.start_address && address <= wp.end_address);
+}
+
+bool CPUDebugInterface::CheckWatchpoints(AddressSpace space, u8 flag, u16 address, u8 value)
+{
+  for (const Watchpoint& wp : m_watchpoints)
+  {
+    if (wp.space != space || (wp.flags & flag) == 0 || (wp.match_value && wp.value != value) ||
+        !WatchpointContains(wp, address))
+    {
+      continue;
+    }
+
+    m_watchpoint_hit.space = space;
+    m_watchpoint_hit.flag = flag;
+    m_watchpoint_hit.pc = m_instruction_pc;
+    m_watchpoint_hit.address = address;
+    m_watchpoint_hit.new_value = value;
+    if (flag != Bus::WATCH_WRITE)
+      m_watchpoint_hit.old_value = value;
+    else if (space == AddressSpace::CPU)
+      m_watchpoint_hit.old_value = ReadMemoryByte(address);
+    else
+      m_watchpoint_hit.old_value = ReadPPUMemoryByte(address);
+
+    Break();
+    m_watchpoint_hit_valid = true;
+    return true;
+  }
+
+  return false;
+}
+
+void CPUDebugInterface::OnWatchedAccess(AddressSpace space, u8 flag, u16 address, u8 value)
+{
+  // Only the first hit is reported. Later accesses, such as by the PPU catching up, aren't.
+  if (!m_stopped)
+    CheckWatchpoints(space, flag, address, value);
+}
+
+void CPUDebugInterface::Break()
+{
+  m_stopped = true;
+  m_stopped_at_check = false;
+  m_step_mode = StepMode::None;
+  UpdateActive();
+}
+
+void CPUDebugInterface::Continue()
+{
+  Resume(StepMode::None);
+}
+
+void CPUDebugInterface::StepInto()
+{
+  Resume(StepMode::StepInto);
+}
+
+void CPUDebugInterface::StepOver()
+{
+  // JSR pushes the address of its last byte, so the call has returned once the stack is back where it started.
+  const CPU::Registers* registers = GetRegisters();
+  if (ReadMemoryByte(registers->PC) != 0x20)
+  {
+    Resume(StepMode::StepInto);
+    return;
+  }
+
+  m_target_address = registers->PC + 3;
+  m_target_stack_pointer = registers->S;
+  Resume(StepMode::StepOver);
+}
+
+void CPUDebugInterface::StepOut()
+{
+  // Returning pops the return address, leaving the stack above where it is now. Pulls can do the same, so it only
+  // counts after RTS or RTI.
+  m_target_stack_pointer = GetRegisters()->S;
+  m_returning = false;
+  Resume(StepMode::StepOut);
+}
+
+void CPUDebugInterface::RunToAddress(ProgramCounterType address)
+{
+  m_target_address = address;
+  Resume(StepMode::RunToAddress);
+}
+
+void CPUDebugInterface::Resume(StepMode mode)
+{
+  if (m_stopped)
+  {
+    m_resuming = true;
+    m_skip_next_breakpoint = m_stopped_at_check;
+  }
+
+  m_stopped = false;
+  m_watchpoint_hit_valid = false;
+  m_step_mode = mode;
+  UpdateActive();
+}
+
+bool CPUDebugInterface::CheckBreak(u16 pc, u8 sp)
+{
+  if (m_stopped)
+    return true;
+
+  m_instruction_pc = pc;
+  const bool resuming = m_resuming;
+  const bool skip_breakpoint = m_skip_next_breakpoint;
+  m_resuming = false;
+  m_skip_next_breakpoint = false;
+
+  bool stop;
+  switch (m_step_mode)
+  {
+    case StepMode::StepInto:
+      stop = true;
+      break;
+
+    case StepMode::StepOver:
+      stop = (pc == m_target_address && sp >= m_target_stack_pointer);
+      break;
+
+    case StepMode::StepOut:
+    {
+      stop = (m_returning && sp > m_target_stack_pointer);
+      const u8 opcode = ReadMemoryByte(pc);
+      m_returning = (opcode == 0x60 || opcode == 0x40);
+    }
+    break;
+
+    case StepMode::RunToAddress:
+      stop = (pc == m_target_address);
+      break;
+
+    default:
+      stop = false;
+      break;
+  }
+
+  // A step never stops where it started. Breakpoints are only skipped there if one stopped execution, as a stop after a
+  // watched access or a Break() call comes before the instruction was checked.
+  if (stop && !resuming)
+  {
+    Break();
+  }
+  else if (skip_breakpoint)
+  {
+    return false;
+  }
+  else if (m_breakpoint_count > 0 && HasBreakpoint(pc))
+  {
+    Break();
+  }
+  else
+  {
+    const bool watched =
+      (m_watching_execute && (m_system->GetBus()->GetCPUPageWatchFlags(pc) & Bus::WATCH_EXECUTE) != 0);
+    if (!watched || !CheckWatchpoints(AddressSpace::CPU, Bus::WATCH_EXECUTE, pc, ReadMemoryByte(pc)))
+      return false;
+  }
+
+  m_stopped_at_check = true;
+  return true;
+}
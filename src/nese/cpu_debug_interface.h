@@ -1,8 +1,165 @@
 #pragma once
+#include "bus.h"
+#include "cpu.h"
 #include "types.h"
+#include <vector>
 
+class String;
+class System;
+
+// Breakpoints and execution control for the debugger. Every system has one, which the CPU consults only while it's
+// active, meaning a breakpoint is set, a step is in progress or execution is stopped; otherwise the CPU runs its normal
+// loop. When a breakpoint or step completes, execution stops before the next instruction, the PPU and APU are caught
+// up, and System::FrameStep() returns part-way through the frame. Stepping resumes it from there.
+//
+// Breakpoints in ROM are bank-aware: they're set on the ROM byte mapped at the address at the time, so they only fire
+// while that bank is mapped. Elsewhere, such as code copied to RAM, they're set on the CPU address.
+//
+// Watchpoints flag the pages they cover in the bus, which passes accesses to those pages here, so unwatched memory
+// doesn't slow down. A hit stops execution after the instruction making the access, or before one being executed.
+//
+// Like the rest of the system, this belongs to the thread running it. Frontends on another thread should only read
+// state while execution is stopped, and pass everything else over to the system's thread.
 class CPUDebugInterface
 {
 public:
   using ProgramCounterType = uint16;
+
+  enum class AddressSpace : u8
+  {
+    CPU,
+    PPU
+  };
+
+  // Watches a range of addresses for any of the Bus::WATCH_FLAG accesses, optionally only those reading or writing a
+  // value. Execute only applies to the CPU, and matches the opcode. CPU RAM mirrors are watched along with it. The
+  // palette isn't on the bus, so can't be watched.
+  struct Watchpoint
+  {
+    AddressSpace space;
+    u8 flags;
+    u16 start_address;
+    u16 end_address; // Inclusive.
+    bool match_value;
+    u8 value;
+  };
+
+  struct WatchpointHit
+  {
+    AddressSpace space;
+    u8 flag;
+    u16 pc; // Instruction making the access.
+    u16 address;
+    u8 old_value; // Same as the new value for reads and executes.
+    u8 new_value;
+  };
+
+  explicit CPUDebugInterface(System* system);
+  ~CPUDebugInterface();
+
+  bool IsActive() const { return m_active; }
+  bool IsStopped() const { return m_stopped; }
+
+  const CPU::Registers* GetRegisters() const;
+  ProgramCounterType GetProgramCounter() const { return GetRegisters()->PC; }
+
+  // Reads memory without side effects. Registers read as zero.
+  u8 ReadMemoryByte(u16 address) const;
+  u8 ReadPPUMemoryByte(u16 address) const;
+
+  // Disassembles the instruction at the address, giving its length in bytes.
+  bool DisassembleInstruction(ProgramCounterType address, String* text, u16* size) const;
+
+  // Breakpoints are keyed by location, which identifies the ROM byte or CPU address an address currently refers to.
+  u32 GetBreakpointLocation(ProgramCounterType address) const;
+  bool HasBreakpoint(ProgramCounterType address) const;
+  void SetBreakpoint(ProgramCounterType address, bool enabled);
+  void ClearBreakpoints();
+  u32 GetBreakpointCount() const { return m_breakpoint_count; }
+
+  const std::vector<Watchpoint>& GetWatchpoints() const { return m_watchpoints; }
+  void AddWatchpoint(const Watchpoint& watchpoint);
+  void RemoveWatchpoint(u32 index);
+  void ClearWatchpoints();
+
+  // The watchpoint hit which stopped execution, or null if it stopped for another reason.
+  const WatchpointHit* GetWatchpointHit() const { return m_watchpoint_hit_valid ? &m_watchpoint_hit : nullptr; }
+
+  // Parses "[ppu:]<r|w|x>...:<start>[-<end>][=<value>]", in hex, e.g. "w:0300-03FF=00". Returns false if invalid.
+  static bool ParseWatchpoint(const char* text, Watchpoint* watchpoint);
+
+  // Stops before the next instruction.
+  void Break();
+
+  // Resumes execution, until a breakpoint is hit.
+  void Continue();
+
+  // Resumes for one instruction, or into an interrupt handler if one is taken first.
+  void StepInto();
+
+  // As StepInto(), except a subroutine call runs until it returns.
+  void StepOver();
+
+  // Runs until the current subroutine or interrupt handler returns.
+  void StepOut();
+
+  // Runs until the instruction at the address, in any bank.
+  void RunToAddress(ProgramCounterType address);
+
+  // Called by the CPU before each instruction or interrupt while active. Returns true if execution should stop.
+  bool CheckBreak(u16 pc, u8 sp);
+
+  // Called by the bus for accesses to watched pages, before writes happen.
+  void OnWatchedAccess(AddressSpace space, u8 flag, u16 address, u8 value);
+
+private:
+  // Locations at and above this are offsets into PRG ROM, below are CPU addresses.
+  static const u32 ROM_LOCATION_BASE = 0x10000;
+
+  enum class StepMode : u8
+  {
+    None,
+    StepInto,
+    StepOver,
+    StepOut,
+    RunToAddress
+  };
+
+  void Resume(StepMode mode);
+  void UpdateActive()
+  {
+    m_active = (m_stopped || m_step_mode != StepMode::None || m_breakpoint_count > 0 || !m_watchpoints.empty());
+  }
+
+  // Flags the pages covered by watchpoints in the bus, and only sets its handler if there are any.
+  void UpdateWatchedPages();
+  bool CheckWatchpoints(AddressSpace space, u8 flag, u16 address, u8 value);
+
+  System* m_system;
+
+  // One bit per location.
+  std::vector<u8> m_breakpoints;
+  u32 m_breakpoint_count = 0;
+
+  std::vector<Watchpoint> m_watchpoints;
+  WatchpointHit m_watchpoint_hit = {};
+  bool m_watchpoint_hit_valid = false;
+  bool m_watching_execute = false;
+  u16 m_instruction_pc = 0;
+
+  StepMode m_step_mode = StepMode::None;
+  u16 m_target_address = 0;
+  u8 m_target_stack_pointer = 0;
+  bool m_returning = false; // The instruction being stepped out of returns.
+
+  bool m_active = false;
+  bool m_stopped = false;
+
+  // Set when CheckBreak() stopped execution, rather than a watched access or Break().
+  bool m_stopped_at_check = false;
+
+  // Cover the instruction execution resumes at, so a step doesn't stop before it's run, nor a breakpoint which was just
+  // hit.
+  bool m_resuming = false;
+  bool m_skip_next_breakpoint = false;
 };
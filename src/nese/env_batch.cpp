@@ -0,0 +1,225 @@
+#include "env_batch.h"
+#include "YBaseLib/Log.h"
+#include "bus.h"
+#include "cartridge.h"
+#include "controller.h"
+#include "ppu.h"
+#include "system.h"
+#include <cstring>
+Log_SetChannel(EnvBatch);
+
+struct EnvBatch::Env
+{
+  std::unique_ptr<Cartridge> cart;
+  StandardController controller;
+  System system;
+
+  // Palette indices of the last rendered frame.
+  std::vector<u8> frame;
+
+  float reward = 0.0f;
+  bool done = false;
+};
+
+EnvBatch::EnvBatch() = default;
+
+EnvBatch::~EnvBatch() = default;
+
+System* EnvBatch::GetSystem(u32 index)
+{
+  return &m_envs[index]->system;
+}
+
+bool EnvBatch::Initialize(const Cartridge* cart, const Config& config)
+{
+  if (config.num_envs == 0 || config.frame_skip == 0 || config.observation_width == 0 ||
+      config.observation_width > PPU::SCREEN_WIDTH || config.observation_height == 0 ||
+      config.observation_height > PPU::SCREEN_HEIGHT)
+  {
+    Log_ErrorPrintf("Invalid environment configuration");
+    return false;
+  }
+
+  m_config = config;
+  m_pool = std::make_unique<WorkStealingPool>(config.num_threads);
+
+  for (u32 i = 0; i < config.num_envs; i++)
+  {
+    std::unique_ptr<Env> env = std::make_unique<Env>();
+    env->cart = cart->Clone();
+    env->frame.resize(PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT);
+
+    // Without audio, the APU only keeps time and synthesizes nothing.
+    if (!env->system.Initialize(nullptr, nullptr, env->cart.get()))
+      return false;
+
+    env->system.SetController(0, &env->controller);
+    env->system.GetPPU()->SetIndexedOutput(env->frame.data());
+    env->system.Reset();
+    m_envs.push_back(std::move(env));
+
+    m_tasks.push_back(i);
+  }
+
+  // Each observation pixel averages a block of the frame.
+  const u32 channels = (config.observation_format == ObservationFormat::RGB) ? 3 : 1;
+  m_observation_size = (config.observation_format == ObservationFormat::None) ?
+                         0 :
+                         (config.observation_width * config.observation_height * channels);
+  m_column_starts.resize(config.observation_width + 1);
+  for (u32 x = 0; x <= config.observation_width; x++)
+    m_column_starts[x] = static_cast<u16>(x * PPU::SCREEN_WIDTH / config.observation_width);
+  m_row_starts.resize(config.observation_height + 1);
+  for (u32 y = 0; y <= config.observation_height; y++)
+    m_row_starts[y] = static_cast<u16>(y * PPU::SCREEN_HEIGHT / config.observation_height);
+
+  for (u32 i = 0; i < countof(m_palette_gray); i++)
+  {
+    const u32 color = PPU::GetPaletteColor(static_cast<u8>(i));
+    const u32 r = color & 0xFF;
+    const u32 g = (color >> 8) & 0xFF;
+    const u32 b = (color >> 16) & 0xFF;
+    m_palette_rgb[i][0] = static_cast<u8>(r);
+    m_palette_rgb[i][1] = static_cast<u8>(g);
+    m_palette_rgb[i][2] = static_cast<u8>(b);
+    m_palette_gray[i] = static_cast<u8>((r * 299 + g * 587 + b * 114) / 1000);
+  }
+
+  // Start from power-on.
+  return m_envs[0]->system.SaveState(&m_start_state) && CaptureStartState();
+}
+
+bool EnvBatch::SetStartState(const std::vector<u8>& state)
+{
+  m_start_state = state;
+  return CaptureStartState();
+}
+
+bool EnvBatch::CaptureStartState()
+{
+  // Run a frame from the state in the first environment to render it, then start from that frame instead, so that the
+  // frame matches the state.
+  Env* env = m_envs[0].get();
+  if (!env->system.LoadState(m_start_state))
+  {
+    Log_ErrorPrintf("Failed to load start state");
+    return false;
+  }
+
+  for (u8 button = 0; button < StandardController::NUM_BUTTONS; button++)
+    env->controller.SetButtonState(button, false);
+
+  env->system.SetVideoEnabled(true);
+  env->system.FrameStep();
+  m_start_frame = env->frame;
+  return env->system.SaveState(&m_start_state);
+}
+
+void EnvBatch::ResetEnv(Env* env)
+{
+  env->system.LoadState(m_start_state);
+  std::memcpy(env->frame.data(), m_start_frame.data(), m_start_frame.size());
+  env->reward = 0.0f;
+  env->done = false;
+}
+
+void EnvBatch::Reset(const Output& output)
+{
+  m_step_output = output;
+  m_pool->Run(m_tasks.data(), static_cast<u32>(m_tasks.size()), [this](u32 index) {
+    ResetEnv(m_envs[index].get());
+    WriteOutput(index);
+  });
+}
+
+void EnvBatch::Step(const u8* actions, const Output& output)
+{
+  // The task only captures this, so that the std::function doesn't allocate.
+  m_step_actions = actions;
+  m_step_output = output;
+  m_pool->Run(m_tasks.data(), static_cast<u32>(m_tasks.size()), [this](u32 index) { StepEnv(index); });
+}
+
+void EnvBatch::StepEnv(u32 index)
+{
+  Env* env = m_envs[index].get();
+  if (env->done)
+    ResetEnv(env);
+
+  const u8 action = m_step_actions[index];
+  for (u8 button = 0; button < StandardController::NUM_BUTTONS; button++)
+    env->controller.SetButtonState(button, (action & (1 << button)) != 0);
+
+  // Only the last frame is seen.
+  for (u32 i = 0; i < m_config.frame_skip; i++)
+  {
+    env->system.SetVideoEnabled(m_observation_size > 0 && i == (m_config.frame_skip - 1));
+    env->system.FrameStep();
+  }
+
+  env->reward = 0.0f;
+  if (m_reward_function)
+    env->reward = m_reward_function(index, &env->system, &env->done);
+
+  WriteOutput(index);
+}
+
+void EnvBatch::WriteOutput(u32 index)
+{
+  const Env* env = m_envs[index].get();
+  if (m_step_output.observations && m_observation_size > 0)
+    WriteObservation(env->frame.data(), m_step_output.observations + index * m_observation_size);
+  if (m_step_output.wram)
+    std::memcpy(m_step_output.wram + index * Bus::WRAM_SIZE, env->system.GetBus()->GetWRAM(), Bus::WRAM_SIZE);
+  if (m_step_output.rewards)
+    m_step_output.rewards[index] = env->reward;
+  if (m_step_output.dones)
+    m_step_output.dones[index] = env->done ? 1 : 0;
+}
+
+void EnvBatch::WriteObservation(const u8* frame, u8* observation) const
+{
+  const bool rgb = (m_config.observation_format == ObservationFormat::RGB);
+  for (u32 y = 0; y < m_config.observation_height; y++)
+  {
+    const u32 row_start = m_row_starts[y];
+    const u32 row_end = m_row_starts[y + 1];
+    for (u32 x = 0; x < m_config.observation_width; x++)
+    {
+      const u32 column_start = m_column_starts[x];
+      const u32 column_end = m_column_starts[x + 1];
+      const u32 count = (row_end - row_start) * (column_end - column_start);
+
+      u32 sum[3] = {};
+      for (u32 sy = row_start; sy < row_end; sy++)
+      {
+        const u8* src = frame + sy * PPU::SCREEN_WIDTH;
+        for (u32 sx = column_start; sx < column_end; sx++)
+        {
+          if (rgb)
+          {
+            const u8* color = m_palette_rgb[src[sx]];
+            sum[0] += color[0];
+            sum[1] += color[1];
+            sum[2] += color[2];
+          }
+          else
+          {
+            sum[0] += m_palette_gray[src[sx]];
+          }
+        }
+      }
+
+      if (rgb)
+      {
+        *(observation++) = static_cast<u8>(sum[0] / count);
+        *(observation++) = static_cast<u8>(sum[1] / count);
+        *(observation++) = static_cast<u8>(sum[2] / count);
+      }
+      else
+      {
+        *(observation++) = static_cast<u8>(sum[0] / count);
+      }
+    }
+  }
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include "common/work_stealing_pool.h"
+#include "types.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+class Cartridge;
+class System;
+
+// Runs many copies of one game in lockstep for reinforcement learning. Each step applies one action per environment,
+// runs every environment for a number of frames on a thread pool, and writes the results into buffers provided by the
+// caller, one entry per environment laid out contiguously. Frames are rendered as palette indices straight from the
+// PPU, and only on the last frame of each step, so there is no display and the only per-pixel work is downscaling the
+// observation. Nothing is allocated once initialized.
+class EnvBatch
+{
+public:
+  enum class ObservationFormat : u8
+  {
+    None,
+    Grayscale, // One byte per pixel.
+    RGB        // Three bytes per pixel, red first.
+  };
+
+  struct Config
+  {
+    u32 num_envs = 1;
+    u32 num_threads = 0; // Zero for one per core.
+    u32 frame_skip = 4;  // Frames emulated per step, with the action held.
+    ObservationFormat observation_format = ObservationFormat::Grayscale;
+    u32 observation_width = 84;
+    u32 observation_height = 84;
+  };
+
+  // Buffers filled by Reset() and Step(). Any may be null if not wanted.
+  struct Output
+  {
+    u8* observations; // num_envs * GetObservationSize() bytes.
+    u8* wram;         // num_envs * Bus::WRAM_SIZE bytes.
+    float* rewards;   // num_envs values.
+    u8* dones;        // num_envs flags.
+  };
+
+  // Called at the end of each step, on the worker thread running that environment, to compute the reward and whether
+  // the episode is over from the game's state. Must only use the system it is given.
+  using RewardFunction = std::function<float(u32 env_index, System* system, bool* done)>;
+
+  EnvBatch();
+  ~EnvBatch();
+
+  u32 GetEnvCount() const { return static_cast<u32>(m_envs.size()); }
+  u32 GetObservationSize() const { return m_observation_size; }
+  System* GetSystem(u32 index);
+
+  // Each environment gets its own copy of the cartridge, sharing the ROM. The start state is the console just after
+  // power-on.
+  bool Initialize(const Cartridge* cart, const Config& config);
+
+  // Replaces the state environments start from, typically one saved past the title screen. One frame is run from it
+  // with no input to render the first observation, so episodes begin from the frame after.
+  bool SetStartState(const std::vector<u8>& state);
+
+  void SetRewardFunction(RewardFunction func) { m_reward_function = std::move(func); }
+
+  // Returns every environment to the start state, and writes the first observations and WRAM. Rewards and done flags
+  // are cleared. Must be called before the first step.
+  void Reset(const Output& output);
+
+  // Advances every environment by frame_skip frames with controller 1 holding the action's buttons, where bit N is
+  // StandardController button N. An environment which finished in the previous step is reset first, so an episode's
+  // last observation is the one returned with its done flag.
+  void Step(const u8* actions, const Output& output);
+
+private:
+  struct Env;
+
+  void ResetEnv(Env* env);
+  void StepEnv(u32 index);
+  void WriteOutput(u32 index);
+  void WriteObservation(const u8* frame, u8* observation) const;
+  bool CaptureStartState();
+
+  Config m_config;
+  std::vector<std::unique_ptr<Env>> m_envs;
+  std::unique_ptr<WorkStealingPool> m_pool;
+  RewardFunction m_reward_function;
+
+  // The state every episode begins from, and the frame it shows.
+  std::vector<u8> m_start_state;
+  std::vector<u8> m_start_frame;
+
+  // Source rectangle for each observation column and row, and the colour of each palette entry.
+  u32 m_observation_size = 0;
+  std::vector<u16> m_column_starts;
+  std::vector<u16> m_row_starts;
+  u8 m_palette_gray[64];
+  u8 m_palette_rgb[64][3];
+
+  // Valid during Step() and Reset(), for the worker threads.
+  const u8* m_step_actions = nullptr;
+  Output m_step_output = {};
+  std::vector<u32> m_tasks;
+};
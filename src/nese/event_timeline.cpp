@@ -0,0 +1,217 @@
+#include "event_timeline.h"
+#include "YBaseLib/Log.h"
+#include "apu.h"
+#include "bus.h"
+#include "ppu.h"
+#include <algorithm>
+#include <cstdio>
+Log_SetChannel(EventTimeline);
+
+EventTimeline::EventTimeline(const Bus* bus, const PPU* ppu, u32 capacity /* = DEFAULT_CAPACITY */)
+  : m_bus(bus), m_ppu(ppu), m_events(std::max(capacity, 1u))
+{
+}
+
+EventTimeline::~EventTimeline() = default;
+
+void EventTimeline::Clear()
+{
+  m_head = 0;
+  m_count = 0;
+}
+
+void EventTimeline::Record(Type type, u16 address /* = 0 */, u8 value /* = 0 */, u32 data /* = 0 */)
+{
+  Event* event;
+  if (m_count < m_events.size())
+  {
+    event = &m_events[(m_head + m_count) % m_events.size()];
+    m_count++;
+  }
+  else
+  {
+    // Full, overwrite the oldest.
+    event = &m_events[m_head];
+    m_head = (m_head + 1) % static_cast<u32>(m_events.size());
+  }
+
+  // Cycles the CPU has run which the PPU and APU haven't caught up with yet.
+  event->time = m_time + static_cast<u64>(m_syncing ? 0 : m_bus->GetPendingCycles());
+  event->data = data;
+  event->scanline = static_cast<u16>(m_ppu->GetCurrentScanline());
+  event->dot = static_cast<u16>(m_ppu->GetCurrentCycle());
+  event->address = address;
+  event->value = value;
+  event->type = type;
+}
+
+bool EventTimeline::WriteChromeTrace(const char* filename) const
+{
+  std::FILE* fp = std::fopen(filename, "w");
+  if (!fp)
+  {
+    Log_ErrorPrintf("Failed to open '%s' for writing", filename);
+    return false;
+  }
+
+  enum Track : u32
+  {
+    TrackFrames = 1,
+    TrackCPU,
+    TrackInterrupts,
+    TrackPPU,
+    TrackAPU,
+    TrackMapper
+  };
+  static const char* track_names[] = {"", "Frames", "CPU", "Interrupt lines", "PPU", "APU", "Mapper"};
+  static const char* irq_source_names[] = {"APU", "Mapper"}; // Indexed by Bus::IRQSource.
+  static const char* ppu_register_names[] = {"PPUCTRL", "PPUMASK",   "PPUSTATUS", "OAMADDR",
+                                             "OAMDATA", "PPUSCROLL", "PPUADDR",   "PPUDATA"};
+
+  std::fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  std::fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"nese\"}}");
+  for (u32 track = TrackFrames; track <= TrackMapper; track++)
+  {
+    std::fprintf(fp,
+                 ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}"
+                 ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+                 track, track_names[track], track, track);
+  }
+
+  // Timestamps are in microseconds of emulated time.
+  const auto to_us = [](u64 cycles) { return double(cycles) * 1000000.0 / double(APU::CPU_CLOCK_RATE); };
+
+  // A span from start to the event, or an instant if start is null. Every event has its position in the frame.
+  const auto write_event = [fp, &to_us](const char* name, u32 track, const Event& e, const Event* start,
+                                        const char* extra_args) {
+    const Event& first = start ? *start : e;
+    std::fprintf(fp, ",\n{\"name\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.4f,", name, track, to_us(first.time));
+    if (start)
+      std::fprintf(fp, "\"ph\":\"X\",\"dur\":%.4f,", to_us(e.time - start->time));
+    else
+      std::fprintf(fp, "\"ph\":\"i\",\"s\":\"t\",");
+
+    std::fprintf(fp, "\"args\":{\"cycle\":%llu,\"scanline\":%u,\"dot\":%u%s}}",
+                 static_cast<unsigned long long>(first.time), first.scanline, first.dot, extra_args);
+  };
+
+  const Event* last_frame = nullptr;
+  const Event* nmi_raise = nullptr;
+  const Event* irq_assert[countof(irq_source_names)] = {};
+  char name[64];
+  char args[128];
+  for (u32 i = 0; i < m_count; i++)
+  {
+    const Event& e = GetEvent(i);
+    args[0] = '\0';
+    switch (e.type)
+    {
+      case Type::Frame:
+      {
+        if (last_frame)
+        {
+          std::snprintf(name, sizeof(name), "Frame %u", e.data);
+          write_event(name, TrackFrames, e, last_frame, args);
+        }
+        last_frame = &e;
+      }
+      break;
+
+      case Type::NMIRaise:
+        nmi_raise = &e;
+        break;
+
+      case Type::NMIClear:
+      {
+        if (nmi_raise)
+          write_event("NMI line", TrackInterrupts, e, nmi_raise, args);
+        nmi_raise = nullptr;
+      }
+      break;
+
+      case Type::IRQAssert:
+        irq_assert[e.value] = &e;
+        break;
+
+      case Type::IRQClear:
+      {
+        if (irq_assert[e.value])
+        {
+          std::snprintf(name, sizeof(name), "IRQ line (%s)", irq_source_names[e.value]);
+          write_event(name, TrackInterrupts, e, irq_assert[e.value], args);
+        }
+        irq_assert[e.value] = nullptr;
+      }
+      break;
+
+      case Type::NMITaken:
+        write_event("NMI", TrackCPU, e, nullptr, args);
+        break;
+
+      case Type::IRQTaken:
+        write_event("IRQ", TrackCPU, e, nullptr, args);
+        break;
+
+      case Type::OAMDMA:
+      {
+        // Shown as a span over the stall.
+        Event end = e;
+        end.time += e.data;
+        std::snprintf(args, sizeof(args), ",\"page\":\"$%02X\"", e.value);
+        write_event("OAM DMA", TrackCPU, end, &e, args);
+      }
+      break;
+
+      case Type::DMCStall:
+      {
+        Event end = e;
+        end.time += e.data;
+        std::snprintf(args, sizeof(args), ",\"address\":\"$%04X\"", e.address);
+        write_event("DMC fetch", TrackAPU, end, &e, args);
+      }
+      break;
+
+      case Type::PPUWrite:
+      {
+        std::snprintf(args, sizeof(args), ",\"value\":\"$%02X\"", e.value);
+        write_event(ppu_register_names[e.address & 7], TrackPPU, e, nullptr, args);
+      }
+      break;
+
+      case Type::MapperWrite:
+      {
+        std::snprintf(name, sizeof(name), "$%04X", e.address);
+        std::snprintf(args, sizeof(args), ",\"value\":\"$%02X\"", e.value);
+        write_event(name, TrackMapper, e, nullptr, args);
+      }
+      break;
+
+      default:
+        break;
+    }
+  }
+
+  // Lines still high run to the end.
+  if (m_count > 0)
+  {
+    const Event& last = GetEvent(m_count - 1);
+    if (nmi_raise)
+      write_event("NMI line", TrackInterrupts, last, nmi_raise, "");
+    for (u32 source = 0; source < countof(irq_source_names); source++)
+    {
+      if (irq_assert[source])
+      {
+        std::snprintf(name, sizeof(name), "IRQ line (%s)", irq_source_names[source]);
+        write_event(name, TrackInterrupts, last, irq_assert[source], "");
+      }
+    }
+  }
+
+  std::fprintf(fp, "\n]}\n");
+  const bool result = (std::ferror(fp) == 0);
+  std::fclose(fp);
+  if (!result)
+    Log_ErrorPrintf("Failed to write '%s'", filename);
+
+  return result;
+}
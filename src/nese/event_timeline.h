@@ -0,0 +1,84 @@
+#pragma once
+#include "types.h"
+#include <vector>
+
+class Bus;
+class PPU;
+
+// Records hardware events with their emulated time, for viewing the timing structure of frames: where the CPU is
+// stalled, when interrupts are raised and taken, and how register writes line up with the raster. Enabled with
+// System::SetEventTimelineEnabled(). Events go into a ring, so the most recent are kept, and can be written out in the
+// Chrome trace format, which Perfetto and chrome://tracing open.
+//
+// Time is counted in CPU cycles since recording started, and carries on across resets and state loads. Events are
+// stamped with the cycle the CPU has reached, except those raised while the PPU and APU are catching up with it,
+// which are placed at the start of the catch-up. Each event also carries the PPU's scanline and dot.
+//
+// Run-ahead's speculative frames aren't recorded: the system detaches the timeline while they run, so its clock and
+// frame numbers only follow the frames which are kept.
+class EventTimeline
+{
+public:
+  static const u32 DEFAULT_CAPACITY = 256 * 1024;
+
+  enum class Type : u8
+  {
+    Frame,       // The PPU finished a frame. Data is the frame number.
+    NMIRaise,    // The NMI line went high.
+    NMIClear,    // The NMI line went low.
+    NMITaken,    // The CPU started its NMI handler.
+    IRQAssert,   // A source asserted the IRQ line. Value is the Bus::IRQSource.
+    IRQClear,    // A source released the IRQ line. Value is the Bus::IRQSource.
+    IRQTaken,    // The CPU started its IRQ handler.
+    OAMDMA,      // Sprite DMA. Value is the source page, data is the stall in cycles.
+    DMCStall,    // The DMC fetched a sample byte. Address is the sample address, data is the stall in cycles.
+    PPUWrite,    // Write to a PPU register. Address is the register, 0-7.
+    MapperWrite, // Write to the cartridge at $8000 and up, which is how mappers switch banks.
+    Count
+  };
+
+  struct Event
+  {
+    u64 time;
+    u32 data;
+    u16 scanline;
+    u16 dot;
+    u16 address;
+    u8 value;
+    Type type;
+  };
+
+  EventTimeline(const Bus* bus, const PPU* ppu, u32 capacity = DEFAULT_CAPACITY);
+  ~EventTimeline();
+
+  // Events held, oldest first.
+  u32 GetEventCount() const { return m_count; }
+  const Event& GetEvent(u32 index) const { return m_events[(m_head + index) % m_events.size()]; }
+
+  void Clear();
+
+  void Record(Type type, u16 address = 0, u8 value = 0, u32 data = 0);
+
+  // Called by the bus around catching the PPU and APU up with the CPU, to advance the clock.
+  void BeginSync() { m_syncing = true; }
+  void EndSync(CycleCount cycles)
+  {
+    m_time += static_cast<u64>(cycles);
+    m_syncing = false;
+  }
+
+  // Writes the events in the Chrome trace event format, with a track each for frames, the CPU, interrupt lines, the
+  // PPU, the APU and the mapper. Line states and stalls are shown as spans, with one per IRQ source.
+  bool WriteChromeTrace(const char* filename) const;
+
+private:
+  const Bus* m_bus;
+  const PPU* m_ppu;
+
+  std::vector<Event> m_events;
+  u32 m_head = 0;
+  u32 m_count = 0;
+
+  u64 m_time = 0;
+  bool m_syncing = false;
+};
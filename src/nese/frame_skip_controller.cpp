@@ -0,0 +1,63 @@
+#include "frame_skip_controller.h"
+#include <algorithm>
+
+FrameSkipController::FrameSkipController() : m_frame_period(1.0 / NTSC_FRAME_RATE) {}
+
+void FrameSkipController::Reset()
+{
+  m_has_last_frame_time = false;
+  m_skipped_in_a_row = 0;
+  m_lag = 0.0;
+}
+
+bool FrameSkipController::BeginFrame()
+{
+  const Timer::Value now = Timer::GetValue();
+  if (m_has_last_frame_time)
+  {
+    const double frame_time = Timer::ConvertValueToSeconds(now - m_last_frame_time);
+    if (m_last_frame_rendered)
+    {
+      m_stats_rendered_frames++;
+      m_stats_rendered_time += frame_time;
+    }
+    else
+    {
+      m_stats_skipped_frames++;
+      m_stats_skipped_time += frame_time;
+    }
+
+    // Too far behind to catch up, such as after a stall, so let the time go rather than skipping a burst of frames.
+    m_lag = std::max(m_lag + frame_time - m_frame_period, 0.0);
+    if (m_lag > m_frame_period * double(m_max_skipped_frames + 1))
+      m_lag = 0.0;
+  }
+  else
+  {
+    m_stats_start_time = now;
+  }
+
+  m_last_frame_time = now;
+  m_has_last_frame_time = true;
+
+  if (Timer::ConvertValueToSeconds(now - m_stats_start_time) >= 1.0)
+  {
+    const u32 total_frames = m_stats_rendered_frames + m_stats_skipped_frames;
+    m_stats.skip_rate = (total_frames > 0) ? (float(m_stats_skipped_frames) / float(total_frames)) : 0.0f;
+    m_stats.rendered_frame_ms =
+      (m_stats_rendered_frames > 0) ? float(m_stats_rendered_time * 1000.0 / m_stats_rendered_frames) : 0.0f;
+    m_stats.skipped_frame_ms =
+      (m_stats_skipped_frames > 0) ? float(m_stats_skipped_time * 1000.0 / m_stats_skipped_frames) : 0.0f;
+
+    m_stats_start_time = now;
+    m_stats_rendered_frames = 0;
+    m_stats_skipped_frames = 0;
+    m_stats_rendered_time = 0.0;
+    m_stats_skipped_time = 0.0;
+  }
+
+  const bool render = (m_lag < m_frame_period || m_skipped_in_a_row >= m_max_skipped_frames);
+  m_skipped_in_a_row = render ? 0 : (m_skipped_in_a_row + 1);
+  m_last_frame_rendered = render;
+  return render;
+}
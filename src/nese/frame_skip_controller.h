@@ -0,0 +1,64 @@
+#pragma once
+#include "YBaseLib/Timer.h"
+#include "apu.h"
+#include "types.h"
+
+// Decides which frames a frontend renders when the host can't keep up with real time. Every frame is still emulated,
+// so audio stays continuous and timing exact, but a skipped frame runs with video disabled and isn't presented.
+//
+// The controller times each pass of the frontend's loop, including presentation and whatever paces it, and keeps
+// count of how far behind real time it has fallen. A frame is skipped while more than a frame behind, but never more
+// than the limit in a row, so the picture keeps updating however slow the host is.
+class FrameSkipController
+{
+public:
+  static const u32 DEFAULT_MAX_SKIPPED_FRAMES = 4;
+
+  // An NTSC frame is 341 * 262 - 0.5 PPU cycles, at three per CPU cycle.
+  static constexpr double NTSC_FRAME_RATE = 3.0 * double(APU::CPU_CLOCK_RATE) / (341.0 * 262.0 - 0.5);
+
+  // Averages over the last second.
+  struct Stats
+  {
+    float skip_rate;         // Fraction of frames skipped.
+    float rendered_frame_ms; // Time of a rendered frame, including presentation.
+    float skipped_frame_ms;  // Time of a skipped frame, so the difference is the cost of rendering.
+  };
+
+  FrameSkipController();
+
+  // Zero never skips.
+  u32 GetMaxSkippedFrames() const { return m_max_skipped_frames; }
+  void SetMaxSkippedFrames(u32 frames) { m_max_skipped_frames = frames; }
+
+  // Real time, per emulated frame. Defaults to the NTSC frame rate; when presentation paces the loop, it should be
+  // the display's refresh period instead.
+  void SetFramePeriod(double seconds) { m_frame_period = seconds; }
+
+  const Stats& GetStats() const { return m_stats; }
+
+  // Call at the start of each frame, and enable video for it only if this returns true.
+  bool BeginFrame();
+
+  // Forgets the time since the last frame, such as after pausing.
+  void Reset();
+
+private:
+  u32 m_max_skipped_frames = DEFAULT_MAX_SKIPPED_FRAMES;
+  double m_frame_period;
+
+  Timer::Value m_last_frame_time = 0;
+  bool m_has_last_frame_time = false;
+  bool m_last_frame_rendered = true;
+  u32 m_skipped_in_a_row = 0;
+
+  // Seconds behind real time.
+  double m_lag = 0.0;
+
+  Stats m_stats = {};
+  Timer::Value m_stats_start_time = 0;
+  u32 m_stats_rendered_frames = 0;
+  u32 m_stats_skipped_frames = 0;
+  double m_stats_rendered_time = 0.0;
+  double m_stats_skipped_time = 0.0;
+};
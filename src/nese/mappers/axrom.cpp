@@ -1,12 +1,18 @@
 #include "axrom.h"
 #include "../bus.h"
 #include "YBaseLib/Error.h"
+#include "common/state_wrapper.h"
 
 namespace Mappers {
 AxROM::AxROM() = default;
 
 AxROM::~AxROM() = default;
 
+std::unique_ptr<Cartridge> AxROM::Clone() const
+{
+  return std::make_unique<AxROM>(*this);
+}
+
 bool AxROM::Initialize(CartridgeData& data, Error* error)
 {
   if (!Cartridge::Initialize(data, error))
@@ -35,6 +41,16 @@ void AxROM::Reset()
   m_prg_base_address_8000 = PRG_ROM_BANK_SIZE;
 }
 
+bool AxROM::DoState(StateWrapper& sw)
+{
+  if (!Cartridge::DoState(sw))
+    return false;
+
+  sw.Do(&m_prg_base_address_8000);
+  sw.Do(&m_nametable_select);
+  return !sw.HasError();
+}
+
 u8 AxROM::ReadCPUAddress(Bus* bus, u16 address)
 {
   if ((address & 0x8000) == 0x8000)
@@ -53,6 +69,15 @@ void AxROM::WriteCPUAddress(Bus* bus, u16 address, u8 value)
   m_nametable_select = ZeroExtend32(value >> 4) & u32(0x01);
 }
 
+bool AxROM::GetPRGROMOffset(u16 address, u32* offset) const
+{
+  if (address < 0x8000)
+    return false;
+
+  *offset = m_prg_base_address_8000 | (address & 0x7FFF);
+  return true;
+}
+
 u8 AxROM::ReadPPUAddress(Bus* bus, u16 address)
 {
   if (address < 0x2000)
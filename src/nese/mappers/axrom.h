@@ -8,10 +8,13 @@ public:
   AxROM();
   ~AxROM() override;
 
+  std::unique_ptr<Cartridge> Clone() const override;
   void Reset() override;
+  bool DoState(StateWrapper& sw) override;
 
   u8 ReadCPUAddress(Bus* bus, u16 address) override;
   void WriteCPUAddress(Bus* bus, u16 address, u8 value) override;
+  bool GetPRGROMOffset(u16 address, u32* offset) const override;
 
   u8 ReadPPUAddress(Bus* bus, u16 address) override;
   void WritePPUAddress(Bus* bus, u16 address, u8 value) override;
@@ -1,12 +1,18 @@
 #include "gxrom.h"
 #include "../bus.h"
 #include "YBaseLib/Error.h"
+#include "common/state_wrapper.h"
 
 namespace Mappers {
 GxROM::GxROM() = default;
 
 GxROM::~GxROM() = default;
 
+std::unique_ptr<Cartridge> GxROM::Clone() const
+{
+  return std::make_unique<GxROM>(*this);
+}
+
 bool GxROM::Initialize(CartridgeData& data, Error* error)
 {
   if (!Cartridge::Initialize(data, error))
@@ -35,6 +41,16 @@ void GxROM::Reset()
   m_chr_base_address = 0;
 }
 
+bool GxROM::DoState(StateWrapper& sw)
+{
+  if (!Cartridge::DoState(sw))
+    return false;
+
+  sw.Do(&m_prg_base_address);
+  sw.Do(&m_chr_base_address);
+  return !sw.HasError();
+}
+
 u8 GxROM::ReadCPUAddress(Bus* bus, u16 address)
 {
   return m_prg_rom[m_prg_base_address | (address & 0x7FFF)];
@@ -48,6 +64,15 @@ void GxROM::WriteCPUAddress(Bus* bus, u16 address, u8 value)
   WriteBankSelect(value);
 }
 
+bool GxROM::GetPRGROMOffset(u16 address, u32* offset) const
+{
+  if (address < 0x8000)
+    return false;
+
+  *offset = m_prg_base_address | (address & 0x7FFF);
+  return true;
+}
+
 u8 GxROM::ReadPPUAddress(Bus* bus, u16 address)
 {
   // Default behavior for nametables.
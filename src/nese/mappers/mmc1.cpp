@@ -1,12 +1,18 @@
 #include "mmc1.h"
 #include "../bus.h"
 #include "YBaseLib/Error.h"
+#include "common/state_wrapper.h"
 
 namespace Mappers {
 MMC1::MMC1() = default;
 
 MMC1::~MMC1() = default;
 
+std::unique_ptr<Cartridge> MMC1::Clone() const
+{
+  return std::make_unique<MMC1>(*this);
+}
+
 bool MMC1::Initialize(CartridgeData& data, Error* error)
 {
   if (!Cartridge::Initialize(data, error))
@@ -40,6 +46,22 @@ void MMC1::Reset()
   m_prg_ram_enable = false;
 }
 
+bool MMC1::DoState(StateWrapper& sw)
+{
+  if (!Cartridge::DoState(sw))
+    return false;
+
+  sw.Do(&m_shift_register_value);
+  sw.Do(&m_shift_register_count);
+  sw.DoArray(m_regs);
+  sw.Do(&m_prg_ram_enable);
+  sw.Do(&m_base_prg_address_8000);
+  sw.Do(&m_base_prg_address_C000);
+  sw.Do(&m_base_chr_address_0000);
+  sw.Do(&m_base_chr_address_1000);
+  return !sw.HasError();
+}
+
 u8 MMC1::ReadCPUAddress(Bus* bus, u16 address)
 {
   switch (address >> 12)
@@ -100,6 +122,18 @@ void MMC1::WriteCPUAddress(Bus* bus, u16 address, u8 value)
   }
 }
 
+bool MMC1::GetPRGROMOffset(u16 address, u32* offset) const
+{
+  if (address < 0x8000)
+    return false;
+
+  if (address < 0xC000)
+    *offset = m_base_prg_address_8000 | u32(address & 0x3FFF);
+  else
+    *offset = m_base_prg_address_C000 | u32(address & 0x3FFF);
+  return true;
+}
+
 u8 MMC1::ReadPPUAddress(Bus* bus, u16 address)
 {
   if (address & 0x2000)
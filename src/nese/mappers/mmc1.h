@@ -9,10 +9,13 @@ public:
   MMC1();
   ~MMC1() override final;
 
+  std::unique_ptr<Cartridge> Clone() const override final;
   void Reset() override final;
+  bool DoState(StateWrapper& sw) override final;
 
   u8 ReadCPUAddress(Bus* bus, u16 address) override final;
   void WriteCPUAddress(Bus* bus, u16 address, u8 value) override final;
+  bool GetPRGROMOffset(u16 address, u32* offset) const override final;
 
   u8 ReadPPUAddress(Bus* bus, u16 address) override final;
   void WritePPUAddress(Bus* bus, u16 address, u8 value) override final;
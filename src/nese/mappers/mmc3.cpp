@@ -2,6 +2,7 @@
 #include "../bus.h"
 #include "YBaseLib/Error.h"
 #include "YBaseLib/Log.h"
+#include "common/state_wrapper.h"
 Log_SetChannel(Mappers::MMC3);
 
 namespace Mappers {
@@ -9,6 +10,15 @@ MMC3::MMC3() = default;
 
 MMC3::~MMC3() = default;
 
+std::unique_ptr<Cartridge> MMC3::Clone() const
+{
+  // Bank pointers refer to the ROM/RAM of this instance, so must be recomputed for the copy.
+  std::unique_ptr<MMC3> clone = std::make_unique<MMC3>(*this);
+  clone->UpdatePRGBankPointers();
+  clone->UpdateCHRBankPointers();
+  return clone;
+}
+
 bool MMC3::Initialize(CartridgeData& data, Error* error)
 {
   // Always provide PRG RAM on MMC3.
@@ -46,6 +56,32 @@ void MMC3::Reset()
   UpdateCHRBankPointers();
 }
 
+bool MMC3::DoState(StateWrapper& sw)
+{
+  if (!Cartridge::DoState(sw))
+    return false;
+
+  sw.Do(&m_bank_select_register);
+  sw.DoArray(m_bank_numbers);
+  sw.Do(&m_prg_ram_enable);
+  sw.Do(&m_prg_ram_writable);
+  sw.Do(&m_last_chr_a12);
+  sw.Do(&m_irq_reload_value);
+  sw.Do(&m_irq_counter);
+  sw.Do(&m_irq_enable);
+  if (sw.HasError())
+    return false;
+
+  // Bank pointers are derived from the registers.
+  if (sw.IsReading())
+  {
+    UpdatePRGBankPointers();
+    UpdateCHRBankPointers();
+  }
+
+  return true;
+}
+
 u8 MMC3::ReadCPUAddress(Bus* bus, u16 address)
 {
   u32 page = (address >> 12);
@@ -120,6 +156,16 @@ void MMC3::WriteCPUAddress(Bus* bus, u16 address, u8 value)
   }
 }
 
+bool MMC3::GetPRGROMOffset(u16 address, u32* offset) const
+{
+  if (address < 0x8000)
+    return false;
+
+  const byte* bank = m_prg_banks[(address >> 13) & 0x03];
+  *offset = static_cast<u32>(bank - m_prg_rom.data()) + u32(address & 0x1FFF);
+  return true;
+}
+
 u8 MMC3::ReadPPUAddress(Bus* bus, u16 address)
 {
   IRQClock(bus, address);
@@ -150,7 +196,8 @@ void MMC3::WritePPUAddress(Bus* bus, u16 address, u8 value)
     {
       // Log_DevPrintf("Write %04X -> %08X %02X", address, u32(m_chr_banks[address >> 10] - m_chr_ram.data()) + (address
       // & 0x3FF), value);
-      m_chr_banks[address >> 10][address & 0x03FF] = value;
+      // Banks point into CHR-RAM when there is no CHR-ROM, so this is writable.
+      const_cast<byte*>(m_chr_banks[address >> 10])[address & 0x03FF] = value;
     }
   }
 }
@@ -223,7 +270,7 @@ void MMC3::UpdateCHRBankPointers()
   }
 
   const u32 size = static_cast<u32>(m_chr_rom.empty() ? m_chr_ram.size() : m_chr_rom.size());
-  byte* base_ptr = m_chr_rom.empty() ? m_chr_ram.data() : m_chr_rom.data();
+  const byte* base_ptr = m_chr_rom.empty() ? m_chr_ram.data() : m_chr_rom.data();
 
   const u32 offset_0000 = ((u32(bank_0000) << 10) % size);
   const u32 offset_0400 = ((u32(bank_0400) << 10) % size);
@@ -318,7 +365,7 @@ void MMC3::WriteIRQReload(Bus* bus, u8 value)
 void MMC3::WriteIRQDisable(Bus* bus, u8 value)
 {
   m_irq_enable = false;
-  bus->SetCPUIRQLine(false);
+  bus->SetCPUIRQLine(false, Bus::IRQSource::Mapper);
 }
 
 void MMC3::WriteIRQEnable(Bus* bus, u8 value)
@@ -343,7 +390,7 @@ void MMC3::IRQClock(Bus* bus, u16 address)
       {
         m_irq_counter--;
         if (m_irq_counter == 0 && m_irq_enable)
-          bus->SetCPUIRQLine(true);
+          bus->SetCPUIRQLine(true, Bus::IRQSource::Mapper);
       }
     }
 
@@ -367,7 +414,7 @@ void MMC3::PPUScanline(Bus* bus, u32 line, bool rendering_enabled)
   {
     m_irq_counter--;
     if (m_irq_counter == 0 && m_irq_enable)
-      bus->SetCPUIRQLine(true);
+      bus->SetCPUIRQLine(true, Bus::IRQSource::Mapper);
   }
 }
 
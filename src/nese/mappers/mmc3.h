@@ -9,10 +9,13 @@ public:
   MMC3();
   ~MMC3() override final;
 
+  std::unique_ptr<Cartridge> Clone() const override final;
   void Reset() override final;
+  bool DoState(StateWrapper& sw) override final;
 
   u8 ReadCPUAddress(Bus* bus, u16 address) override final;
   void WriteCPUAddress(Bus* bus, u16 address, u8 value) override final;
+  bool GetPRGROMOffset(u16 address, u32* offset) const override final;
 
   u8 ReadPPUAddress(Bus* bus, u16 address) override final;
   void WritePPUAddress(Bus* bus, u16 address, u8 value) override final;
@@ -40,7 +43,7 @@ private:
 
   // Cached address bases.
   const byte* m_prg_banks[NUM_PRG_BANKS] = {};
-  byte* m_chr_banks[NUM_CHR_BANKS] = {};
+  const byte* m_chr_banks[NUM_CHR_BANKS] = {};
 
   u8 m_bank_select_register = 0;
   u8 m_bank_numbers[8] = {};
@@ -7,6 +7,11 @@ NROM::NROM() = default;
 
 NROM::~NROM() = default;
 
+std::unique_ptr<Cartridge> NROM::Clone() const
+{
+  return std::make_unique<NROM>(*this);
+}
+
 bool NROM::Initialize(CartridgeData& data, Error* error)
 {
   if (!Cartridge::Initialize(data, error))
@@ -39,4 +44,13 @@ u8 NROM::ReadCPUAddress(Bus* bus, u16 address)
 }
 
 void NROM::WriteCPUAddress(Bus* bus, u16 address, u8 value) {}
+
+bool NROM::GetPRGROMOffset(u16 address, u32* offset) const
+{
+  if (address < 0x8000)
+    return false;
+
+  *offset = ((address & 0xC000) == 0xC000) ? (m_prg_base_address_C000 | (address & 0x3FFF)) : (address & 0x3FFF);
+  return true;
+}
 } // namespace Mappers
@@ -8,10 +8,12 @@ public:
   NROM();
   ~NROM() override;
 
+  std::unique_ptr<Cartridge> Clone() const override;
   void Reset() override;
 
   u8 ReadCPUAddress(Bus* bus, u16 address) override;
   void WriteCPUAddress(Bus* bus, u16 address, u8 value) override;
+  bool GetPRGROMOffset(u16 address, u32* offset) const override;
 
 protected:
   bool Initialize(CartridgeData& data, Error* error) override;
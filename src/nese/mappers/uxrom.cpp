@@ -1,12 +1,18 @@
 #include "uxrom.h"
 #include "../bus.h"
 #include "YBaseLib/Error.h"
+#include "common/state_wrapper.h"
 
 namespace Mappers {
 UxROM::UxROM() = default;
 
 UxROM::~UxROM() = default;
 
+std::unique_ptr<Cartridge> UxROM::Clone() const
+{
+  return std::make_unique<UxROM>(*this);
+}
+
 bool UxROM::Initialize(CartridgeData& data, Error* error)
 {
   if (!Cartridge::Initialize(data, error))
@@ -29,6 +35,15 @@ void UxROM::Reset()
   m_prg_base_address_8000 = 0;
 }
 
+bool UxROM::DoState(StateWrapper& sw)
+{
+  if (!Cartridge::DoState(sw))
+    return false;
+
+  sw.Do(&m_prg_base_address_8000);
+  return !sw.HasError();
+}
+
 u8 UxROM::ReadCPUAddress(Bus* bus, u16 address)
 {
   if ((address & 0xC000) == 0xC000)
@@ -45,4 +60,16 @@ void UxROM::WriteCPUAddress(Bus* bus, u16 address, u8 value)
   // 8000-FFFF - Bank Select.
   m_prg_base_address_8000 = ((value & 0x0F) << 14) % m_prg_rom.size();
 }
+
+bool UxROM::GetPRGROMOffset(u16 address, u32* offset) const
+{
+  if (address < 0x8000)
+    return false;
+
+  if ((address & 0xC000) == 0xC000)
+    *offset = m_prg_base_address_C000 | (address & 0x3FFF);
+  else
+    *offset = m_prg_base_address_8000 | (address & 0x3FFF);
+  return true;
+}
 } // namespace Mappers
\ No newline at end of file
@@ -0,0 +1,298 @@
+#include "nsf_player.h"
+#include "YBaseLib/Error.h"
+#include "YBaseLib/Log.h"
+#include "bus.h"
+#include "common/audio.h"
+#include "common/mapped_file.h"
+#include "cpu.h"
+#include <algorithm>
+#include <cstring>
+Log_SetChannel(NSFPlayer);
+
+static const char NSF_MAGIC[5] = {'N', 'E', 'S', 'M', 0x1A};
+
+// Used when the header doesn't give a rate.
+static const u32 DEFAULT_PLAY_PERIOD_US = 16639;
+
+// The driver lives in the unused $5000 page, with a couple of registers the player uses to control it.
+static const u16 DRIVER_ADDRESS = 0x5000;
+static const u16 DRIVER_SONG_REGISTER = 0x5080; // Current song.
+static const u16 DRIVER_PLAY_REGISTER = 0x5081; // Non-zero when PLAY is due, cleared by reading.
+static const u16 DRIVER_RESET_ADDRESS = DRIVER_ADDRESS + 0x00;
+static const u16 DRIVER_INIT_OPERAND = 0x24;
+static const u16 DRIVER_PLAY_OPERAND = 0x2C;
+static const u16 DRIVER_RTI_ADDRESS = DRIVER_ADDRESS + 0x31;
+
+// Silences the APU as the NSF spec requires, calls INIT with the song in A, then polls for PLAY. IRQ and NMI go to
+// an RTI, as nothing here uses them.
+static const u8 s_driver_code[] = {
+  0x78,             // $00: SEI
+  0xD8,             // $01: CLD
+  0xA2, 0xFF,       // $02: LDX #$FF
+  0x9A,             // $04: TXS
+  0xA9, 0x00,       // $05: LDA #$00
+  0xA2, 0x00,       // $07: LDX #$00
+  0x9D, 0x00, 0x40, // $09: STA $4000,X
+  0xE8,             // $0C: INX
+  0xE0, 0x14,       // $0D: CPX #$14
+  0xD0, 0xF8,       // $0F: BNE $09
+  0x8D, 0x15, 0x40, // $11: STA $4015
+  0xA9, 0x0F,       // $14: LDA #$0F
+  0x8D, 0x15, 0x40, // $16: STA $4015
+  0xA9, 0x40,       // $19: LDA #$40
+  0x8D, 0x17, 0x40, // $1B: STA $4017
+  0xAD, 0x80, 0x50, // $1E: LDA DRIVER_SONG_REGISTER
+  0xA2, 0x00,       // $21: LDX #$00 (NTSC)
+  0x20, 0x00, 0x00, // $23: JSR INIT
+  0xAD, 0x81, 0x50, // $26: LDA DRIVER_PLAY_REGISTER
+  0xF0, 0xFB,       // $29: BEQ $26
+  0x20, 0x00, 0x00, // $2B: JSR PLAY
+  0x4C, 0x26, 0x50, // $2E: JMP $26
+  0x40,             // $31: RTI
+};
+
+// Memory map of an NSF: 4K banks at $8000-$FFFF, switched by writes to $5FF8-$5FFF, 8K of RAM at $6000-$7FFF, and
+// the driver, which the vectors point to.
+class NSFCartridge final : public Cartridge
+{
+public:
+  void Setup(const NSFPlayer::NSFData& data)
+  {
+    m_prg_rom = data.data;
+    m_prg_ram.resize(0x2000);
+    m_bank_count = m_prg_rom.size() / NSFPlayer::BANK_SIZE;
+    std::memcpy(m_initial_banks, data.initial_banks, sizeof(m_initial_banks));
+
+    std::memcpy(m_driver, s_driver_code, sizeof(s_driver_code));
+    m_driver[DRIVER_INIT_OPERAND + 0] = Truncate8(data.init_address);
+    m_driver[DRIVER_INIT_OPERAND + 1] = Truncate8(data.init_address >> 8);
+    m_driver[DRIVER_PLAY_OPERAND + 0] = Truncate8(data.play_address);
+    m_driver[DRIVER_PLAY_OPERAND + 1] = Truncate8(data.play_address >> 8);
+  }
+
+  void SetSong(u8 song) { m_song = song; }
+  void SetPlayPending() { m_play_pending = true; }
+
+  std::unique_ptr<Cartridge> Clone() const override { return std::make_unique<NSFCartridge>(*this); }
+
+  void Reset() override
+  {
+    std::fill(m_prg_ram.begin(), m_prg_ram.end(), u8(0));
+    for (u32 i = 0; i < NSFPlayer::NUM_BANKS; i++)
+      SelectBank(i, m_initial_banks[i]);
+
+    m_play_pending = false;
+  }
+
+  u8 ReadCPUAddress(Bus* bus, u16 address) override
+  {
+    if (address >= 0x8000)
+    {
+      if (address >= 0xFFFA)
+      {
+        const u16 vector = (address < 0xFFFC || address >= 0xFFFE) ? DRIVER_RTI_ADDRESS : DRIVER_RESET_ADDRESS;
+        return (address & 1) ? Truncate8(vector >> 8) : Truncate8(vector);
+      }
+
+      return m_prg_rom[m_bank_base[(address >> 12) & 7] | (address & 0xFFF)];
+    }
+    else if (address >= 0x6000)
+    {
+      return m_prg_ram[address & 0x1FFF];
+    }
+    else if (address == DRIVER_SONG_REGISTER)
+    {
+      return m_song;
+    }
+    else if (address == DRIVER_PLAY_REGISTER)
+    {
+      const bool pending = m_play_pending;
+      m_play_pending = false;
+      return pending ? 1 : 0;
+    }
+    else if (address >= DRIVER_ADDRESS && address < (DRIVER_ADDRESS + sizeof(m_driver)))
+    {
+      return m_driver[address - DRIVER_ADDRESS];
+    }
+
+    return 0;
+  }
+
+  void WriteCPUAddress(Bus* bus, u16 address, u8 value) override
+  {
+    if (address >= 0x6000 && address < 0x8000)
+      m_prg_ram[address & 0x1FFF] = value;
+    else if (address >= 0x5FF8 && address < 0x6000)
+      SelectBank(address - 0x5FF8, value);
+  }
+
+  u8 ReadPPUAddress(Bus* bus, u16 address) override { return 0; }
+  void WritePPUAddress(Bus* bus, u16 address, u8 value) override {}
+
+private:
+  void SelectBank(u32 slot, u8 bank) { m_bank_base[slot] = (bank % m_bank_count) * NSFPlayer::BANK_SIZE; }
+
+  u8 m_driver[sizeof(s_driver_code)];
+  u32 m_bank_base[NSFPlayer::NUM_BANKS] = {};
+  u32 m_bank_count = 1;
+  u8 m_initial_banks[NSFPlayer::NUM_BANKS] = {};
+  u8 m_song = 0;
+  bool m_play_pending = false;
+};
+
+static std::string ReadHeaderString(const byte* field)
+{
+  // 32 bytes, null-terminated unless the string fills the field.
+  return std::string(reinterpret_cast<const char*>(field), std::find(field, field + 32, byte(0)) - field);
+}
+
+bool NSFPlayer::LoadDataFromFile(const char* filename, NSFData* data, Error* error)
+{
+  std::shared_ptr<MappedFile> mf = MappedFile::Open(filename, error);
+  if (!mf)
+    return false;
+
+  return LoadDataFromMemory(mf->GetData(), mf->GetSize(), data, error);
+}
+
+bool NSFPlayer::LoadDataFromMemory(const byte* image, size_t image_size, NSFData* data, Error* error)
+{
+  if (image_size < HEADER_SIZE || std::memcmp(image, NSF_MAGIC, sizeof(NSF_MAGIC)) != 0)
+  {
+    error->SetErrorUser(1, "Not an NSF file");
+    return false;
+  }
+
+  const auto read_word = [image](u32 offset) { return u16(u16(image[offset]) | (u16(image[offset + 1]) << 8)); };
+  data->song_count = image[0x06];
+  data->starting_song = (image[0x07] > 0) ? (image[0x07] - 1) : 0;
+  data->load_address = read_word(0x08);
+  data->init_address = read_word(0x0A);
+  data->play_address = read_word(0x0C);
+  data->title = ReadHeaderString(image + 0x0E);
+  data->artist = ReadHeaderString(image + 0x2E);
+  data->copyright = ReadHeaderString(image + 0x4E);
+  data->play_period_us = read_word(0x6E);
+  data->expansion_chips = image[0x7B];
+  if (data->play_period_us == 0)
+    data->play_period_us = DEFAULT_PLAY_PERIOD_US;
+
+  if (image_size == HEADER_SIZE)
+  {
+    error->SetErrorUser(1, "NSF has no program data");
+    return false;
+  }
+
+  if (data->song_count == 0 || data->load_address < 0x8000)
+  {
+    error->SetErrorUserFormatted(1, "Unsupported NSF: %u songs, load address $%04X", u32(data->song_count),
+                                 u32(data->load_address));
+    return false;
+  }
+
+  if (image[0x7A] & 0x01)
+    Log_WarningPrintf("NSF is for PAL, playing with NTSC timing");
+  if (data->expansion_chips != 0)
+    Log_WarningPrintf("NSF uses expansion chips (0x%02X), which are not emulated", u32(data->expansion_chips));
+
+  // Without bankswitching, the data is loaded linearly from the load address, which is the same as banks 0-7 with the
+  // data offset from $8000.
+  std::memcpy(data->initial_banks, image + 0x70, NUM_BANKS);
+  const bool bankswitched =
+    std::any_of(data->initial_banks, data->initial_banks + NUM_BANKS, [](u8 bank) { return bank != 0; });
+  u32 padding;
+  if (bankswitched)
+  {
+    padding = data->load_address & (BANK_SIZE - 1);
+  }
+  else
+  {
+    padding = data->load_address - 0x8000;
+    for (u32 i = 0; i < NUM_BANKS; i++)
+      data->initial_banks[i] = u8(i);
+  }
+
+  const u32 program_size = u32(image_size - HEADER_SIZE);
+  u32 padded_size = (padding + program_size + (BANK_SIZE - 1)) & ~(BANK_SIZE - 1);
+  if (!bankswitched)
+    padded_size = std::max(padded_size, NUM_BANKS * BANK_SIZE);
+
+  auto program = std::make_shared<Cartridge::DataType>(padded_size);
+  std::memcpy(program->data() + padding, image + HEADER_SIZE, std::min(program_size, padded_size - padding));
+  data->data = Cartridge::ROMView(program, program->data(), u32(program->size()));
+  return true;
+}
+
+NSFPlayer::NSFPlayer()
+  : m_bus(std::make_unique<Bus>()), m_cpu(std::make_unique<CPU>()), m_apu(std::make_unique<APU>()),
+    m_cartridge(std::make_unique<NSFCartridge>())
+{
+}
+
+NSFPlayer::~NSFPlayer() = default;
+
+bool NSFPlayer::Initialize(const NSFData& data, Audio* audio, Error* error)
+{
+  m_audio = audio;
+  if (m_audio && !m_audio->Reconfigure(APU::GetAudioQualitySampleRate(m_apu->GetAudioQuality()), 1))
+  {
+    error->SetErrorUser(1, "Failed to configure audio output");
+    return false;
+  }
+
+  m_data = data;
+  m_cartridge->Setup(m_data);
+  m_play_period = u64(m_data.play_period_us) * APU::CPU_CLOCK_RATE;
+
+  m_bus->Initialize(m_cpu.get(), nullptr, m_apu.get());
+  m_bus->SetCartridge(m_cartridge.get());
+  m_cpu->Initialize(nullptr, m_bus.get());
+  m_apu->Initialize(m_bus.get(), m_audio);
+  StartSong(m_data.starting_song);
+  return true;
+}
+
+void NSFPlayer::StartSong(u32 song)
+{
+  // Pausing the output empties it without racing the device's thread.
+  if (m_audio)
+    m_audio->PauseOutput(true);
+
+  m_song = std::min(song, GetSongCount() - 1);
+  m_cartridge->SetSong(u8(m_song));
+  m_bus->Reset();
+  m_cartridge->Reset();
+  m_apu->Reset();
+  m_cpu->Reset();
+
+  // INIT may take a while, but the first PLAY is still due one period after the reset.
+  m_play_timer = s64(m_play_period);
+
+  if (m_audio)
+    m_audio->PauseOutput(false);
+}
+
+void NSFPlayer::Execute(CycleCount cycles)
+{
+  while (cycles > 0)
+  {
+    const CycleCount cycles_until_play = CycleCount((u64(m_play_timer) + 999999) / 1000000);
+    const CycleCount slice = std::min(std::min(cycles, cycles_until_play), m_apu->GetMaxExecutionDelay());
+
+    const u32 start_cycle = m_cpu->GetCyclesSinceReset();
+    m_cpu->Execute(slice);
+    m_bus->ExecutePendingCycles();
+
+    // Instructions can overrun the slice.
+    const CycleCount executed = CycleCount(m_cpu->GetCyclesSinceReset() - start_cycle);
+    cycles -= executed;
+    m_play_timer -= s64(executed) * 1000000;
+    if (m_play_timer <= 0)
+    {
+      // If PLAY overruns its period, the next call is made as soon as it returns, and any further calls are skipped.
+      m_cartridge->SetPlayPending();
+      while (m_play_timer <= 0)
+        m_play_timer += s64(m_play_period);
+    }
+  }
+}
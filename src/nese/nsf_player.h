@@ -0,0 +1,83 @@
+#pragma once
+#include "apu.h"
+#include "cartridge.h"
+#include "types.h"
+#include <memory>
+#include <string>
+
+class Audio;
+class Bus;
+class CPU;
+class Error;
+class NSFCartridge;
+
+// Plays NES Sound Format files, which contain a game's music code and data ripped from the ROM, along with the
+// addresses of its init and play routines. There is no PPU or display: the CPU runs a small driver which calls INIT
+// once for the selected song, then PLAY at the rate given in the header, and the APU renders the output. Nothing
+// paces the emulation, so with a file output a song renders far faster than real time.
+class NSFPlayer
+{
+public:
+  static const u32 HEADER_SIZE = 0x80;
+  static const u32 BANK_SIZE = 0x1000;
+  static const u32 NUM_BANKS = 8;
+
+  // Parsed NSF file. The program data is padded so that bank N starts at N * BANK_SIZE, as it is for bankswitched
+  // files, which lets both kinds be mapped the same way.
+  struct NSFData
+  {
+    Cartridge::ROMView data;
+    std::string title;
+    std::string artist;
+    std::string copyright;
+    u32 play_period_us;
+    u16 load_address;
+    u16 init_address;
+    u16 play_address;
+    u8 initial_banks[NUM_BANKS];
+    u8 song_count;
+    u8 starting_song; // Zero-based.
+    u8 expansion_chips;
+  };
+
+  static bool LoadDataFromFile(const char* filename, NSFData* data, Error* error);
+  static bool LoadDataFromMemory(const byte* image, size_t image_size, NSFData* data, Error* error);
+
+  NSFPlayer();
+  ~NSFPlayer();
+
+  Bus* GetBus() { return m_bus.get(); }
+  CPU* GetCPU() { return m_cpu.get(); }
+  APU* GetAPU() { return m_apu.get(); }
+  const NSFData& GetData() const { return m_data; }
+  u32 GetSongCount() const { return m_data.song_count; }
+  u32 GetCurrentSong() const { return m_song; }
+
+  // As for System, the audio device is opened at the tier's preferred sample rate if this is called before
+  // Initialize().
+  void SetAudioQuality(APU::AudioQuality quality) { m_apu->SetAudioQuality(quality); }
+
+  // Audio may be null, to run without output.
+  bool Initialize(const NSFData& data, Audio* audio, Error* error);
+
+  // Resets the machine and selects a song, numbered from zero. INIT runs as soon as execution starts.
+  void StartSong(u32 song);
+
+  // Emulates the given number of CPU cycles, calling PLAY whenever it is due.
+  void Execute(CycleCount cycles);
+
+private:
+  Audio* m_audio = nullptr;
+
+  std::unique_ptr<Bus> m_bus;
+  std::unique_ptr<CPU> m_cpu;
+  std::unique_ptr<APU> m_apu;
+  std::unique_ptr<NSFCartridge> m_cartridge;
+
+  NSFData m_data = {};
+  u32 m_song = 0;
+
+  // In units of a millionth of a CPU cycle, so the period in microseconds converts exactly.
+  u64 m_play_period = 0;
+  s64 m_play_timer = 0;
+};
@@ -0,0 +1,156 @@
+#include "perf_counters.h"
+#include "YBaseLib/Assert.h"
+#include "common/audio.h"
+#include <algorithm>
+#include <cstdio>
+
+const char* PerfCounters::GetSectionName(Section section)
+{
+  static const char* names[NUM_SECTIONS] = {"CPU", "PPU", "APU", "Present", "Audio", "Host"};
+  return names[static_cast<u32>(section)];
+}
+
+std::string PerfCounters::FormatStats(const Stats& stats)
+{
+  const FrameStats& avg = stats.average;
+  char buf[512];
+  int len = std::snprintf(buf, sizeof(buf), "FRAME %.2f MS  P50 %.2f  P95 %.2f  P99 %.2f  MAX %.2f\n", avg.frame_ms,
+                          stats.frame_ms_p50, stats.frame_ms_p95, stats.frame_ms_p99, stats.frame_ms_max);
+
+  // Three sections to a line, to fit a 256 pixel wide frame.
+  for (u32 i = 0; i < NUM_SECTIONS && len > 0 && len < int(sizeof(buf)); i++)
+  {
+    len += std::snprintf(buf + len, sizeof(buf) - len, "%s %.2f%s", GetSectionName(static_cast<Section>(i)),
+                         avg.section_ms[i], ((i % 3) == 2) ? " MS\n" : "  ");
+  }
+
+  if (len > 0 && len < int(sizeof(buf)))
+  {
+    std::snprintf(buf + len, sizeof(buf) - len, "%u CYCLES  %u INSTRUCTIONS  %u SYNCS\nUNDERRUN %u  OVERRUN %u SAMPLES",
+                  avg.cpu_cycles, avg.cpu_instructions, avg.syncs, stats.audio_underrun_samples,
+                  stats.audio_overrun_samples);
+  }
+
+  return buf;
+}
+
+void PerfCounters::Reset(u32 instructions_executed, const Audio* audio)
+{
+  m_stack[0] = Section::Host;
+  m_depth = 0;
+  m_last_switch_time = Timer::GetValue();
+  m_frame_start_time = m_last_switch_time;
+  std::fill_n(m_section_time, NUM_SECTIONS, Timer::Value(0));
+
+  m_frame = {};
+  m_last_instructions_executed = instructions_executed;
+  m_last_underrun_samples = audio ? audio->GetUnderrunSampleCount() : 0;
+  m_last_overrun_samples = audio ? audio->GetOverrunSampleCount() : 0;
+
+  m_history_position = 0;
+  m_history_count = 0;
+}
+
+void PerfCounters::AddElapsedTime(Timer::Value now)
+{
+  m_section_time[static_cast<u32>(m_stack[m_depth])] += now - m_last_switch_time;
+  m_last_switch_time = now;
+}
+
+void PerfCounters::Enter(Section section)
+{
+  DebugAssert(m_depth < (MAX_DEPTH - 1));
+  AddElapsedTime(Timer::GetValue());
+  m_stack[++m_depth] = section;
+}
+
+void PerfCounters::Leave()
+{
+  DebugAssert(m_depth > 0);
+  AddElapsedTime(Timer::GetValue());
+  m_depth--;
+}
+
+void PerfCounters::EndFrame(u32 instructions_executed, const Audio* audio)
+{
+  const Timer::Value now = Timer::GetValue();
+  AddElapsedTime(now);
+
+  m_frame.frame_ms = float(Timer::ConvertValueToMilliseconds(now - m_frame_start_time));
+  for (u32 i = 0; i < NUM_SECTIONS; i++)
+    m_frame.section_ms[i] = float(Timer::ConvertValueToMilliseconds(m_section_time[i]));
+  m_frame.cpu_instructions = instructions_executed - m_last_instructions_executed;
+  if (audio)
+  {
+    const u64 underrun_samples = audio->GetUnderrunSampleCount();
+    const u64 overrun_samples = audio->GetOverrunSampleCount();
+    m_frame.audio_underrun_samples = static_cast<u32>(underrun_samples - m_last_underrun_samples);
+    m_frame.audio_overrun_samples = static_cast<u32>(overrun_samples - m_last_overrun_samples);
+    m_last_underrun_samples = underrun_samples;
+    m_last_overrun_samples = overrun_samples;
+  }
+
+  m_history[m_history_position] = m_frame;
+  m_history_position = (m_history_position + 1) % HISTORY_SIZE;
+  m_history_count = std::min(m_history_count + 1, HISTORY_SIZE);
+
+  m_frame_start_time = now;
+  std::fill_n(m_section_time, NUM_SECTIONS, Timer::Value(0));
+  m_frame = {};
+  m_last_instructions_executed = instructions_executed;
+}
+
+const PerfCounters::FrameStats& PerfCounters::GetLastFrameStats() const
+{
+  return m_history[(m_history_position + HISTORY_SIZE - 1) % HISTORY_SIZE];
+}
+
+PerfCounters::Stats PerfCounters::GetStats() const
+{
+  Stats stats = {};
+  stats.frame_count = m_history_count;
+  if (m_history_count == 0)
+    return stats;
+
+  stats.last_frame = GetLastFrameStats();
+
+  double frame_ms = 0.0;
+  double section_ms[NUM_SECTIONS] = {};
+  u64 cpu_cycles = 0, cpu_instructions = 0, syncs = 0, underrun_samples = 0, overrun_samples = 0;
+  float frame_times[HISTORY_SIZE];
+  for (u32 i = 0; i < m_history_count; i++)
+  {
+    const FrameStats& frame = m_history[i];
+    frame_ms += frame.frame_ms;
+    for (u32 j = 0; j < NUM_SECTIONS; j++)
+      section_ms[j] += frame.section_ms[j];
+    cpu_cycles += frame.cpu_cycles;
+    cpu_instructions += frame.cpu_instructions;
+    syncs += frame.syncs;
+    underrun_samples += frame.audio_underrun_samples;
+    overrun_samples += frame.audio_overrun_samples;
+    frame_times[i] = frame.frame_ms;
+  }
+
+  const double scale = 1.0 / double(m_history_count);
+  stats.average.frame_ms = float(frame_ms * scale);
+  for (u32 i = 0; i < NUM_SECTIONS; i++)
+    stats.average.section_ms[i] = float(section_ms[i] * scale);
+  stats.average.cpu_cycles = static_cast<u32>(double(cpu_cycles) * scale + 0.5);
+  stats.average.cpu_instructions = static_cast<u32>(double(cpu_instructions) * scale + 0.5);
+  stats.average.syncs = static_cast<u32>(double(syncs) * scale + 0.5);
+  stats.average.audio_underrun_samples = static_cast<u32>(double(underrun_samples) * scale + 0.5);
+  stats.average.audio_overrun_samples = static_cast<u32>(double(overrun_samples) * scale + 0.5);
+  stats.audio_underrun_samples = static_cast<u32>(underrun_samples);
+  stats.audio_overrun_samples = static_cast<u32>(overrun_samples);
+
+  std::sort(frame_times, frame_times + m_history_count);
+  const auto percentile = [&frame_times, this](float p) {
+    return frame_times[static_cast<u32>(p * float(m_history_count - 1) + 0.5f)];
+  };
+  stats.frame_ms_p50 = percentile(0.5f);
+  stats.frame_ms_p95 = percentile(0.95f);
+  stats.frame_ms_p99 = percentile(0.99f);
+  stats.frame_ms_max = frame_times[m_history_count - 1];
+  return stats;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include "YBaseLib/Timer.h"
+#include "types.h"
+#include <string>
+
+class Audio;
+
+// Per-frame performance counters for a system, enabled with System::SetStatsEnabled(). Components mark where their
+// work begins and ends, and the time between each switch goes to the section which was running, so the sections are
+// exclusive of each other and add up to the frame time: the PPU's time doesn't include presenting the frame, and the
+// CPU's is what's left of the frame loop.
+class PerfCounters
+{
+public:
+  enum class Section : u8
+  {
+    CPU,         // Instruction execution, and everything else in the frame loop not below.
+    PPU,         // Rendering.
+    APU,         // Channels and synthesis, unless synthesis is pipelined onto its own thread.
+    Present,     // Handing the frame to the display, including any wait for vsync.
+    AudioOutput, // Writing samples to the audio output, including any wait for it to catch up.
+    Host,        // Outside the system, in the frontend's loop.
+    Count
+  };
+
+  static const u32 NUM_SECTIONS = static_cast<u32>(Section::Count);
+
+  // Frames kept for averages and percentiles.
+  static const u32 HISTORY_SIZE = 240;
+
+  struct FrameStats
+  {
+    float frame_ms;                 // Wall time since the previous frame ended.
+    float section_ms[NUM_SECTIONS]; // Indexed by Section.
+    u32 cpu_cycles;
+    u32 cpu_instructions;
+    u32 syncs;                  // Times the PPU and APU were caught up with the CPU.
+    u32 audio_underrun_samples; // Silence the audio device played, for want of samples.
+    u32 audio_overrun_samples;  // Samples dropped as the audio output was full.
+  };
+
+  struct Stats
+  {
+    u32 frame_count;            // Frames in the history, up to HISTORY_SIZE.
+    FrameStats last_frame;      // The most recent frame.
+    FrameStats average;         // Mean over the history.
+    u32 audio_underrun_samples; // Totals over the history.
+    u32 audio_overrun_samples;
+    float frame_ms_p50;
+    float frame_ms_p95;
+    float frame_ms_p99;
+    float frame_ms_max;
+  };
+
+  // Attributes time to a section until the end of the scope. Does nothing if the counters are null, which is how
+  // components skip the timer reads when stats are disabled.
+  class Scope
+  {
+  public:
+    Scope(PerfCounters* counters, Section section) : m_counters(counters)
+    {
+      if (m_counters)
+        m_counters->Enter(section);
+    }
+    ~Scope()
+    {
+      if (m_counters)
+        m_counters->Leave();
+    }
+
+  private:
+    PerfCounters* m_counters;
+  };
+
+  static const char* GetSectionName(Section section);
+
+  // Formats stats as a few short lines, for an overlay.
+  static std::string FormatStats(const Stats& stats);
+
+  // Clears the history and starts the current frame from now. Takes the same arguments as EndFrame().
+  void Reset(u32 instructions_executed, const Audio* audio);
+
+  void Enter(Section section);
+  void Leave();
+
+  void AddSync(CycleCount cpu_cycles)
+  {
+    m_frame.syncs++;
+    m_frame.cpu_cycles += static_cast<u32>(cpu_cycles);
+  }
+
+  // Records the frame. The instruction count is the CPU's running total, and audio may be null.
+  void EndFrame(u32 instructions_executed, const Audio* audio);
+
+  const FrameStats& GetLastFrameStats() const;
+  Stats GetStats() const;
+
+private:
+  static const u32 MAX_DEPTH = 8;
+
+  void AddElapsedTime(Timer::Value now);
+
+  Section m_stack[MAX_DEPTH] = {Section::Host};
+  u32 m_depth = 0;
+  Timer::Value m_last_switch_time = 0;
+  Timer::Value m_frame_start_time = 0;
+  Timer::Value m_section_time[NUM_SECTIONS] = {};
+
+  FrameStats m_frame = {};
+  u32 m_last_instructions_executed = 0;
+  u64 m_last_underrun_samples = 0;
+  u64 m_last_overrun_samples = 0;
+
+  FrameStats m_history[HISTORY_SIZE] = {};
+  u32 m_history_position = 0;
+  u32 m_history_count = 0;
+};
@@ -5,7 +5,10 @@
 #include "YBaseLib/Memory.h"
 #include "bus.h"
 #include "common/display.h"
+#include "common/state_wrapper.h"
 #include "cpu.h"
+#include "event_timeline.h"
+#include "perf_counters.h"
 #include "system.h"
 Log_SetChannel(PPU);
 
@@ -37,7 +40,22 @@ void PPU::Initialize(System* system, Bus* bus, Display* display)
   m_bus = bus;
   m_display = display;
 
-  m_display->ResizeFramebuffer(SCREEN_WIDTH, SCREEN_HEIGHT);
+  // Without a display, frames are never output. Resizing may recreate the display's textures, which must happen on
+  // the thread that owns it, so it is skipped when the owner has already set the framebuffer up.
+  if (!m_display)
+  {
+    m_output_enabled = false;
+  }
+  else if (!m_display->GetFramebufferPointer() || m_display->GetFramebufferWidth() != SCREEN_WIDTH ||
+           m_display->GetFramebufferHeight() != SCREEN_HEIGHT)
+  {
+    m_display->ResizeFramebuffer(SCREEN_WIDTH, SCREEN_HEIGHT);
+  }
+}
+
+u32 PPU::GetPaletteColor(u8 index)
+{
+  return PALETTE[index % countof(PALETTE)];
 }
 
 void PPU::Reset()
@@ -75,6 +93,45 @@ void PPU::Reset()
   WriteOAMAddress(0);
 }
 
+bool PPU::DoState(StateWrapper& sw)
+{
+  sw.DoMarker("PPU");
+  sw.Do(&m_current_cycle);
+  sw.Do(&m_current_scanline);
+  sw.DoArray(m_palette_ram);
+  sw.DoArray(m_oam_ram);
+
+  // BitField members aren't trivially copyable, but the register block is plain data.
+  sw.DoBytes(&m_regs, sizeof(m_regs));
+
+  sw.Do(&m_f);
+  sw.Do(&m_register);
+  sw.Do(&m_nmi_enable);
+  sw.Do(&m_nmi_hold);
+  sw.Do(&m_nmi_flag);
+  sw.Do(&m_sprite_current_index);
+  sw.Do(&m_sprite_counter);
+  sw.Do(&m_sprite_count);
+  sw.Do(&m_vram_increment);
+  sw.Do(&m_sprite_table_address);
+  sw.Do(&m_background_table_address);
+  sw.Do(&m_sprite_height);
+  sw.Do(&m_flagMasterSlave);
+  sw.Do(&m_grayscale_flag);
+  sw.Do(&m_flagShowLeftBackground);
+  sw.Do(&m_flagShowLeftSprites);
+  sw.Do(&m_flagShowBackground);
+  sw.Do(&m_flagShowSprites);
+  sw.Do(&m_flagRedTint);
+  sw.Do(&m_flagGreenTint);
+  sw.Do(&m_flagBlueTint);
+  sw.Do(&m_flagSpriteZeroHit);
+  sw.Do(&m_flagSpriteOverflow);
+  sw.Do(&m_oam_address);
+  sw.Do(&m_ppu_bus_value);
+  return !sw.HasError();
+}
+
 u8 PPU::ReadRegister(u8 address)
 {
   switch (address)
@@ -291,7 +348,9 @@ void PPU::WriteDMA(u8 value)
       oam_buffer[i] = m_bus->ReadCPUAddress(start_address + i);
   }
 
-  m_bus->StallCPU(513);
+  const u32 stall_cycles = m_bus->StallCPU(513);
+  if (EventTimeline* timeline = m_bus->GetEventTimeline())
+    timeline->Record(EventTimeline::Type::OAMDMA, 0, value, stall_cycles);
 
   // OAM writes start at OAMADDR. OAMADDR is not written to.
   u8 oam_offset = m_oam_address;
@@ -374,6 +433,18 @@ void PPU::RenderPixel()
   int32 y = m_current_scanline;
   DebugAssert(x >= 0 && y >= 0 && x < SCREEN_WIDTH && y < SCREEN_HEIGHT);
 
+  // Without output, the only side effect is sprite 0 hit. Sprite 0 is always in the first slot when present.
+  if (!m_output_enabled)
+  {
+    if (!m_flagSpriteZeroHit && m_flagShowBackground && m_flagShowSprites && m_sprite_count > 0 &&
+        m_regs.sprites[0].index == 0)
+    {
+      UpdateSpriteZeroHit(x);
+    }
+
+    return;
+  }
+
   u8 color = 0;
   if (m_flagShowBackground && (m_flagShowLeftBackground || x >= 8))
   {
@@ -432,7 +503,35 @@ void PPU::RenderPixel()
     color = sprite_color;
 
   DebugAssert(color < countof(m_palette_ram));
-  m_display->SetPixel(x, y, PALETTE[m_palette_ram[color] % countof(PALETTE)]);
+  const u8 entry = m_palette_ram[color] % countof(PALETTE);
+  if (m_indexed_output)
+    m_indexed_output[y * SCREEN_WIDTH + x] = entry;
+  else
+    m_display->SetPixel(x, y, PALETTE[entry]);
+}
+
+void PPU::UpdateSpriteZeroHit(s32 x)
+{
+  // The same test as RenderPixel(), but only whether the pixels are opaque matters, not their colours. Sprite 0 is
+  // first in priority, so the other sprites don't need looking at either.
+  if (x == 255 || (x < 8 && (!m_flagShowLeftBackground || !m_flagShowLeftSprites)))
+    return;
+
+  const auto& sprite = m_regs.sprites[0];
+  s32 sprite_x = x - s32(u32(sprite.x));
+  if (sprite.tile == 64 || sprite_x < 0 || sprite_x >= 8)
+    return;
+
+  if (sprite.attribute & 0x40)
+    sprite_x ^= 0x07;
+
+  const u8 sprite_bit = u8(0x80) >> sprite_x;
+  const u16 tile_bit = u16(0x8000) >> (m_regs.fine_x + (x & 7));
+  if (((sprite.tile_data_low | sprite.tile_data_high) & sprite_bit) &&
+      ((m_regs.tile_data_low | m_regs.tile_data_high) & tile_bit))
+  {
+    m_flagSpriteZeroHit = true;
+  }
 }
 
 void PPU::EvaluateSprite()
@@ -547,7 +646,11 @@ void PPU::Execute(CycleCount cycles)
         if (m_current_scanline == 240)
         {
           m_nmi_hold = true;
-          m_display->DisplayFramebuffer();
+          if (m_output_enabled && !m_indexed_output)
+          {
+            PerfCounters::Scope scope(m_perf_counters, PerfCounters::Section::Present);
+            m_display->DisplayFramebuffer();
+          }
           m_system->EndFrame();
         }
         else if (m_current_scanline == 260)
@@ -5,6 +5,8 @@
 class System;
 class Bus;
 class Display;
+class PerfCounters;
+class StateWrapper;
 
 class PPU
 {
@@ -19,13 +21,36 @@ public:
   PPU();
   ~PPU();
 
+  // Display may be null, in which case output is always disabled.
   void Initialize(System* system, Bus* bus, Display* display);
   void Reset();
+  bool DoState(StateWrapper& sw);
 
   u8 ReadRegister(u8 address);
   void WriteRegister(u8 address, u8 value);
   void WriteDMA(u8 value);
 
+  // When output is disabled, pixels are not composited or written to the display, and frames are not presented.
+  // CPU-visible behaviour such as sprite 0 hit, sprite overflow, NMI and the mapper's view of the fetches is
+  // unaffected. Takes effect immediately, so it can be changed between frames.
+  bool IsOutputEnabled() const { return m_output_enabled; }
+  void SetOutputEnabled(bool enabled) { m_output_enabled = enabled && (m_display || m_indexed_output); }
+
+  // Writes the palette entry (0-63) of each pixel to a buffer of SCREEN_WIDTH * SCREEN_HEIGHT bytes instead of the
+  // display, for callers which convert the frame themselves. Null returns output to the display.
+  void SetIndexedOutput(u8* buffer) { m_indexed_output = buffer; }
+
+  // Times presenting frames when set. See System::SetStatsEnabled().
+  void SetPerfCounters(PerfCounters* counters) { m_perf_counters = counters; }
+
+  // Returns the colour of a palette entry, in the display's pixel format.
+  static u32 GetPaletteColor(u8 index);
+
+  // Current position in the frame. Lines 0-239 are visible, 240-260 are post-render and vertical blank, and 261 is
+  // pre-render.
+  u32 GetCurrentScanline() const { return m_current_scanline; }
+  CycleCount GetCurrentCycle() const { return m_current_cycle; }
+
   // Returns the number of cycles until the next execution of the PPU is required.
   CycleCount GetMaxExecutionDelay() const;
 
@@ -37,6 +62,9 @@ private:
   System* m_system = nullptr;
   Bus* m_bus = nullptr;
   Display* m_display = nullptr;
+  u8* m_indexed_output = nullptr;
+  PerfCounters* m_perf_counters = nullptr;
+  bool m_output_enabled = true;
 
   CycleCount m_current_cycle = 0;
   u32 m_current_scanline = 0;
@@ -164,6 +192,7 @@ private:
   void StoreTileData();
 
   void RenderPixel();
+  void UpdateSpriteZeroHit(s32 x);
 
   void EvaluateSprite();
   void CalculateSpriteTileAddress(const u8 sprite_index);
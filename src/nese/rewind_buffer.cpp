@@ -0,0 +1,260 @@
+#include "rewind_buffer.h"
+#include "YBaseLib/Assert.h"
+#include "YBaseLib/Log.h"
+#include "system.h"
+#include <algorithm>
+#include <cstring>
+Log_SetChannel(RewindBuffer);
+
+static inline void WriteVarInt(u8*& out, u32 value)
+{
+  while (value >= 0x80)
+  {
+    *(out++) = static_cast<u8>(value | 0x80);
+    value >>= 7;
+  }
+  *(out++) = static_cast<u8>(value);
+}
+
+static inline bool ReadVarInt(const u8*& in, const u8* in_end, u32* value)
+{
+  u32 result = 0;
+  for (u32 shift = 0; shift < 35; shift += 7)
+  {
+    if (in == in_end)
+      return false;
+
+    const u8 byte = *(in++);
+    result |= static_cast<u32>(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+    {
+      *value = result;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+RewindBuffer::RewindBuffer(System* system) : m_system(system)
+{
+  SetBudget(DEFAULT_MAX_MEMORY_MB, DEFAULT_MAX_SECONDS);
+}
+
+RewindBuffer::~RewindBuffer() = default;
+
+void RewindBuffer::SetBudget(u32 max_memory_mb, u32 max_seconds)
+{
+  m_max_seconds = std::max(max_seconds, 1u);
+  m_storage.resize(max_memory_mb * 1024 * 1024);
+  m_storage.shrink_to_fit();
+  m_entries.resize((m_max_seconds * FRAMES_PER_SECOND) / m_capture_interval + 1);
+  m_entries.shrink_to_fit();
+  Clear();
+}
+
+void RewindBuffer::SetCaptureInterval(u32 frames)
+{
+  m_capture_interval = std::max(frames, 1u);
+  m_entries.resize((m_max_seconds * FRAMES_PER_SECOND) / m_capture_interval + 1);
+  m_entries.shrink_to_fit();
+  Clear();
+}
+
+float RewindBuffer::GetHistorySeconds() const
+{
+  return static_cast<float>(m_entry_count * m_capture_interval) / static_cast<float>(FRAMES_PER_SECOND);
+}
+
+void RewindBuffer::Clear()
+{
+  m_current_state.clear();
+  m_storage_write_position = 0;
+  m_used_bytes = 0;
+  m_first_entry = 0;
+  m_entry_count = 0;
+  m_frames_since_capture = 0;
+}
+
+void RewindBuffer::FrameCompleted()
+{
+  if (m_storage.empty())
+    return;
+
+  if ((++m_frames_since_capture) < m_capture_interval && !m_current_state.empty())
+    return;
+
+  m_frames_since_capture = 0;
+  if (!Capture())
+    Clear();
+}
+
+bool RewindBuffer::Capture()
+{
+  if (!m_system->SaveState(&m_capture_state))
+  {
+    Log_ErrorPrintf("Failed to save state for rewind");
+    return false;
+  }
+
+  // The state size only changes if the cartridge is swapped, in which case the history is meaningless.
+  if (m_current_state.size() == m_capture_state.size())
+  {
+    const u32 state_size = static_cast<u32>(m_capture_state.size());
+    const u32 delta_size = EncodeDelta(m_capture_state.data(), m_current_state.data(), state_size, &m_encode_buffer);
+    if (delta_size > m_storage.size())
+    {
+      Log_WarningPrintf("Rewind delta of %u bytes exceeds budget, discarding history", delta_size);
+      Clear();
+    }
+    else
+    {
+      PushEntry(m_encode_buffer.data(), delta_size);
+    }
+  }
+  else
+  {
+    Clear();
+  }
+
+  m_current_state.swap(m_capture_state);
+  return true;
+}
+
+void RewindBuffer::PushEntry(const u8* data, u32 size)
+{
+  const u32 max_entries = static_cast<u32>(m_entries.size());
+  if (m_entry_count == max_entries)
+    PopOldestEntry();
+
+  // Entries are kept contiguous, so wrap to the start if this one would straddle the end.
+  u32 position = m_storage_write_position;
+  if ((position + size) > m_storage.size())
+  {
+    while (m_entry_count > 0 && m_entries[m_first_entry].offset >= position)
+      PopOldestEntry();
+    position = 0;
+  }
+
+  // Evict the oldest entries which overlap the range being written.
+  while (m_entry_count > 0)
+  {
+    const Entry& oldest = m_entries[m_first_entry];
+    if (oldest.offset >= (position + size) || (oldest.offset + oldest.size) <= position)
+      break;
+    PopOldestEntry();
+  }
+
+  std::memcpy(&m_storage[position], data, size);
+
+  Entry& entry = m_entries[(m_first_entry + m_entry_count) % max_entries];
+  entry.offset = position;
+  entry.size = size;
+  m_entry_count++;
+  m_used_bytes += size;
+  m_storage_write_position = position + size;
+}
+
+void RewindBuffer::PopOldestEntry()
+{
+  DebugAssert(m_entry_count > 0);
+  m_used_bytes -= m_entries[m_first_entry].size;
+  m_first_entry = (m_first_entry + 1) % static_cast<u32>(m_entries.size());
+  m_entry_count--;
+}
+
+bool RewindBuffer::Rewind()
+{
+  if (m_current_state.empty())
+    return false;
+
+  bool result = false;
+  if (m_entry_count > 0)
+  {
+    // Pop the newest entry, and transform the current state into the one before it.
+    const u32 newest_index = (m_first_entry + m_entry_count - 1) % static_cast<u32>(m_entries.size());
+    const Entry& entry = m_entries[newest_index];
+    if (!ApplyDelta(m_current_state.data(), static_cast<u32>(m_current_state.size()), &m_storage[entry.offset],
+                    entry.size))
+    {
+      Log_ErrorPrintf("Corrupted rewind delta, discarding history");
+      Clear();
+      return false;
+    }
+
+    m_storage_write_position = entry.offset;
+    m_used_bytes -= entry.size;
+    m_entry_count--;
+    result = true;
+  }
+
+  m_frames_since_capture = 0;
+  if (!m_system->LoadState(m_current_state))
+  {
+    Log_ErrorPrintf("Failed to load rewind state");
+    Clear();
+    return false;
+  }
+
+  return result;
+}
+
+u32 RewindBuffer::EncodeDelta(const u8* new_state, const u8* old_state, u32 size, std::vector<u8>* out)
+{
+  // Worst case is alternating single changed/unchanged bytes, at most three bytes of overhead per literal byte.
+  const size_t max_size = size * 4 + 16;
+  if (out->size() < max_size)
+    out->resize(max_size);
+
+  u8* out_ptr = out->data();
+  u32 pos = 0;
+  while (pos < size)
+  {
+    // Compare a word at a time while skipping unchanged runs, the common case.
+    const u32 run_start = pos;
+    while ((pos + sizeof(u64)) <= size)
+    {
+      u64 a, b;
+      std::memcpy(&a, new_state + pos, sizeof(a));
+      std::memcpy(&b, old_state + pos, sizeof(b));
+      if (a != b)
+        break;
+      pos += sizeof(u64);
+    }
+    while (pos < size && new_state[pos] == old_state[pos])
+      pos++;
+
+    const u32 literal_start = pos;
+    while (pos < size && new_state[pos] != old_state[pos])
+      pos++;
+
+    WriteVarInt(out_ptr, literal_start - run_start);
+    WriteVarInt(out_ptr, pos - literal_start);
+    for (u32 i = literal_start; i < pos; i++)
+      *(out_ptr++) = new_state[i] ^ old_state[i];
+  }
+
+  return static_cast<u32>(out_ptr - out->data());
+}
+
+bool RewindBuffer::ApplyDelta(u8* state, u32 size, const u8* delta, u32 delta_size)
+{
+  const u8* in = delta;
+  const u8* in_end = delta + delta_size;
+  u32 pos = 0;
+  while (in != in_end)
+  {
+    u32 run_length, literal_length;
+    if (!ReadVarInt(in, in_end, &run_length) || !ReadVarInt(in, in_end, &literal_length))
+      return false;
+
+    pos += run_length;
+    if ((pos + literal_length) > size || static_cast<u32>(in_end - in) < literal_length)
+      return false;
+
+    for (u32 i = 0; i < literal_length; i++)
+      state[pos++] ^= *(in++);
+  }
+
+  return true;
+}
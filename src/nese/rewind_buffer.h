@@ -0,0 +1,87 @@
+#pragma once
+#include "types.h"
+#include <vector>
+
+class System;
+
+// Keeps a history of machine states for rewinding, within a fixed memory budget.
+// Only the newest state is held in full. Each older state is stored as an XOR delta against the state after it,
+// with runs of unchanged bytes run-length encoded. Most of WRAM/VRAM/OAM/CHR-RAM is untouched between frames, so
+// the deltas are typically a few hundred bytes. Stepping backwards applies deltas to the newest state in turn.
+class RewindBuffer
+{
+public:
+  static const u32 DEFAULT_MAX_MEMORY_MB = 16;
+  static const u32 DEFAULT_MAX_SECONDS = 120;
+  static const u32 DEFAULT_CAPTURE_INTERVAL = 2;
+  static const u32 FRAMES_PER_SECOND = 60;
+
+  RewindBuffer(System* system);
+  ~RewindBuffer();
+
+  // Sets the memory used for delta storage in megabytes, and the maximum length of history. Clears the buffer.
+  void SetBudget(u32 max_memory_mb, u32 max_seconds);
+
+  // Sets how many frames pass between captures. Clears the buffer.
+  void SetCaptureInterval(u32 frames);
+
+  u32 GetMaxMemory() const { return static_cast<u32>(m_storage.size()); }
+  u32 GetMaxSeconds() const { return m_max_seconds; }
+  u32 GetCaptureInterval() const { return m_capture_interval; }
+
+  // Number of states which can be stepped back to.
+  u32 GetEntryCount() const { return m_entry_count; }
+
+  // Bytes used by delta storage, excluding the full copy of the newest state.
+  u32 GetMemoryUsage() const { return m_used_bytes; }
+
+  // Length of the history which is currently held.
+  float GetHistorySeconds() const;
+
+  void Clear();
+
+  // Call after each emulated frame. Captures the system state every capture interval.
+  void FrameCompleted();
+
+  // Restores the previous captured state, and removes it from the history.
+  // Returns false if there is no older state, in which case the oldest state is reloaded.
+  bool Rewind();
+
+private:
+  struct Entry
+  {
+    u32 offset;
+    u32 size;
+  };
+
+  bool Capture();
+  void PushEntry(const u8* data, u32 size);
+  void PopOldestEntry();
+
+  // Encodes (new ^ old) as a sequence of [zero run length][literal length][literal bytes], lengths as varints.
+  static u32 EncodeDelta(const u8* new_state, const u8* old_state, u32 size, std::vector<u8>* out);
+
+  // Applies an encoded delta in-place. Since the delta is an XOR, this converts either state into the other.
+  static bool ApplyDelta(u8* state, u32 size, const u8* delta, u32 delta_size);
+
+  System* m_system;
+
+  u32 m_max_seconds = DEFAULT_MAX_SECONDS;
+  u32 m_capture_interval = DEFAULT_CAPTURE_INTERVAL;
+  u32 m_frames_since_capture = 0;
+
+  // Newest state in full, and scratch space for the next capture.
+  std::vector<u8> m_current_state;
+  std::vector<u8> m_capture_state;
+  std::vector<u8> m_encode_buffer;
+
+  // Encoded deltas, written in a circular fashion. Entries never straddle the end of the storage.
+  std::vector<u8> m_storage;
+  u32 m_storage_write_position = 0;
+  u32 m_used_bytes = 0;
+
+  // Ring of entries, oldest first.
+  std::vector<Entry> m_entries;
+  u32 m_first_entry = 0;
+  u32 m_entry_count = 0;
+};
@@ -1,16 +1,20 @@
 #include "system.h"
-#include "YBaseLib/Timer.h"
+#include "YBaseLib/Assert.h"
 #include "apu.h"
 #include "bus.h"
 #include "cartridge.h"
 #include "common/audio.h"
+#include "common/state_wrapper.h"
+#include "controller.h"
 #include "cpu.h"
+#include "cpu_debug_interface.h"
 #include "ppu.h"
 
 System::System()
   : m_bus(std::make_unique<Bus>()), m_cpu(std::make_unique<CPU>()), m_ppu(std::make_unique<PPU>()),
-    m_apu(std::make_unique<APU>())
+    m_apu(std::make_unique<APU>()), m_debug_interface(std::make_unique<CPUDebugInterface>(this))
 {
+  m_cpu->SetDebugInterface(m_debug_interface.get());
 }
 
 System::~System() = default;
@@ -19,6 +23,10 @@ void System::SetCartridge(Cartridge* cartridge)
 {
   m_cartridge = cartridge;
   m_bus->SetCartridge(cartridge);
+
+  // Breakpoints in ROM are keyed by offset, so mean nothing for another cartridge. Nor do watchpoints.
+  m_debug_interface->ClearBreakpoints();
+  m_debug_interface->ClearWatchpoints();
 }
 
 void System::SetController(uint32 index, Controller* controller)
@@ -32,7 +40,7 @@ bool System::Initialize(Display* display, Audio* audio, Cartridge* cartridge)
   m_display = display;
   m_audio = audio;
 
-  if (!m_audio->Reconfigure(Audio::DefaultOutputSampleRate, 1))
+  if (m_audio && !m_audio->Reconfigure(APU::GetAudioQualitySampleRate(m_apu->GetAudioQuality()), 1))
     return false;
 
   m_bus->Initialize(m_cpu.get(), m_ppu.get(), m_apu.get());
@@ -45,7 +53,6 @@ bool System::Initialize(Display* display, Audio* audio, Cartridge* cartridge)
 
 void System::Reset()
 {
-  m_audio->EmptyBuffers();
   m_bus->Reset();
   m_cartridge->Reset();
   m_ppu->Reset();
@@ -54,13 +61,111 @@ void System::Reset()
   m_frame_number = 1;
 }
 
+std::unique_ptr<System> System::Clone(Display* display /* = nullptr */, Audio* audio /* = nullptr */)
+{
+  std::unique_ptr<System> clone = std::make_unique<System>();
+  clone->SetAudioQuality(GetAudioQuality());
+  clone->m_owned_cartridge = m_cartridge->Clone();
+  for (u32 i = 0; i < NUM_CONTROLLERS; i++)
+  {
+    if (!m_controllers[i])
+      continue;
+
+    clone->m_owned_controllers[i] = m_controllers[i]->Clone();
+    clone->SetController(i, clone->m_owned_controllers[i].get());
+  }
+
+  if (!clone->Initialize(display, audio, clone->m_owned_cartridge.get()))
+    return nullptr;
+
+  if (!CopyTo(clone.get()))
+    return nullptr;
+
+  return clone;
+}
+
+bool System::CopyTo(System* clone)
+{
+  DebugAssert(clone->m_cartridge->GetPRGROM().data() == m_cartridge->GetPRGROM().data());
+
+  // Copied through the save state path, as components hold pointers to each other.
+  clone->m_run_ahead_frames = m_run_ahead_frames;
+  return SaveState(&m_clone_state) && clone->LoadState(m_clone_state);
+}
+
+bool System::SaveState(std::vector<u8>* buffer)
+{
+  StateWrapper sw(buffer);
+  return DoState(sw);
+}
+
+bool System::LoadState(const std::vector<u8>& buffer)
+{
+  StateWrapper sw(buffer);
+  return DoState(sw);
+}
+
+bool System::DoState(StateWrapper& sw)
+{
+  sw.DoMarker("SYS");
+  sw.Do(&m_frame_number);
+
+  if (!m_bus->DoState(sw) || !m_ppu->DoState(sw) || !m_apu->DoState(sw) || !m_cartridge->DoState(sw))
+    return false;
+
+  for (Controller* controller : m_controllers)
+  {
+    if (controller && !controller->DoState(sw))
+      return false;
+  }
+
+  // The CPU goes last, so its interrupt line state takes precedence over lines raised while restoring devices.
+  return m_cpu->DoState(sw);
+}
+
 void System::SingleStep()
 {
   m_cpu->Execute(1);
   m_bus->ExecutePendingCycles();
 }
 
+void System::SetStatsEnabled(bool enabled)
+{
+  m_stats_enabled = enabled;
+  if (enabled)
+    m_perf_counters.Reset(m_cpu->GetInstructionsExecuted(), m_audio);
+
+  PerfCounters* counters = enabled ? &m_perf_counters : nullptr;
+  m_bus->SetPerfCounters(counters);
+  m_ppu->SetPerfCounters(counters);
+  m_apu->SetPerfCounters(counters);
+}
+
+void System::SetEventTimelineEnabled(bool enabled, u32 capacity /* = EventTimeline::DEFAULT_CAPACITY */)
+{
+  if (enabled)
+    m_event_timeline = std::make_unique<EventTimeline>(m_bus.get(), m_ppu.get(), capacity);
+  else
+    m_event_timeline.reset();
+
+  m_bus->SetEventTimeline(m_event_timeline.get());
+}
+
 void System::FrameStep()
+{
+  PerfCounters::Scope scope(m_stats_enabled ? &m_perf_counters : nullptr, PerfCounters::Section::CPU);
+  if (m_run_ahead_frames > 0 && !m_debug_interface->IsActive())
+  {
+    RunAheadFrameStep();
+  }
+  else
+  {
+    m_ppu->SetOutputEnabled(m_video_enabled);
+    RunFrame();
+  }
+}
+
+void System::RunFrame()
 {
   const u32 prev_frame_number = m_frame_number;
   while (m_frame_number == prev_frame_number)
@@ -69,24 +174,41 @@ void System::FrameStep()
     m_cpu->Execute(cpu_cycles);
     // m_cpu->Execute(1);
     m_bus->ExecutePendingCycles();
+    if (m_debug_interface->IsStopped())
+      break;
   }
 }
 
-void System::EndFrame()
+void System::RunAheadFrameStep()
 {
-  m_frame_number++;
+  // The real frame produces the audio, but its video is stale by the time it would be presented.
+  m_ppu->SetOutputEnabled(false);
+  RunFrame();
+
+  if (!SaveState(&m_run_ahead_state))
+    return;
 
-#if 0
-  static Timer tmr;
-  static u32 lf;
-  static u32 cc;
-  if (tmr.GetTimeSeconds() > 1.0f)
+  // Speculative frames must not produce audio, otherwise it would be heard more than once. Nor are they recorded in the
+  // event timeline, as they're discarded.
+  m_bus->SetEventTimeline(nullptr);
+  m_apu->BeginSpeculation();
+  for (u32 i = 0; i < m_run_ahead_frames; i++)
   {
-    u32 f = m_frame_number - lf;
-    std::fprintf(stderr, "%u frames in %f seconds (%f fps), %u cycles\n", f, tmr.GetTimeSeconds(), f / tmr.GetTimeSeconds(), m_cpu->GetCyclesSinceReset() - cc);
-    tmr.Reset();
-    lf = m_frame_number;
-    cc = m_cpu->GetCyclesSinceReset();
+    m_ppu->SetOutputEnabled(m_video_enabled && i == (m_run_ahead_frames - 1));
+    RunFrame();
   }
-#endif
+
+  LoadState(m_run_ahead_state);
+  m_apu->EndSpeculation();
+  m_bus->SetEventTimeline(m_event_timeline.get());
+}
+
+void System::EndFrame()
+{
+  if (EventTimeline* timeline = m_bus->GetEventTimeline())
+    timeline->Record(EventTimeline::Type::Frame, 0, 0, m_frame_number);
+
+  m_frame_number++;
+  if (m_stats_enabled)
+    m_perf_counters.EndFrame(m_cpu->GetInstructionsExecuted(), m_audio);
 }
@@ -1,16 +1,27 @@
 #pragma once
+#include "apu.h"
+#include "event_timeline.h"
+#include "perf_counters.h"
 #include "types.h"
 #include <memory>
+#include <vector>
 
 class Audio;
 class Bus;
 class CPU;
 class PPU;
-class APU;
 class Controller;
 class Cartridge;
+class CPUDebugInterface;
 class Display;
+class StateWrapper;
 
+// Thread safety: all emulation state belongs to the System, with no globals or function statics in the core, so any
+// number of systems can run at once, each on its own thread. A system and its display, audio, cartridge and
+// controllers must be used by one thread at a time; moving a system between threads between steps is fine, given the
+// usual synchronization. The exceptions are the cartridge's ROM, which is read-only and shared freely between clones,
+// and the audio output's ring, which is written by the system's thread and read by the device's. Logging goes to the
+// global log, so it is kept out of the per-cycle and per-instruction paths.
 class System
 {
 public:
@@ -20,26 +31,80 @@ public:
   ~System();
 
   Bus* GetBus() { return m_bus.get(); }
+  const Bus* GetBus() const { return m_bus.get(); }
   CPU* GetCPU() { return m_cpu.get(); }
   PPU* GetPPU() { return m_ppu.get(); }
   APU* GetAPU() { return m_apu.get(); }
 
+  // Breakpoints and stepping. Stopping in the debugger ends a frame step early, and frame steps return straight away
+  // while stopped. Run-ahead is skipped while the debugger is active.
+  CPUDebugInterface* GetDebugInterface() { return m_debug_interface.get(); }
+
   Cartridge* GetCartridge() { return m_cartridge; }
   void SetCartridge(Cartridge* cartridge);
 
   Controller* GetController(uint32 index) const { return m_controllers[index]; }
   void SetController(uint32 index, Controller* controller);
 
+  // Display and audio may be null, to run without output.
   bool Initialize(Display* display, Audio* audio, Cartridge* cartridge);
+
+  // Selects the audio synthesis tier. The audio device is opened at the tier's preferred sample rate if this is called
+  // before Initialize(); after, only the synthesis changes.
+  APU::AudioQuality GetAudioQuality() const { return m_apu->GetAudioQuality(); }
+  void SetAudioQuality(APU::AudioQuality quality) { m_apu->SetAudioQuality(quality); }
   void Reset();
 
+  // Creates an independent copy of the system in its current state, which owns copies of the cartridge and
+  // controllers. ROM is shared with this system. The copy outputs to the given display and audio rather than this
+  // system's, which may be null. Must be called between steps.
+  std::unique_ptr<System> Clone(Display* display = nullptr, Audio* audio = nullptr);
+
+  // Overwrites the state of a previous clone of this system with the current state, without allocating. Creating a
+  // System is dominated by Nes_Apu's synthesis table setup, so reusing clones is much faster when forking repeatedly.
+  bool CopyTo(System* clone);
+
   void SingleStep();
   void FrameStep();
 
+  // With video disabled, frames are emulated in full but no pixels are produced or presented, which suits jobs that
+  // only read memory. A system initialized without a display never produces video. Applies from the next frame step,
+  // so it can be switched per frame, such as to only render every Nth frame.
+  bool IsVideoEnabled() const { return m_video_enabled; }
+  void SetVideoEnabled(bool enabled) { m_video_enabled = enabled; }
+
+  // Run-ahead hides the game's own input lag. Each frame step emulates this many additional frames with the current
+  // input, presents the last one, then restores the state. Zero disables run-ahead.
+  u32 GetRunAheadFrames() const { return m_run_ahead_frames; }
+  void SetRunAheadFrames(u32 frames) { m_run_ahead_frames = frames; }
+
+  // Performance counters, which time each component and count cycles, instructions and syncs per frame. Off by
+  // default; while off, the cost is a null check at each switch between components. Enabling clears the history.
+  // Speculative frames from run-ahead are counted as frames of their own.
+  bool IsStatsEnabled() const { return m_stats_enabled; }
+  void SetStatsEnabled(bool enabled);
+  PerfCounters::Stats GetStats() const { return m_perf_counters.GetStats(); }
+  const PerfCounters::FrameStats& GetLastFrameStats() const { return m_perf_counters.GetLastFrameStats(); }
+
+  // Event timeline, which records interrupts, DMA stalls and register writes with their emulated time. Off by
+  // default; while off, the cost is a null check at each event. Enabling starts a new, empty timeline, and disabling
+  // discards it.
+  EventTimeline* GetEventTimeline() const { return m_event_timeline.get(); }
+  void SetEventTimelineEnabled(bool enabled, u32 capacity = EventTimeline::DEFAULT_CAPACITY);
+
   u32 GetFrameNumber() const { return m_frame_number; }
   void EndFrame();
 
+  // Saves/restores the complete machine state, excluding ROM and host input. Must be called between steps.
+  // The buffer's capacity is retained, so repeated saves into the same buffer don't allocate.
+  bool SaveState(std::vector<u8>* buffer);
+  bool LoadState(const std::vector<u8>& buffer);
+
 private:
+  bool DoState(StateWrapper& sw);
+  void RunFrame();
+  void RunAheadFrameStep();
+
   Display* m_display = nullptr;
   Audio* m_audio = nullptr;
 
@@ -47,10 +112,26 @@ private:
   std::unique_ptr<CPU> m_cpu;
   std::unique_ptr<PPU> m_ppu;
   std::unique_ptr<APU> m_apu;
+  std::unique_ptr<CPUDebugInterface> m_debug_interface;
 
   Cartridge* m_cartridge = nullptr;
 
   Controller* m_controllers[NUM_CONTROLLERS] = {};
 
+  // Only set for clones, normally the cartridge and controllers are owned by the host.
+  std::unique_ptr<Cartridge> m_owned_cartridge;
+  std::unique_ptr<Controller> m_owned_controllers[NUM_CONTROLLERS];
+
   u32 m_frame_number = 1;
+
+  bool m_video_enabled = true;
+
+  PerfCounters m_perf_counters;
+  bool m_stats_enabled = false;
+
+  std::unique_ptr<EventTimeline> m_event_timeline;
+
+  u32 m_run_ahead_frames = 0;
+  std::vector<u8> m_run_ahead_state;
+  std::vector<u8> m_clone_state;
 };
@@ -0,0 +1,34 @@
+#include "system_pool.h"
+#include "YBaseLib/Assert.h"
+#include "system.h"
+#include <algorithm>
+
+SystemPool::SystemPool(u32 num_threads /* = 0 */) : m_pool(num_threads) {}
+
+SystemPool::~SystemPool() = default;
+
+void SystemPool::AddSystem(System* system)
+{
+  DebugAssert(std::find(m_systems.begin(), m_systems.end(), system) == m_systems.end());
+  m_tasks.push_back(static_cast<u32>(m_systems.size()));
+  m_systems.push_back(system);
+}
+
+void SystemPool::RemoveSystem(System* system)
+{
+  auto iter = std::find(m_systems.begin(), m_systems.end(), system);
+  if (iter == m_systems.end())
+    return;
+
+  m_systems.erase(iter);
+  m_tasks.pop_back();
+}
+
+void SystemPool::FrameStep(u32 frames /* = 1 */)
+{
+  m_pool.Run(m_tasks.data(), static_cast<u32>(m_tasks.size()), [this, frames](u32 index) {
+    System* system = m_systems[index];
+    for (u32 i = 0; i < frames; i++)
+      system->FrameStep();
+  });
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "common/work_stealing_pool.h"
+#include "types.h"
+#include <vector>
+
+class System;
+
+// Steps many independent systems at once on a work-stealing pool, such as for batch testing or training agents.
+// Systems are not owned. Each system is stepped by one thread at a time, so the contract in system.h is met as long as
+// the systems don't share a display, audio output, cartridge or controller.
+class SystemPool
+{
+public:
+  // Zero threads means one per core.
+  explicit SystemPool(u32 num_threads = 0);
+  ~SystemPool();
+
+  u32 GetThreadCount() const { return m_pool.GetThreadCount(); }
+  u32 GetSystemCount() const { return static_cast<u32>(m_systems.size()); }
+  System* GetSystem(u32 index) const { return m_systems[index]; }
+
+  void AddSystem(System* system);
+  void RemoveSystem(System* system);
+
+  // Runs every system for the given number of frames, and returns when all of them have finished.
+  void FrameStep(u32 frames = 1);
+
+private:
+  WorkStealingPool m_pool;
+  std::vector<System*> m_systems;
+  std::vector<u32> m_tasks;
+};